@@ -1,12 +1,16 @@
 #include "ads1115.h"
 
 #include "twi.h"
+#include "scheduler.h"
 
-#define ADS1115_ADDRESS (0x48<<1)
+#define ADS1115_PERIOD_MS	250
 
+#include <stddef.h>
 #include <stdio.h>
 #include <avr/pgmspace.h>
 
+#include "hal.h"
+
 #define OS 	15
 #define MUXX2 	14
 #define MUXX1 	13
@@ -43,6 +47,12 @@
 // Data rate (DR)
 // 000 : 8SPS
 #define DR_8SPS 		(0)
+// 001 : 16SPS
+#define DR_16SPS 		(_BV(DR0))
+// 010 : 32SPS
+#define DR_32SPS 		(_BV(DR1))
+// 011 : 64SPS
+#define DR_64SPS 		(_BV(DR1) | _BV(DR0))
 // 100 : 128SPS (default)
 #define DR_128SPS 		(_BV(DR2))
 
@@ -65,67 +75,343 @@
 // 111 : AINP = AIN3 and AINN = GND
 #define IM_IN3_GND 		(_BV(MUXX2) | _BV(MUXX1) | _BV(MUXX0))
 
-#define ADS1115_CFG_CH0 	(_BV(OS) | IM_IN1_GND | _BV(MODE) | DR_8SPS | PGA_2_048 | _BV(COMP_QUE1) | _BV(COMP_QUE0))
+#define ADS1115_START_SINGLE	((1U << OS) | _BV(MODE))
+
+/*
+ * Channel scan table: device address, input multiplexer, PGA and data
+ * rate of each channel.  Conversions are run one at a time, round
+ * robin over the table.  With a single channel, the device is left in
+ * continuous conversion.
+ */
+typedef struct {
+  uint8_t address;
+  uint16_t config;
+} _ads1115_scan_t;
+
+#define ADS1115_SCAN(ADDRESS, MUX, PGA, DR) { ((ADDRESS) << 1), ((MUX) | (PGA) | (DR)) }
+
+static const _ads1115_scan_t _ads1115_scan_table[ADS1115_CHANNEL_COUNT] PROGMEM = {
+  [ADS1115_CHANNEL_OIL_TEMPERATURE] = ADS1115_SCAN(0x48, IM_IN1_GND, PGA_2_048, DR_32SPS),
+  [ADS1115_CHANNEL_DIESEL_TEMPERATURE] = ADS1115_SCAN(0x48, IM_IN2_GND, PGA_2_048, DR_16SPS),
+  [ADS1115_CHANNEL_COOLANT_TEMPERATURE] = ADS1115_SCAN(0x48, IM_IN3_GND, PGA_2_048, DR_16SPS),
+  [ADS1115_CHANNEL_FUEL_PRESSURE] = ADS1115_SCAN(0x48, IM_IN0_GND, PGA_4_096, DR_64SPS),
+};
+
+#define ADS1115_CONTINUOUS	(ADS1115_CHANNEL_COUNT == 1)
 
 #define ADS1115_REG_CONVERSION 	0x00
 #define ADS1115_REG_CONFIG 	0x01
+#define ADS1115_REG_LO_THRESH 	0x02
+#define ADS1115_REG_HI_THRESH 	0x03
 
-void
-ads1115_init(void)
+// Conversion ready signal: ALERT/RDY pins (wired together) on INT1
+#define ADS1115_RDY		HAL_PIN_ADS1115_RDY	// Arduino Digital Pin 3
+
+// Connection is lost when no conversion is retrieved within this delay
+#define ADS1115_TIMEOUT_MS	500	// 4 conversions at 8 SPS
+
+volatile twi_connection_state ads1115_connection_state;
+volatile int ads1115_connection_last_error;
+
+static volatile ads1115_sample_t _ads1115_samples[ADS1115_CHANNEL_COUNT];
+static volatile uint8_t _ads1115_channel;
+static volatile uint32_t _ads1115_rdy_timestamp;
+static uint32_t _ads1115_start_timestamp;
+static volatile uint16_t _ads1115_overruns = 0;
+static void (*_ads1115_sample_hook)(const ads1115_channel_t channel, const int16_t value) = NULL;
+
+static void _ads1115_setup_done(twi_transaction_t *transaction);
+static void _ads1115_conversion_done(twi_transaction_t *transaction);
+
+/*
+ * Setup sequence: for each device, Hi_thresh MSB set and Lo_thresh
+ * MSB cleared turn the ALERT/RDY pin into a conversion ready signal.
+ * Steps are numbered per channel, those of channels sharing the device
+ * of a previous one are skipped.  Then conversion of the first channel
+ * is started.
+ *
+ * In continuous mode, register pointer is left on the conversion
+ * register: samples are then retrieved with a single read.
+ */
+#define ADS1115_SETUP_STEPS	(2 * ADS1115_CHANNEL_COUNT + (ADS1115_CONTINUOUS ? 2 : 1))
+
+static uint8_t _ads1115_setup_step;
+static uint8_t _ads1115_setup_data[3];
+static twi_transaction_t _ads1115_setup_transaction = {
+  .write_buf = _ads1115_setup_data,
+  .read_len = 0,
+  .read_buf = NULL,
+  .callback = _ads1115_setup_done,
+  .status = TWI_OK
+};
+
+// Read conversion register
+static uint8_t _ads1115_pointer = ADS1115_REG_CONVERSION;
+static uint8_t _ads1115_conversion[2];
+static twi_transaction_t _ads1115_conversion_transaction = {
+  .write_len = ADS1115_CONTINUOUS ? 0 : 1,
+  .write_buf = &_ads1115_pointer,
+  .read_len = sizeof(_ads1115_conversion),
+  .read_buf = _ads1115_conversion,
+  .callback = _ads1115_conversion_done,
+  .status = TWI_OK
+};
+
+void ads1115_process(void);
+
+/*
+ * Conversion ready, retrieve it.
+ */
+ISR(INT1_vect)
 {
-  // FIXME Test connection
-  ads1115_connection_state = CONNECTION_OK;
-  ads1115_connection_last_error = 0;
+  if (_ads1115_setup_step != ADS1115_SETUP_STEPS)
+    return;
+  if (_ads1115_conversion_transaction.status == TWI_PENDING) {
+    _ads1115_overruns++;
+    return;
+  }
+  _ads1115_rdy_timestamp = scheduler_millis();
+  _ads1115_conversion_transaction.addr = pgm_read_byte(&_ads1115_scan_table[_ads1115_channel].address);
+  if (TWI_OK != twi_submit(&_ads1115_conversion_transaction))
+    _ads1115_overruns++;
 }
 
-#define ADS1115_ERR_CONNECTION_LOST -32768
-int16_t
-ads1115_read(void)
+static void
+_ads1115_connection_lost(const int error)
 {
-  // Set configuration
-  uint8_t data[3] = { ADS1115_REG_CONFIG, (ADS1115_CFG_CH0 >> 8), (ADS1115_CFG_CH0 & 0xff) };
-  if (0 > (ads1115_connection_last_error = twi_write_bytes(ADS1115_ADDRESS, 3, data))) {
-    ads1115_connection_state = CONNECTION_BROKEN;
-    return ADS1115_ERR_CONNECTION_LOST;
-  } else {
-    ads1115_connection_state = CONNECTION_OK;
+  ads1115_connection_last_error = error;
+  ads1115_connection_state = CONNECTION_BROKEN;
+  for (uint8_t channel = 0; channel < ADS1115_CHANNEL_COUNT; channel++) {
+    _ads1115_samples[channel].value = ADS1115_ERR_CONNECTION_LOST;
+    if (_ads1115_sample_hook != NULL)
+      _ads1115_sample_hook(channel, ADS1115_ERR_CONNECTION_LOST);
   }
+}
 
-  // Read configuration
-  if (0 > twi_read_bytes(ADS1115_ADDRESS, 2, data)) {
-    ads1115_connection_state = CONNECTION_BROKEN;
-    return ADS1115_ERR_CONNECTION_LOST;
-  } else {
-    ads1115_connection_state = CONNECTION_OK;
-  }
+/*
+ * Write 16 bits "value" into register "reg" of the device of
+ * "channel".
+ */
+static void
+_ads1115_setup_write(const uint8_t channel, const uint8_t reg, const uint16_t value)
+{
+  _ads1115_setup_transaction.addr = pgm_read_byte(&_ads1115_scan_table[channel].address);
+  _ads1115_setup_transaction.write_len = 3;
+  _ads1115_setup_data[0] = reg;
+  _ads1115_setup_data[1] = value >> 8;
+  _ads1115_setup_data[2] = value & 0xff;
+  if (TWI_OK != twi_submit(&_ads1115_setup_transaction))
+    _ads1115_connection_lost(TWI_ERR_QUEUE_FULL);
+}
 
-  // Compare if its OK
-  // uint16_t config = (data[0] << 8) | data[1];
-  // printf_P(PSTR("Expected: %04x, register: %04x\n"), ADS1115_CFG_CH0 & ~(0x8000), config);
+/*
+ * Start conversion of "channel": continuous conversion if it is the
+ * only one, single shot otherwise.
+ */
+static void
+_ads1115_convert(const uint8_t channel)
+{
+  const uint16_t config = pgm_read_word(&_ads1115_scan_table[channel].config);
+  _ads1115_channel = channel;
+  _ads1115_setup_write(channel, ADS1115_REG_CONFIG, ADS1115_CONTINUOUS ? config : (config | ADS1115_START_SINGLE));
+}
 
-  // Retrieve conversion result
-  // Important: this will return the PREVIOUS converted value, to retrieve the
-  // current shot we need to way OS flag is set on configuration register
+/*
+ * "channel" is the first of the scan table on its device.
+ */
+static bool
+_ads1115_first_of_device(const uint8_t channel)
+{
+  const uint8_t address = pgm_read_byte(&_ads1115_scan_table[channel].address);
 
-  // Point to "conversion" register
-  data[0] = ADS1115_REG_CONVERSION;
-  if (0 > (ads1115_connection_last_error = twi_write_bytes(ADS1115_ADDRESS, 1, data))) {
-    ads1115_connection_state = CONNECTION_BROKEN;
-    return ADS1115_ERR_CONNECTION_LOST;
-  } else {
-    ads1115_connection_state = CONNECTION_OK;
+  for (uint8_t n = 0; n < channel; n++) {
+    if (pgm_read_byte(&_ads1115_scan_table[n].address) == address)
+      return false;
   }
+  return true;
+}
 
-  // Read register
-  if (0 > twi_read_bytes(ADS1115_ADDRESS, 2, data)) {
-    ads1115_connection_state = CONNECTION_BROKEN;
-    return ADS1115_ERR_CONNECTION_LOST;
+/*
+ * Submit next step of setup sequence.
+ */
+static void
+_ads1115_setup_next(void)
+{
+  // Thresholds are written from the first channel of each device only
+  while ((_ads1115_setup_step < 2 * ADS1115_CHANNEL_COUNT) && !_ads1115_first_of_device(_ads1115_setup_step >> 1))
+    _ads1115_setup_step += 2;
+
+  const uint8_t step = _ads1115_setup_step;
+  if (step < 2 * ADS1115_CHANNEL_COUNT) {
+    if (step & 1)
+      _ads1115_setup_write(step >> 1, ADS1115_REG_HI_THRESH, 0x8000);
+    else
+      _ads1115_setup_write(step >> 1, ADS1115_REG_LO_THRESH, 0x0000);
+  } else if (step == 2 * ADS1115_CHANNEL_COUNT) {
+    _ads1115_convert(0);
   } else {
-    ads1115_connection_state = CONNECTION_OK;
+    // Continuous mode: point to conversion register
+    _ads1115_setup_transaction.write_len = 1;
+    _ads1115_setup_data[0] = ADS1115_REG_CONVERSION;
+    if (TWI_OK != twi_submit(&_ads1115_setup_transaction))
+      _ads1115_connection_lost(TWI_ERR_QUEUE_FULL);
+  }
+}
+
+static void
+_ads1115_setup_done(twi_transaction_t *transaction)
+{
+  if (transaction->status != TWI_OK) {
+    _ads1115_connection_lost(transaction->status);
+    return;
   }
+  if (_ads1115_setup_step < ADS1115_SETUP_STEPS) {
+    if (++_ads1115_setup_step != ADS1115_SETUP_STEPS)
+      _ads1115_setup_next();
+  }
+}
+
+static void
+_ads1115_conversion_done(twi_transaction_t *transaction)
+{
+  if (transaction->status != TWI_OK) {
+    _ads1115_connection_lost(transaction->status);
+    return;
+  }
+  ads1115_connection_state = CONNECTION_OK;
 
   // Convert value to int16_t
-  int16_t value = (data[0] << 8) | data[1];
-  return value;
+  const uint8_t channel = _ads1115_channel;
+  _ads1115_samples[channel].value = (_ads1115_conversion[0] << 8) | _ads1115_conversion[1];
+  _ads1115_samples[channel].timestamp = _ads1115_rdy_timestamp;
+  if (_ads1115_sample_hook != NULL)
+    _ads1115_sample_hook(channel, _ads1115_samples[channel].value);
+
+  // Round robin
+  if (!ADS1115_CONTINUOUS)
+    _ads1115_convert((channel + 1 == ADS1115_CHANNEL_COUNT) ? 0 : (channel + 1));
+}
+
+/*
+ * (Re)start conversions.
+ */
+static void
+_ads1115_start(void)
+{
+  const uint8_t sreg = SREG;
+  cli();
+  _ads1115_start_timestamp = scheduler_millis();
+  _ads1115_setup_step = 0;
+  _ads1115_setup_next();
+  SREG = sreg;
 }
 
+void
+ads1115_init(void)
+{
+  ads1115_connection_state = CONNECTION_OK;
+  ads1115_connection_last_error = 0;
+  for (uint8_t channel = 0; channel < ADS1115_CHANNEL_COUNT; channel++)
+    _ads1115_samples[channel].value = ADS1115_ERR_CONNECTION_LOST;
+
+  // ALERT/RDY is open drain: input with internal pull up, interrupt on falling edge
+  hal_pin_input_pullup(ADS1115_RDY);
+  hal_extint_enable(HAL_EXTINT1, HAL_EDGE_FALLING);
+
+  _ads1115_start();
+
+  scheduler_add_hook_fct(ads1115_process, ADS1115_PERIOD_MS, SCHEDULER_CONTEXT_MAIN);
+}
+
+/*
+ * Connection watchdog: restart conversions when they stop coming.
+ */
+void
+ads1115_process(void)
+{
+  if ((_ads1115_setup_transaction.status == TWI_PENDING) || (_ads1115_conversion_transaction.status == TWI_PENDING))
+    return;
+
+  // Setup sequence failed
+  if (_ads1115_setup_step != ADS1115_SETUP_STEPS) {
+    _ads1115_start();
+    return;
+  }
+
+  // Conversion of current channel should be over for long
+  ads1115_sample_t sample;
+  uint8_t previous = _ads1115_channel;
+  previous = (previous == 0) ? (ADS1115_CHANNEL_COUNT - 1) : (previous - 1);
+  ads1115_get_sample(ADS1115_CONTINUOUS ? 0 : previous, &sample);
+  const uint32_t now = scheduler_millis();
+  if ((now - sample.timestamp > ADS1115_TIMEOUT_MS) && (now - _ads1115_start_timestamp > ADS1115_TIMEOUT_MS)) {
+    _ads1115_connection_lost(TWI_ERR_UNKNOWN);
+    _ads1115_start();
+  }
+}
+
+/*
+ * Back from power-down: conversion ready edges were lost and the time
+ * spent asleep would be taken for a connection loss, start over.
+ */
+void
+ads1115_resume(void)
+{
+  if ((_ads1115_setup_transaction.status == TWI_PENDING) || (_ads1115_conversion_transaction.status == TWI_PENDING))
+    return;
+  _ads1115_start();
+}
+
+/*
+ * Set function called with each new conversion, from interrupt
+ * context, or with ADS1115_ERR_CONNECTION_LOST for every channel when
+ * connection is lost.
+ */
+void
+ads1115_set_sample_hook(void (*fct)(const ads1115_channel_t channel, const int16_t value))
+{
+  const uint8_t sreg = SREG;
+  cli();
+  _ads1115_sample_hook = fct;
+  SREG = sreg;
+}
+
+/*
+ * Copy the last retrieved conversion of "channel" and its timestamp
+ * (ms, see scheduler_millis()).  The bus is not accessed.
+ */
+void
+ads1115_get_sample(const ads1115_channel_t channel, ads1115_sample_t *sample)
+{
+  const uint8_t sreg = SREG;
+  cli();
+  sample->value = _ads1115_samples[channel].value;
+  sample->timestamp = _ads1115_samples[channel].timestamp;
+  SREG = sreg;
+}
+
+/*
+ * Return the last converted value of "channel", or
+ * ADS1115_ERR_CONNECTION_LOST.
+ */
+int16_t
+ads1115_read(const ads1115_channel_t channel)
+{
+  ads1115_sample_t sample;
+  ads1115_get_sample(channel, &sample);
+  return sample.value;
+}
+
+/*
+ * Number of conversions missed because the previous one was still
+ * being retrieved.
+ */
+uint16_t
+ads1115_overruns(void)
+{
+  const uint8_t sreg = SREG;
+  cli();
+  const uint16_t overruns = _ads1115_overruns;
+  SREG = sreg;
+  return overruns;
+}
@@ -3,10 +3,30 @@
 
 #include "twi.h"
 
-volatile twi_connection_state ads1115_connection_state;
-volatile int ads1115_connection_last_error;
+extern volatile twi_connection_state ads1115_connection_state;
+extern volatile int ads1115_connection_last_error;
+
+#define ADS1115_ERR_CONNECTION_LOST -32768
+
+// Channels, see scan table in ads1115.c
+typedef enum {
+  ADS1115_CHANNEL_OIL_TEMPERATURE,
+  ADS1115_CHANNEL_DIESEL_TEMPERATURE,
+  ADS1115_CHANNEL_COOLANT_TEMPERATURE,
+  ADS1115_CHANNEL_FUEL_PRESSURE,
+  ADS1115_CHANNEL_COUNT
+} ads1115_channel_t;
+
+typedef struct {
+  int16_t value;
+  uint32_t timestamp;	// ms, see scheduler_millis()
+} ads1115_sample_t;
 
 void ads1115_init(void);
-int16_t ads1115_read(void);
+void ads1115_resume(void);
+int16_t ads1115_read(const ads1115_channel_t channel);
+void ads1115_get_sample(const ads1115_channel_t channel, ads1115_sample_t *sample);
+uint16_t ads1115_overruns(void);
+void ads1115_set_sample_hook(void (*fct)(const ads1115_channel_t channel, const int16_t value));
 
 #endif /* __ADS1115_H__ */
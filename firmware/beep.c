@@ -1,28 +1,19 @@
 #include "beep.h"
 
-#include <avr/io.h>
-#include <avr/interrupt.h>
+#include <stddef.h>
 
-#include <util/delay.h>
-
-#include <string.h>
-
-#define OCR			OCR0A
-#define DDROC			DDRD
-#define OC0			PD6	// Arduino Digital Pin 6
-#define TCCRA			TCCR0A
-#define TCCRB			TCCR0B
+#include "hal.h"
 
 /*
-  PWM is used in CTC mode @62.5Khz (16Mhz / 256)
+  PWM is used in CTC mode @62.5Khz (16Mhz / 256), see hal_tone_start()
 
   fq = 1 / (x * 1/62.5k * 2)
   x = 62.5k / ( 2 * fq )
 
   http://www.phy.mtu.edu/~suits/notefreqs.html
 */
-#define FQ2CTC(fq) ( 62500 / ( 2 * fq ) )
-typedef enum {
+#define FQ2CTC(fq) ( HAL_TONE_HZ / ( 2 * fq ) )
+enum {
   NOTE_DO2 = FQ2CTC(131),	// C3
   NOTE_RE2 = FQ2CTC(147),	// D3
   NOTE_MI2 = FQ2CTC(165),	// E3
@@ -44,79 +35,144 @@ typedef enum {
   NOTE_SOL4 = FQ2CTC(784),	// G5
   NOTE_LA4 = FQ2CTC(880),	// A5
   NOTE_SI4 = FQ2CTC(988)	// B5
-} note_t;
+};
 
 
-void beep_ctc_start(void);
-void beep_ctc_stop(void);
+// Notes lookup table, indexed by letter: 'a' to 'g' (octave 3), 'A' to 'G' (octave 4)
+static const uint8_t _beep_notes[2][7] PROGMEM = {
+  { NOTE_LA3, NOTE_SI3, NOTE_DO3, NOTE_RE3, NOTE_MI3, NOTE_FA3, NOTE_SOL3 },
+  { NOTE_LA4, NOTE_SI4, NOTE_DO4, NOTE_RE4, NOTE_MI4, NOTE_FA4, NOTE_SOL4 }
+};
 
-void
-beep_play_note(const note_t note)
+// Rests are timed with 2 ms compare match periods
+#define BEEP_REST_CTC	124
+
+// Default durations, in tempo units
+#define BEEP_NOTE_UNITS	2
+#define BEEP_REST_UNITS	1
+
+// Partitions waiting to be played
+#define BEEP_QUEUE_SIZE	4
+
+static const char *volatile _beep_queue[BEEP_QUEUE_SIZE];
+static volatile uint8_t _beep_queue_head = 0;
+static volatile uint8_t _beep_queue_tail = 0;
+
+// Partition being played (NULL when idle), and compare matches left for the current note
+static const char *_beep_partition = NULL;
+static volatile uint16_t _beep_remaining;
+
+static volatile uint8_t _beep_tempo = BEEP_DEFAULT_TEMPO;
+
+static void beep_next(void);
+
+ISR(TIMER0_COMPA_vect)
 {
-  OCR = note;
-  beep_ctc_start();
-  _delay_ms(150.);
-  beep_ctc_stop();
+  if (--_beep_remaining == 0)
+    beep_next();
 }
 
-void beep_play_partition_P(const char *partition)
+/*
+ * Start the next note or rest of the partition being played, or the
+ * next queued partition, or stop the timer when there is nothing left
+ * to play.  Called with interrupts disabled.
+ */
+static void
+beep_next(void)
 {
-  char	n;
-  while ((n = pgm_read_byte(partition++))) {
-    switch (n) {
-      case 'c': 		// Do = C4
-        beep_play_note(NOTE_DO3);
-        break;
-      case 'd': 		// Ré = D4
-        beep_play_note(NOTE_RE3);
-        break;
-      case 'e': 		// Mi = E4
-        beep_play_note(NOTE_MI3);
-        break;
-      case 'f': 		// Fa = F4
-        beep_play_note(NOTE_FA3);
-        break;
-      case 'g': 		// Sol = G4
-        beep_play_note(NOTE_SOL3);
-        break;
-      case 'a': 		// La = A4
-        beep_play_note(NOTE_LA3);
-        break;
-      case 'b': 		// Si3 = B4
-        beep_play_note(NOTE_SI3);
-        break;
-      case 'C': 		// Do4 = C5
-        beep_play_note(NOTE_DO4);
-        break;
-      case 'D': 		// Ré4 = D5
-        beep_play_note(NOTE_RE4);
-        break;
-      case 'E': 		// Mi4 = E5
-        beep_play_note(NOTE_MI4);
-        break;
-      case 'F': 		// Fa4 = F5
-        beep_play_note(NOTE_FA4);
-        break;
-      case 'G': 		// Sol4 = G5
-        beep_play_note(NOTE_SOL4);
-        break;
-      case 'A': 		// La4 = A5
-        beep_play_note(NOTE_LA4);
-        break;
-      case 'B': 		// Si4 = B5
-        beep_play_note(NOTE_SI4);
-        break;
-      default:
-        _delay_ms(75.);
+  char n;
+
+  while ((_beep_partition == NULL) || ((n = pgm_read_byte(_beep_partition)) == '\0')) {
+    if (_beep_queue_tail == _beep_queue_head) {
+      _beep_partition = NULL;
+      hal_tone_stop();
+      return;
     }
+    _beep_partition = _beep_queue[_beep_queue_tail];
+    _beep_queue_tail = (_beep_queue_tail + 1) % BEEP_QUEUE_SIZE;
   }
+  _beep_partition++;
+
+  uint8_t ctc;
+  uint8_t units;
+  if ((n >= 'a') && (n <= 'g')) {
+    ctc = pgm_read_byte(&_beep_notes[0][n - 'a']);
+    units = BEEP_NOTE_UNITS;
+  } else if ((n >= 'A') && (n <= 'G')) {
+    ctc = pgm_read_byte(&_beep_notes[1][n - 'A']);
+    units = BEEP_NOTE_UNITS;
+  } else {
+    ctc = 0;
+    units = BEEP_REST_UNITS;
+  }
+
+  // Optional duration
+  const char d = pgm_read_byte(_beep_partition);
+  if ((d >= '1') && (d <= '9')) {
+    units = d - '0';
+    _beep_partition++;
+  }
+
+  const uint16_t ms = (uint16_t)units * _beep_tempo;
+  if (ctc != 0) {
+    _beep_remaining = ((uint32_t)ms * 125) / (2 * ((uint16_t)ctc + 1));	/* ms * 62.5 kHz / (ctc + 1) */
+  } else {
+    _beep_remaining = ms / 2;
+  }
+  if (_beep_remaining == 0)
+    _beep_remaining = 1;
+
+  // Toggle buzzer on compare match, rests keep it disconnected
+  hal_tone_start((ctc != 0) ? ctc : BEEP_REST_CTC, ctc != 0);
+}
+
+/*
+ * Queue a partition stored in program memory, and return at once.
+ *
+ * Partition is a string of notes: 'c' to 'b' from C4 to B4, 'C' to 'B'
+ * from C5 to B5, any other character being a rest.  Each note or rest
+ * may be followed by its duration in tempo units ('1' to '9'), notes
+ * default to 2 units and rests to 1 unit.  Partition is dropped if
+ * too many are already waiting.
+ */
+void
+beep_play_partition_P(const char *partition)
+{
+  const uint8_t sreg = SREG;
+  cli();
+  const uint8_t head = (_beep_queue_head + 1) % BEEP_QUEUE_SIZE;
+  if (head != _beep_queue_tail) {
+    _beep_queue[_beep_queue_head] = partition;
+    _beep_queue_head = head;
+    if (_beep_partition == NULL)
+      beep_next();
+  }
+  SREG = sreg;
+}
+
+/*
+ * Set tempo unit duration, in ms.
+ */
+void
+beep_set_tempo(const uint8_t unit_ms)
+{
+  _beep_tempo = unit_ms;
+}
+
+/*
+ * A partition is being played, the tone timer is running.
+ */
+bool
+beep_playing(void)
+{
+  return _beep_partition != NULL;
 }
 
 void
 beep_init(void)
 {
   /* Enable OC0 as output. */
-  DDROC |= _BV(OC0);
+  hal_pin_output(HAL_PIN_BEEP);
 
   // TODO: Set OC0 at low level
 
@@ -130,26 +186,3 @@ beep_init(void)
   // Utop'huile init beeps :)
   beep_play_partition_P(PSTR("GA_AG"));
 }
-
-void
-beep_ctc_start(void)
-{
-  /* Timer 0 is 8-bit PWM. */
-  TCCRA = _BV(WGM01) | _BV(COM0A0);	/*  Compare Output Mode, Fast PWM Mode + CTC mode */
-  TCCRB = _BV(CS02);			/* 16 Mhz / 256 */
-
-  /* Enable timer 0 overflow interrupt. */
-// 	TIMSK |= _BV(OCIE0);
-}
-
-void
-beep_ctc_stop(void)
-{
-  /* Timer 0 is 8-bit PWM. */
-  TCCRA = 0x00;
-
-  // TODO: Set OC0 at low level
-
-  /* Disable timer 2 overflow interrupt. */
-// 	TIMSK &= ~(_BV(OCIE0));
-}
@@ -2,8 +2,14 @@
 #define __BEEP_H__
 
 #include <avr/pgmspace.h>
+#include <stdbool.h>
+
+// Default tempo unit duration, in ms
+#define BEEP_DEFAULT_TEMPO	75
 
 void beep_init(void);
 void beep_play_partition_P(const char *partition);
+void beep_set_tempo(const uint8_t unit_ms);
+bool beep_playing(void);
 
 #endif				/* !__BEEP_H__ */
@@ -1,17 +1,17 @@
 #include "buttons.h"
 
-#include <avr/io.h>
-#include <avr/interrupt.h>
-
 #include <stdio.h>
 
+#include "hal.h"
+
 #include "beep.h"
 #include "scheduler.h"
 
-#define BUTTONS_PORT 	PORTD
-#define BUTTONS_PIN	PIND
-#define BUTTONS_DDR 	DDRD
-#define BUTTON0 	PD2
+#define BUTTON0 	HAL_PIN_BUTTON0
+
+#define BUTTONS_PERIOD_MS	50
+#define BUTTONS_LONG_PRESS_MS	1000
+#define BUTTONS_LONG_PRESS	(BUTTONS_LONG_PRESS_MS / BUTTONS_PERIOD_MS)	// in buttons_process() periods
 
 typedef enum {
   BUTTON_RELEASED,
@@ -26,9 +26,9 @@ void buttons_process(void);
 
 ISR(INT0_vect)
 {
-  if (bit_is_set(BUTTONS_PIN, BUTTON0)) {
+  if (hal_pin_read(BUTTON0)) {
     _button0_state = BUTTON_RELEASED;
-    if (_button0_pressed_counter < 2) {
+    if (_button0_pressed_counter < BUTTONS_LONG_PRESS) {
       _buttons_requested_action = BUTTON_ACTION_OK;
     } else {
 
@@ -43,13 +43,11 @@ void
 buttons_init(void)
 {
   /* Dashboard button */
-  BUTTONS_DDR &= ~(_BV(BUTTON0));		// BUTTON0 as input
-  BUTTONS_PORT |= _BV(BUTTON0);		// Enable internal pull up
+  hal_pin_input_pullup(BUTTON0);		// BUTTON0 as input, internal pull up
 
-  EICRA |= _BV(ISC00);		// Enable INT0 on both failing and rising edge
-  EIMSK |= _BV(INT0);
+  hal_extint_enable(HAL_EXTINT0, HAL_EDGE_ANY);		// Enable INT0 on both failing and rising edge
 
-  scheduler_add_hook_fct(buttons_process);
+  scheduler_add_hook_fct(buttons_process, BUTTONS_PERIOD_MS, SCHEDULER_CONTEXT_ISR);
 }
 
 button_action_t
@@ -64,9 +62,35 @@ void
 buttons_process(void)
 {
   if (_button0_state == BUTTON_PRESSED) {
-    if (++_button0_pressed_counter >= 2) {
+    if (++_button0_pressed_counter >= BUTTONS_LONG_PRESS) {
       _buttons_requested_action = BUTTON_ACTION_POWER;
       _button0_state = BUTTON_RELEASED;
     }
   }
 }
+
+/*
+ * Button released and no action waiting for
+ * buttons_get_requested_action().
+ */
+bool
+buttons_idle(void)
+{
+  return (_button0_state == BUTTON_RELEASED) && (_buttons_requested_action == BUTTON_ACTION_NONE);
+}
+
+/*
+ * Back from power-down, where the INT0 edge of a press is lost: the
+ * button is pressed if it is still held down.
+ */
+void
+buttons_wakeup(void)
+{
+  const uint8_t sreg = SREG;
+  cli();
+  if (!hal_pin_read(BUTTON0) && (_button0_state == BUTTON_RELEASED)) {
+    _button0_state = BUTTON_PRESSED;
+    _button0_pressed_counter = 0;
+  }
+  SREG = sreg;
+}
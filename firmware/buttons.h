@@ -1,6 +1,8 @@
 #ifndef __BUTTONS_H__
 #define __BUTTONS_H__
 
+#include <stdbool.h>
+
 typedef enum {
   BUTTON_ACTION_NONE,
   BUTTON_ACTION_OK,
@@ -10,6 +12,8 @@ typedef enum {
 
 void buttons_init(void);
 button_action_t buttons_get_requested_action(void);
+bool buttons_idle(void);
+void buttons_wakeup(void);
 
 #endif	/*	__BUTTONS_H__ */
 
@@ -3,6 +3,4 @@
 
 #include "version.h"
 
-#define SHELL_COMMAND_COUNT 5
-
 #endif
@@ -0,0 +1,222 @@
+#include "eventlog.h"
+
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <util/crc16.h>
+
+#include "scheduler.h"
+
+// Slot written by the next eventlog_add(), i.e. the oldest one
+static uint8_t _eventlog_next = 0;
+static uint16_t _eventlog_sequence = 0;
+
+/*
+ * Write queue, filled by eventlog_add() and drained by the EEPROM
+ * ready interrupt, one byte at a time.
+ */
+static struct {
+  uint8_t raw[EVENTLOG_RECORD_SIZE];
+  uint8_t slot;
+} _eventlog_queue[EVENTLOG_QUEUE];
+static volatile uint8_t _eventlog_head = 0;
+static volatile uint8_t _eventlog_count = 0;
+static uint8_t _eventlog_byte = 0;
+static volatile uint16_t _eventlog_dropped = 0;
+
+static uint16_t
+_eventlog_crc(const uint8_t *raw)
+{
+  uint16_t crc = 0xffff;
+
+  for (uint8_t i = 0; i < EVENTLOG_RECORD_SIZE - 2; i++)
+    crc = _crc_ccitt_update(crc, raw[i]);
+  return crc;
+}
+
+static void
+_eventlog_encode(uint8_t *raw, const eventlog_record_t *record)
+{
+  raw[0] = record->sequence;
+  raw[1] = record->sequence >> 8;
+  raw[2] = record->time;
+  raw[3] = record->time >> 8;
+  raw[4] = record->event;
+  raw[5] = record->arg;
+  raw[6] = record->temperature;
+  raw[7] = (uint16_t)record->temperature >> 8;
+  const uint16_t crc = _eventlog_crc(raw);
+  raw[8] = crc;
+  raw[9] = crc >> 8;
+}
+
+static bool
+_eventlog_decode(const uint8_t *raw, eventlog_record_t *record)
+{
+  if (_eventlog_crc(raw) != (raw[8] | ((uint16_t)raw[9] << 8)))
+    return false;
+  record->sequence = raw[0] | ((uint16_t)raw[1] << 8);
+  record->time = raw[2] | ((uint16_t)raw[3] << 8);
+  record->event = raw[4];
+  record->arg = raw[5];
+  record->temperature = raw[6] | ((uint16_t)raw[7] << 8);
+  return true;
+}
+
+/*
+ * Read an EEPROM byte between two writes of the interrupt handler,
+ * interrupts stay enabled while waiting.
+ */
+static uint8_t
+_eventlog_eeprom_read(const uint16_t address)
+{
+  for (;;) {
+    while (!hal_eeprom_ready())
+      hal_busy_wait();
+    const uint8_t sreg = SREG;
+    cli();
+    if (hal_eeprom_ready()) {
+      const uint8_t data = hal_eeprom_read(address);
+      SREG = sreg;
+      return data;
+    }
+    SREG = sreg;
+  }
+}
+
+static void
+_eventlog_read_slot(const uint8_t slot, uint8_t *raw)
+{
+  const uint16_t address = (uint16_t)slot * EVENTLOG_RECORD_SIZE;
+
+  for (uint8_t i = 0; i < EVENTLOG_RECORD_SIZE; i++)
+    raw[i] = _eventlog_eeprom_read(address + i);
+}
+
+/*
+ * Find the newest record: sequence numbers of valid records are
+ * consecutive modulo 2^16, and compared as such.
+ */
+void
+eventlog_init(void)
+{
+  bool found = false;
+
+  for (uint8_t slot = 0; slot < EVENTLOG_SLOTS; slot++) {
+    uint8_t raw[EVENTLOG_RECORD_SIZE];
+    eventlog_record_t record;
+
+    _eventlog_read_slot(slot, raw);
+    if (!_eventlog_decode(raw, &record))
+      continue;
+    if (!found || ((int16_t)(record.sequence - _eventlog_sequence) >= 0)) {
+      found = true;
+      _eventlog_sequence = record.sequence + 1;
+      _eventlog_next = (slot + 1 == EVENTLOG_SLOTS) ? 0 : slot + 1;
+    }
+  }
+}
+
+/*
+ * Queue a record, may be called from interrupt context.  Returns false
+ * (and counts the record as dropped) if the queue is full.
+ */
+bool
+eventlog_add(const eventlog_event_t event, const uint8_t arg, const int16_t temperature)
+{
+  const uint32_t seconds = scheduler_millis() / 1000;
+  eventlog_record_t record = {
+    .time = (seconds > UINT16_MAX) ? UINT16_MAX : seconds,
+    .event = event,
+    .arg = arg,
+    .temperature = temperature
+  };
+  const uint8_t sreg = SREG;
+  cli();
+
+  if (_eventlog_count == EVENTLOG_QUEUE) {
+    _eventlog_dropped++;
+    SREG = sreg;
+    return false;
+  }
+  uint8_t tail = _eventlog_head + _eventlog_count;
+  if (tail >= EVENTLOG_QUEUE)
+    tail -= EVENTLOG_QUEUE;
+  record.sequence = _eventlog_sequence++;
+  _eventlog_encode(_eventlog_queue[tail].raw, &record);
+  _eventlog_queue[tail].slot = _eventlog_next;
+  if (++_eventlog_next == EVENTLOG_SLOTS)
+    _eventlog_next = 0;
+  _eventlog_count++;
+  hal_eeprom_irq(true);
+
+  SREG = sreg;
+  return true;
+}
+
+/*
+ * Write the next queued byte.  Bytes already holding the right value
+ * are skipped, saving both time and wear.  A record leaves the queue
+ * once its last byte is written, i.e. when the EEPROM is ready again:
+ * until then, it is still pending.
+ */
+ISR(EE_READY_vect)
+{
+  while (_eventlog_count != 0) {
+    if (_eventlog_byte == EVENTLOG_RECORD_SIZE) {
+      _eventlog_byte = 0;
+      if (++_eventlog_head == EVENTLOG_QUEUE)
+        _eventlog_head = 0;
+      _eventlog_count--;
+      continue;
+    }
+
+    const uint8_t *raw = _eventlog_queue[_eventlog_head].raw;
+    const uint16_t address = (uint16_t)_eventlog_queue[_eventlog_head].slot * EVENTLOG_RECORD_SIZE + _eventlog_byte;
+    const uint8_t data = raw[_eventlog_byte++];
+
+    if (hal_eeprom_read(address) != data) {
+      hal_eeprom_write(address, data);
+      return;
+    }
+  }
+  hal_eeprom_irq(false);
+}
+
+/*
+ * Record "n" of the log, from the oldest (0) to the newest
+ * (EVENTLOG_SLOTS - 1).  Returns false for an empty or corrupted slot,
+ * or a record still being written.
+ */
+bool
+eventlog_read(const uint8_t n, eventlog_record_t *record)
+{
+  uint8_t raw[EVENTLOG_RECORD_SIZE];
+
+  eventlog_read_raw(n, raw);
+  return _eventlog_decode(raw, record);
+}
+
+// Record "n" as stored, see eventlog_read()
+void
+eventlog_read_raw(const uint8_t n, uint8_t raw[EVENTLOG_RECORD_SIZE])
+{
+  uint16_t slot = (uint16_t)_eventlog_next + n;
+
+  if (slot >= EVENTLOG_SLOTS)
+    slot -= EVENTLOG_SLOTS;
+  _eventlog_read_slot(slot, raw);
+}
+
+// Records queued or being written, not yet entirely in EEPROM
+uint8_t
+eventlog_pending(void)
+{
+  return _eventlog_count;
+}
+
+// Records lost because the queue was full
+uint16_t
+eventlog_dropped(void)
+{
+  return _eventlog_dropped;
+}
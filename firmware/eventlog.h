@@ -0,0 +1,67 @@
+#ifndef __EVENTLOG_H__
+#define __EVENTLOG_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "hal.h"
+
+/*
+ * Event log, a ring of fixed size records filling the EEPROM.  Records
+ * are written in turn to the next slot, so that every slot wears at the
+ * same rate, and carry a sequence number (the newest one is found at
+ * startup) and a CRC (a record torn by a power loss is ignored).
+ *
+ * Record layout, little endian:
+ *   0  sequence	uint16
+ *   2  time		uint16, seconds since boot, saturated
+ *   4  event		uint8, eventlog_event_t
+ *   5  arg		uint8, event specific
+ *   6  temperature	int16, oil temperature (0.1 °C)
+ *   8  crc		uint16, CRC-CCITT (_crc_ccitt_update(), 0xffff
+ *			initial value) of bytes 0 to 7
+ *
+ * Records are queued in RAM and written one byte per EE_READY
+ * interrupt, the control loop never waits for the EEPROM.
+ */
+#define EVENTLOG_RECORD_SIZE	10
+#define EVENTLOG_SLOTS		(HAL_EEPROM_SIZE / EVENTLOG_RECORD_SIZE)
+
+// Records waiting to be written
+#define EVENTLOG_QUEUE		4
+
+typedef enum {
+  EVENTLOG_BOOT,		// arg: HAL_RESET_* flags
+  EVENTLOG_MODE,		// arg: new utophuile_mode_t
+  EVENTLOG_CONNECTION_LOST,	// arg: eventlog_device_t
+  EVENTLOG_CONNECTION_BACK,	// arg: eventlog_device_t
+  EVENTLOG_RELAY_FEEDBACK,	// arg: relays (bit n: relay n + 4) whose feedback is wrong
+  EVENTLOG_HEATER_CUT,		// arg: 1 cut, 0 released
+  EVENTLOG_STACK_LOW,		// arg: bytes never used between heap and stack, saturated
+  EVENTLOG_EVENT_COUNT
+} eventlog_event_t;
+
+typedef enum {
+  EVENTLOG_DEVICE_ADS1115,
+  EVENTLOG_DEVICE_RELAY
+} eventlog_device_t;
+
+// Temperature of events logged without one
+#define EVENTLOG_NO_TEMPERATURE	INT16_MIN
+
+typedef struct {
+  uint16_t sequence;
+  uint16_t time;
+  uint8_t event;
+  uint8_t arg;
+  int16_t temperature;
+} eventlog_record_t;
+
+void eventlog_init(void);
+bool eventlog_add(const eventlog_event_t event, const uint8_t arg, const int16_t temperature);
+bool eventlog_read(const uint8_t n, eventlog_record_t *record);
+void eventlog_read_raw(const uint8_t n, uint8_t raw[EVENTLOG_RECORD_SIZE]);
+uint8_t eventlog_pending(void);
+uint16_t eventlog_dropped(void);
+
+#endif	/* __EVENTLOG_H__ */
@@ -0,0 +1,114 @@
+#include "filter.h"
+
+#include <avr/io.h>
+#include <avr/interrupt.h>
+
+void
+filter_init(filter_t *filter, const uint8_t median, const uint8_t iir_shift, const uint16_t max_step)
+{
+  filter->median = (median == 0) ? 1 : ((median > FILTER_MEDIAN_MAX) ? FILTER_MEDIAN_MAX : median);
+  filter->iir_shift = iir_shift;
+  filter->max_step = max_step;
+  filter->rejections = 0;
+  filter_reset(filter);
+}
+
+/*
+ * Forget past samples, output is invalid until next sample.
+ */
+void
+filter_reset(filter_t *filter)
+{
+  filter->index = 0;
+  filter->count = 0;
+  filter->rejects = 0;
+  filter->output = FILTER_INVALID;
+}
+
+/*
+ * Median of the accepted samples window (insertion sort of a copy).
+ */
+static int16_t
+filter_median(const filter_t *filter)
+{
+  int16_t sorted[FILTER_MEDIAN_MAX];
+  const uint8_t n = filter->count;
+
+  for (uint8_t i = 0; i < n; i++) {
+    const int16_t v = filter->window[i];
+    uint8_t j = i;
+    for (; (j > 0) && (sorted[j - 1] > v); j--)
+      sorted[j] = sorted[j - 1];
+    sorted[j] = v;
+  }
+  return sorted[n >> 1];
+}
+
+/*
+ * Feed a new sample, at sample rate (may be called from interrupt
+ * context).  FILTER_INVALID resets the filter.
+ */
+void
+filter_process(filter_t *filter, const int16_t sample)
+{
+  if (sample == FILTER_INVALID) {
+    filter_reset(filter);
+    return;
+  }
+
+  // Rate of change plausibility
+  if ((filter->count != 0) && (filter->max_step != 0)) {
+    const int32_t step = (int32_t)sample - filter->last;
+    if ((step > filter->max_step) || (step < -(int32_t)filter->max_step)) {
+      filter->rejections++;
+      if (++filter->rejects < FILTER_MAX_REJECTS)
+        return;
+      // Sustained step: start again from this sample
+      filter_reset(filter);
+    }
+  }
+  filter->rejects = 0;
+  filter->last = sample;
+
+  // Median
+  filter->window[filter->index] = sample;
+  if (++filter->index == filter->median)
+    filter->index = 0;
+  if (filter->count < filter->median)
+    filter->count++;
+  const int16_t median = (filter->median > 1) ? filter_median(filter) : sample;
+
+  // IIR
+  if ((filter->iir_shift == 0) || (filter->output == FILTER_INVALID)) {
+    filter->iir = (int32_t)median << 8;
+  } else {
+    filter->iir += (((int32_t)median << 8) - filter->iir) >> filter->iir_shift;
+  }
+  filter->output = (filter->iir + 0x80) >> 8;
+}
+
+/*
+ * Latest filtered value, or FILTER_INVALID.
+ */
+int16_t
+filter_output(filter_t *filter)
+{
+  const uint8_t sreg = SREG;
+  cli();
+  const int16_t output = filter->output;
+  SREG = sreg;
+  return output;
+}
+
+/*
+ * Number of samples rejected by the rate of change check.
+ */
+uint16_t
+filter_rejections(filter_t *filter)
+{
+  const uint8_t sreg = SREG;
+  cli();
+  const uint16_t rejections = filter->rejections;
+  SREG = sreg;
+  return rejections;
+}
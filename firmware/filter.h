@@ -0,0 +1,48 @@
+#ifndef __FILTER_H__
+#define __FILTER_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Largest median window
+#define FILTER_MEDIAN_MAX	7
+
+// Consecutive out of rate samples accepted as a genuine step
+#define FILTER_MAX_REJECTS	3
+
+// No valid output (same value as ADS1115_ERR_CONNECTION_LOST)
+#define FILTER_INVALID		INT16_MIN
+
+/*
+ * Sample filter, stages are run in this order:
+ * - rate of change plausibility check: samples further than "max_step"
+ *   from the previous accepted one are rejected, unless there are
+ *   FILTER_MAX_REJECTS of them in a row (0 disables the check),
+ * - median of the last "median" accepted samples, rejects spikes
+ *   (1 disables the stage),
+ * - first order IIR low pass: y += (x - y) / 2^iir_shift, Q8 fixed
+ *   point (0 disables the stage).
+ */
+typedef struct {
+  // Configuration
+  uint8_t median;
+  uint8_t iir_shift;
+  uint16_t max_step;
+  // State
+  int16_t window[FILTER_MEDIAN_MAX];
+  uint8_t index;
+  uint8_t count;
+  uint8_t rejects;
+  int16_t last;
+  int32_t iir;		// Q8
+  volatile int16_t output;
+  volatile uint16_t rejections;
+} filter_t;
+
+void filter_init(filter_t *filter, const uint8_t median, const uint8_t iir_shift, const uint16_t max_step);
+void filter_reset(filter_t *filter);
+void filter_process(filter_t *filter, const int16_t sample);
+int16_t filter_output(filter_t *filter);
+uint16_t filter_rejections(filter_t *filter);
+
+#endif	/* __FILTER_H__ */
@@ -0,0 +1,179 @@
+#include "fmt.h"
+
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "uart.h"
+
+// Digits of a 32 bits number in decimal
+#define FMT_DIGITS_MAX	10
+
+void
+fmt_char(const char c)
+{
+  uart_putchar(c);
+}
+
+void
+fmt_str_P(PGM_P s)
+{
+  char c;
+
+  while ((c = pgm_read_byte(s++)) != '\0')
+    fmt_char(c);
+}
+
+static void
+_fmt_str(const char *s)
+{
+  while (*s != '\0')
+    fmt_char(*s++);
+}
+
+/*
+ * Print "value", negated if "negative", with "decimals" digits after
+ * the decimal point, right aligned on "width" characters.  Most of the
+ * numbers fit on 16 bits: cheaper divisions are used for them.
+ */
+static void
+_fmt_number(uint32_t value, const bool negative, const uint8_t base, const uint8_t decimals, uint8_t width, const char pad)
+{
+  char digits[FMT_DIGITS_MAX];
+  uint8_t n = 0;
+
+  do {
+    uint8_t digit;
+    if (value <= UINT16_MAX) {
+      const uint16_t v = value;
+      digit = v % base;
+      value = v / base;
+    } else {
+      digit = value % base;
+      value /= base;
+    }
+    digits[n++] = (digit < 10) ? '0' + digit : 'a' - 10 + digit;
+  } while ((value != 0) || (n <= decimals));
+
+  const uint8_t length = n + (decimals != 0) + negative;
+  if (negative && (pad == '0'))
+    fmt_char('-');
+  for (; width > length; width--)
+    fmt_char(pad);
+  if (negative && (pad != '0'))
+    fmt_char('-');
+  while (n != 0) {
+    if (n-- == decimals)
+      fmt_char('.');
+    fmt_char(digits[n]);
+  }
+}
+
+void
+fmt_P(PGM_P fmt, ...)
+{
+  va_list ap;
+  char c;
+
+  va_start(ap, fmt);
+  while ((c = pgm_read_byte(fmt++)) != '\0') {
+    if (c != '%') {
+      fmt_char(c);
+      continue;
+    }
+
+    char pad = ' ';
+    uint8_t width = 0;
+    uint8_t decimals = 0;
+    bool wide = false;
+
+    c = pgm_read_byte(fmt++);
+    if (c == '0') {
+      pad = '0';
+      c = pgm_read_byte(fmt++);
+    }
+    for (; (c >= '0') && (c <= '9'); c = pgm_read_byte(fmt++))
+      width = width * 10 + c - '0';
+    if (c == '.') {
+      decimals = pgm_read_byte(fmt++) - '0';
+      c = pgm_read_byte(fmt++);
+    }
+    if (c == 'l') {
+      wide = true;
+      c = pgm_read_byte(fmt++);
+    }
+
+    switch (c) {
+      case 's':
+        _fmt_str(va_arg(ap, const char *));
+        break;
+      case 'S':
+        fmt_str_P(va_arg(ap, PGM_P));
+        break;
+      case 'c':
+        fmt_char(va_arg(ap, int));
+        break;
+      case 'u':
+      case 'x': {
+        const uint32_t value = wide ? va_arg(ap, uint32_t) : (uint16_t)va_arg(ap, int);
+        _fmt_number(value, false, (c == 'x') ? 16 : 10, 0, width, pad);
+        break;
+      }
+      case 'd': {
+        const int32_t value = wide ? va_arg(ap, int32_t) : (int16_t)va_arg(ap, int);
+        _fmt_number((value < 0) ? 0 - (uint32_t)value : (uint32_t)value, value < 0, 10, decimals, width, pad);
+        break;
+      }
+      case '\0':
+        // Lone '%' at the end
+        fmt--;
+        break;
+      default:
+        fmt_char(c);
+        break;
+    }
+  }
+  va_end(ap);
+}
+
+static bool
+_fmt_space(const char c)
+{
+  return (c == ' ') || (c == '\t') || (c == '\r') || (c == '\n');
+}
+
+static const char *
+_fmt_skip_spaces(const char *s)
+{
+  if (s == NULL)
+    return NULL;
+  while (_fmt_space(*s))
+    s++;
+  return (*s == '\0') ? NULL : s;
+}
+
+const char *
+fmt_int(const char *s, int32_t *value)
+{
+  bool negative = false;
+  uint32_t v = 0;
+
+  if ((s = _fmt_skip_spaces(s)) == NULL)
+    return NULL;
+  if ((*s == '-') || (*s == '+'))
+    negative = (*s++ == '-');
+  if ((*s < '0') || (*s > '9'))
+    return NULL;
+  // INT32_MIN has no positive counterpart
+  const uint32_t max = (uint32_t)INT32_MAX + negative;
+  for (; (*s >= '0') && (*s <= '9'); s++) {
+    const uint8_t digit = *s - '0';
+    if (v > (max - digit) / 10)
+      return NULL;
+    v = v * 10 + digit;
+  }
+  if ((*s != '\0') && !_fmt_space(*s))
+    return NULL;
+  *value = (negative && (v != 0)) ? -(int32_t)(v - 1) - 1 : (int32_t)v;
+  return s;
+}
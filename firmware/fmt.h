@@ -0,0 +1,35 @@
+#ifndef __FMT_H__
+#define __FMT_H__
+
+#include <avr/pgmspace.h>
+#include <stdint.h>
+
+/*
+ * Console formatting and parsing, instead of avr-libc vfprintf() and
+ * vfscanf(): output goes straight to uart_putchar().
+ *
+ * fmt_P() conversions, with an optional '0' flag and field width:
+ *   %s   string in RAM
+ *   %S   string in program memory
+ *   %c   character
+ *   %u   unsigned, 8 or 16 bits
+ *   %d   signed, 8 or 16 bits
+ *   %x   unsigned, 8 or 16 bits, lower case hexadecimal
+ *   %lu, %ld, %lx  same, the argument is a uint32_t or an int32_t
+ *   %.Nd fixed point: signed 16 bits with N (1 to 4) decimals,
+ *        "%.1d" prints a temperature (0.1 °C)
+ *   %%   '%'
+ * Unknown conversions are printed as is.
+ */
+void fmt_P(PGM_P fmt, ...);
+void fmt_char(const char c);
+void fmt_str_P(PGM_P s);
+
+/*
+ * Read a decimal integer with an optional sign, after leading spaces:
+ * returns where parsing stopped, or NULL if "s" is NULL or the word is
+ * not a number (in range for an int32_t).
+ */
+const char *fmt_int(const char *s, int32_t *value);
+
+#endif	/* __FMT_H__ */
@@ -0,0 +1,149 @@
+#ifndef __HAL_H__
+#define __HAL_H__
+
+/*
+ * Hardware abstraction layer: the few peripheral accesses made by the
+ * drivers (GPIO, external interrupts, timers, UART, TWI, EEPROM, power
+ * management and RAM layout).
+ *
+ * On the atmega328p (hal_avr.h), every function is an inline access to
+ * the registers, with constant pins compiling to sbi/cbi/sbic.  The
+ * host build (host/hal_host.h) provides the same functions on top of
+ * simulated hardware, see host/hal.c.
+ *
+ * Interrupt handlers keep the avr-libc ISR() names, critical sections
+ * keep the SREG / cli() / sei() idiom.
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// GPIO pins, see pinouts.txt
+typedef enum {
+  HAL_PIN_BUTTON0,	// PD2, dashboard button (INT0)
+  HAL_PIN_ADS1115_RDY,	// PD3, ADS1115 ALERT/RDY (INT1)
+  HAL_PIN_BEEP,		// PD6, buzzer (OC0A)
+  HAL_PIN_LEDS_COM,	// PC0, LEDs common
+  HAL_PIN_LED0,		// PC1, green LED
+  HAL_PIN_LED1,		// PC2, orange LED
+  HAL_PIN_LED2,		// PC3, red LED
+  HAL_PIN_COUNT
+} hal_pin_t;
+
+// External interrupts (INT0_vect, INT1_vect)
+typedef enum {
+  HAL_EXTINT0,
+  HAL_EXTINT1
+} hal_extint_t;
+
+// Interrupt sense control, same values as ISCn1:ISCn0
+typedef enum {
+  HAL_EDGE_ANY = 1,
+  HAL_EDGE_FALLING = 2,
+  HAL_EDGE_RISING = 3
+} hal_edge_t;
+
+// Sleep modes, see hal_sleep()
+typedef enum {
+  HAL_SLEEP_IDLE,	// CPU stopped, peripherals and tick running
+  HAL_SLEEP_POWER_DOWN	// oscillator stopped: only the watchdog and pin changes wake up
+} hal_sleep_t;
+
+// Watchdog wake-up period, see hal_wdt_wakeup()
+#define HAL_WDT_MS	1000
+
+// Tone timer clock, see hal_tone_start()
+#define HAL_TONE_HZ	62500
+
+// EEPROM size, in bytes
+#define HAL_EEPROM_SIZE	1024
+
+// RAM size, in bytes, and pattern painted above .bss at reset
+#define HAL_RAM_SIZE	2048
+#define HAL_RAM_PAINT	0xc5
+
+// RAM layout, see hal_ram_layout()
+typedef struct {
+  uint16_t data;	// .data size
+  uint16_t bss;		// .bss size
+  uint8_t *heap;	// heap start, after .data and .bss
+  uint8_t *brk;		// heap end (malloc() break)
+  uint8_t *end;		// past the end of RAM, the stack grows down from there
+} hal_ram_t;
+
+#if defined(__AVR__)
+#include "hal_avr.h"
+#else
+#include "host/hal_host.h"
+#endif
+
+/*
+ * Every target provides:
+ *
+ * GPIO
+ *   hal_pin_output(pin), hal_pin_input_pullup(pin)
+ *   hal_pin_write(pin, level), hal_pin_toggle(pin), hal_pin_read(pin)
+ *
+ * External interrupts
+ *   hal_extint_enable(extint, edge)
+ *
+ * Scheduler tick: 1 kHz TIMER1_COMPA_vect interrupt
+ *   hal_tick_init()
+ *   hal_tick_missed(): next tick is already pending
+ *   hal_tick_phase(): time since the last tick, in 1 / HAL_TICK_PHASES
+ *     ms, interrupts disabled
+ *
+ * Tone timer: TIMER0_COMPA_vect every "ocr" + 1 periods of
+ * HAL_TONE_HZ, toggling the buzzer pin if "output" is set
+ *   hal_tone_start(ocr, output), hal_tone_stop()
+ *
+ * UART: RX complete (USART_RX_vect) and data register empty
+ * (USART_UDRE_vect) interrupts
+ *   hal_uart_init(baud)
+ *   hal_uart_rx_status(): HAL_UART_RX_FRAME_ERROR, HAL_UART_RX_OVERRUN,
+ *     to be read before the data
+ *   hal_uart_rx_data()
+ *   hal_uart_tx_data(c): also clears the transmit complete flag
+ *   hal_uart_tx_ready(), hal_uart_tx_done(), hal_uart_tx_irq(enable)
+ *
+ * TWI master: TWI_vect interrupt, status codes from <util/twi.h>
+ *   hal_twi_init()
+ *   hal_twi_start(), hal_twi_stop(), hal_twi_stop_start()
+ *   hal_twi_next(ack): go on with the next address or data byte
+ *   hal_twi_write(data), hal_twi_read(), hal_twi_status()
+ *
+ * EEPROM: EE_READY_vect interrupt, level triggered while no write is
+ * in progress (about 3.4 ms per byte)
+ *   hal_eeprom_ready(): no write in progress
+ *   hal_eeprom_read(address): EEPROM must be ready
+ *   hal_eeprom_write(address, data): erase and write, EEPROM must be
+ *     ready and interrupts disabled
+ *   hal_eeprom_irq(enable)
+ *
+ * Reset
+ *   hal_reset_cause(): HAL_RESET_* flags of the last reset, cleared
+ *
+ * Busy waits
+ *   hal_busy_wait(): called in every busy wait loop
+ *
+ * Power management
+ *   hal_sleep(mode): called with interrupts disabled, returns once the
+ *     wake-up interrupt has been run, interrupts enabled.  External
+ *     interrupt edges are lost in HAL_SLEEP_POWER_DOWN, and the tick
+ *     stops.
+ *   hal_wdt_wakeup(enable): WDT_vect every HAL_WDT_MS (watchdog
+ *     oscillator, about 10 % accurate), interrupts disabled
+ *   hal_pcint_wakeup(enable): PCINT2_vect on any change of the button
+ *     or UART RXD pins, interrupts disabled
+ *   hal_power_reduce(): stop the clock of unused peripherals (ADC,
+ *     analog comparator, SPI, Timer2)
+ *
+ * RAM
+ *   HAL_RAM_PAINTER: expanded in a single source file, paints RAM from
+ *     the heap start to the end with HAL_RAM_PAINT at reset, before
+ *     anything else runs
+ *   hal_ram_layout(ram)
+ *   hal_stack_pointer(): next free byte of the stack
+ */
+
+#endif	/* __HAL_H__ */
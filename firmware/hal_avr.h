@@ -0,0 +1,422 @@
+#ifndef __HAL_AVR_H__
+#define __HAL_AVR_H__
+
+/*
+ * atmega328p implementation of hal.h, inline register accesses.
+ */
+
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <avr/power.h>
+#include <avr/sleep.h>
+#include <avr/wdt.h>
+#include <stddef.h>
+#include <util/twi.h>
+
+#define _HAL_INLINE	static inline __attribute__((always_inline))
+
+/*
+ * GPIO: PINx, DDRx and PORTx registers are consecutive, pins are
+ * constants so accesses compile to sbi/cbi/sbic.
+ */
+_HAL_INLINE volatile uint8_t *
+_hal_pin_port(const hal_pin_t pin)
+{
+  return (pin <= HAL_PIN_BEEP) ? &PORTD : &PORTC;
+}
+
+_HAL_INLINE uint8_t
+_hal_pin_mask(const hal_pin_t pin)
+{
+  switch (pin) {
+    case HAL_PIN_BUTTON0:
+      return _BV(PD2);
+    case HAL_PIN_ADS1115_RDY:
+      return _BV(PD3);
+    case HAL_PIN_BEEP:
+      return _BV(PD6);
+    case HAL_PIN_LEDS_COM:
+      return _BV(PC0);
+    case HAL_PIN_LED0:
+      return _BV(PC1);
+    case HAL_PIN_LED1:
+      return _BV(PC2);
+    case HAL_PIN_LED2:
+    default:
+      return _BV(PC3);
+  }
+}
+
+#define _HAL_PIN(pin)	(*(_hal_pin_port(pin) - 2))
+#define _HAL_DDR(pin)	(*(_hal_pin_port(pin) - 1))
+#define _HAL_PORT(pin)	(*_hal_pin_port(pin))
+
+_HAL_INLINE void
+hal_pin_output(const hal_pin_t pin)
+{
+  _HAL_DDR(pin) |= _hal_pin_mask(pin);
+}
+
+_HAL_INLINE void
+hal_pin_input_pullup(const hal_pin_t pin)
+{
+  _HAL_DDR(pin) &= ~_hal_pin_mask(pin);
+  _HAL_PORT(pin) |= _hal_pin_mask(pin);
+}
+
+_HAL_INLINE void
+hal_pin_write(const hal_pin_t pin, const bool level)
+{
+  if (level)
+    _HAL_PORT(pin) |= _hal_pin_mask(pin);
+  else
+    _HAL_PORT(pin) &= ~_hal_pin_mask(pin);
+}
+
+_HAL_INLINE void
+hal_pin_toggle(const hal_pin_t pin)
+{
+  _HAL_PIN(pin) = _hal_pin_mask(pin);	/* Writing PINx toggles PORTx */
+}
+
+_HAL_INLINE bool
+hal_pin_read(const hal_pin_t pin)
+{
+  return (_HAL_PIN(pin) & _hal_pin_mask(pin)) != 0;
+}
+
+/*
+ * External interrupts
+ */
+_HAL_INLINE void
+hal_extint_enable(const hal_extint_t extint, const hal_edge_t edge)
+{
+  EICRA = (EICRA & ~(3 << (2 * extint))) | (edge << (2 * extint));
+  EIMSK |= _BV(extint);
+}
+
+/*
+ * Scheduler tick: Timer1 in CTC mode, clocked at clk/64 (i.e. 16 000
+ * 000 / 64 = 250000 hz), compare match every 250 clocks.
+ */
+#define _HAL_TICK_OCR	((F_CPU / 64 / 1000) - 1)
+
+_HAL_INLINE void
+hal_tick_init(void)
+{
+  TCCR1A = 0;
+  TCCR1B = _BV(WGM12) | _BV(CS11) | _BV(CS10);
+  OCR1A = _HAL_TICK_OCR;
+  TIMSK1 |= _BV(OCIE1A);
+}
+
+_HAL_INLINE bool
+hal_tick_missed(void)
+{
+  return bit_is_set(TIFR1, OCF1A);
+}
+
+#define HAL_TICK_PHASES	(_HAL_TICK_OCR + 1)
+
+_HAL_INLINE uint8_t
+hal_tick_phase(void)
+{
+  return TCNT1;		/* below _HAL_TICK_OCR + 1 */
+}
+
+/*
+ * Tone: Timer0 in CTC mode, clocked at clk/256 (62.5 kHz), toggling
+ * OC0A on compare match.
+ */
+_HAL_INLINE void
+hal_tone_start(const uint8_t ocr, const bool output)
+{
+  OCR0A = ocr;
+  TCCR0A = _BV(WGM01) | (output ? _BV(COM0A0) : 0);
+  TCNT0 = 0;
+  TCCR0B = _BV(CS02);
+  TIMSK0 |= _BV(OCIE0A);
+}
+
+_HAL_INLINE void
+hal_tone_stop(void)
+{
+  TIMSK0 &= ~(_BV(OCIE0A));
+  TCCR0B = 0x00;
+  TCCR0A = 0x00;
+}
+
+/*
+ * UART
+ */
+#define HAL_UART_RX_FRAME_ERROR	_BV(FE0)
+#define HAL_UART_RX_OVERRUN	_BV(DOR0)
+
+_HAL_INLINE void
+hal_uart_init(const uint32_t baud)
+{
+#if F_CPU < 2000000UL
+  UCSR0A = _BV(U2X0);		/* improve baud rate error by using 2x clk */
+  UBRR0L = (F_CPU / (8UL * baud)) - 1;
+#else
+  UBRR0L = (F_CPU / (16UL * baud)) - 1;
+#endif
+  UCSR0B = _BV(TXEN0) | _BV(RXEN0) | _BV(RXCIE0);	/* tx/rx enable, rx interrupt */
+}
+
+_HAL_INLINE uint8_t
+hal_uart_rx_status(void)
+{
+  return UCSR0A & (HAL_UART_RX_FRAME_ERROR | HAL_UART_RX_OVERRUN);
+}
+
+_HAL_INLINE uint8_t
+hal_uart_rx_data(void)
+{
+  return UDR0;
+}
+
+_HAL_INLINE void
+hal_uart_tx_data(const uint8_t c)
+{
+  UDR0 = c;
+  UCSR0A = (UCSR0A & _BV(U2X0)) | _BV(TXC0);	/* clear transmit complete flag */
+}
+
+_HAL_INLINE bool
+hal_uart_tx_ready(void)
+{
+  return bit_is_set(UCSR0A, UDRE0);
+}
+
+_HAL_INLINE bool
+hal_uart_tx_done(void)
+{
+  return bit_is_set(UCSR0A, TXC0);
+}
+
+_HAL_INLINE void
+hal_uart_tx_irq(const bool enable)
+{
+  if (enable)
+    UCSR0B |= _BV(UDRIE0);
+  else
+    UCSR0B &= ~(_BV(UDRIE0));
+}
+
+/*
+ * TWI master, 100 kHz.  SCL (PC5) and SDA (PC4) internal pull ups are
+ * enabled.
+ */
+_HAL_INLINE void
+hal_twi_init(void)
+{
+  PORTC |= _BV(PC5) | _BV(PC4);
+
+  /* TWPS = 0 => prescaler = 1 */
+  TWSR = 0;
+#if F_CPU < 3600000UL
+  TWBR = 10;			/* smallest TWBR value */
+#else
+  TWBR = (F_CPU / 100000UL - 16) / 2;
+#endif
+}
+
+_HAL_INLINE void
+hal_twi_start(void)
+{
+  TWCR = _BV(TWINT) | _BV(TWSTA) | _BV(TWEN) | _BV(TWIE);
+}
+
+_HAL_INLINE void
+hal_twi_stop(void)
+{
+  TWCR = _BV(TWINT) | _BV(TWSTO) | _BV(TWEN);
+}
+
+_HAL_INLINE void
+hal_twi_stop_start(void)
+{
+  TWCR = _BV(TWINT) | _BV(TWSTO) | _BV(TWSTA) | _BV(TWEN) | _BV(TWIE);
+}
+
+_HAL_INLINE void
+hal_twi_next(const bool ack)
+{
+  TWCR = _BV(TWINT) | _BV(TWEN) | _BV(TWIE) | (ack ? _BV(TWEA) : 0);
+}
+
+_HAL_INLINE void
+hal_twi_write(const uint8_t data)
+{
+  TWDR = data;
+}
+
+_HAL_INLINE uint8_t
+hal_twi_read(void)
+{
+  return TWDR;
+}
+
+_HAL_INLINE uint8_t
+hal_twi_status(void)
+{
+  return TW_STATUS;
+}
+
+/*
+ * EEPROM, erase and write in one operation (EEPM = 0).  EEPE must be
+ * set within four cycles of EEMPE.
+ */
+_HAL_INLINE bool
+hal_eeprom_ready(void)
+{
+  return bit_is_clear(EECR, EEPE);
+}
+
+_HAL_INLINE uint8_t
+hal_eeprom_read(const uint16_t address)
+{
+  EEAR = address;
+  EECR |= _BV(EERE);
+  return EEDR;
+}
+
+_HAL_INLINE void
+hal_eeprom_write(const uint16_t address, const uint8_t data)
+{
+  EEAR = address;
+  EEDR = data;
+  EECR |= _BV(EEMPE);
+  EECR |= _BV(EEPE);
+}
+
+_HAL_INLINE void
+hal_eeprom_irq(const bool enable)
+{
+  if (enable)
+    EECR |= _BV(EERIE);
+  else
+    EECR &= ~(_BV(EERIE));
+}
+
+/*
+ * Reset cause, MCUSR flags
+ */
+#define HAL_RESET_POWER_ON	_BV(PORF)
+#define HAL_RESET_EXTERNAL	_BV(EXTRF)
+#define HAL_RESET_BROWN_OUT	_BV(BORF)
+#define HAL_RESET_WATCHDOG	_BV(WDRF)
+
+_HAL_INLINE uint8_t
+hal_reset_cause(void)
+{
+  const uint8_t cause = MCUSR;
+  MCUSR = 0;
+  return cause;
+}
+
+_HAL_INLINE void
+hal_busy_wait(void)
+{
+}
+
+/*
+ * Power management.  Timer2 cannot wake the CPU up from power-save:
+ * its asynchronous 32 kHz crystal would go on TOSC1/TOSC2, which drive
+ * the 16 MHz crystal.  Power-down is used instead, with the watchdog
+ * interrupt as wake-up timer and pin change interrupts on PD0 (RXD,
+ * PCINT16) and PD2 (button, PCINT18): INT0 and INT1 edges need the I/O
+ * clock.  The brown-out detector is disabled during power-down.
+ */
+_HAL_INLINE void
+hal_sleep(const hal_sleep_t mode)
+{
+  set_sleep_mode((mode == HAL_SLEEP_POWER_DOWN) ? SLEEP_MODE_PWR_DOWN : SLEEP_MODE_IDLE);
+  sleep_enable();
+  if (mode == HAL_SLEEP_POWER_DOWN)
+    sleep_bod_disable();
+  sei();
+  sleep_cpu();	/* sei() takes effect after this instruction: no wake-up is lost */
+  sleep_disable();
+}
+
+/*
+ * Watchdog in interrupt mode, ~1 s period.  WDE and WDP must be
+ * written within four cycles of WDCE.
+ */
+_HAL_INLINE void
+hal_wdt_wakeup(const bool enable)
+{
+  wdt_reset();
+  WDTCSR = _BV(WDCE) | _BV(WDE);
+  WDTCSR = enable ? (_BV(WDIE) | _BV(WDP2) | _BV(WDP1)) : 0;
+}
+
+_HAL_INLINE void
+hal_pcint_wakeup(const bool enable)
+{
+  if (enable) {
+    PCMSK2 = _BV(PCINT16) | _BV(PCINT18);
+    PCIFR = _BV(PCIF2);		/* forget changes seen while awake */
+    PCICR |= _BV(PCIE2);
+  } else {
+    PCICR &= ~(_BV(PCIE2));
+    PCMSK2 = 0;
+  }
+}
+
+_HAL_INLINE void
+hal_power_reduce(void)
+{
+  ADCSRA = 0;			/* ADC must be off before its clock is stopped */
+  ACSR = _BV(ACD);
+  power_adc_disable();
+  power_spi_disable();
+  power_timer2_disable();
+}
+
+/*
+ * RAM.  The painter runs from .init1, before the stack pointer, .data
+ * and .bss are set: no register needs to be saved and nothing is on
+ * the stack yet.  malloc() is not linked unless used, __brkval is then
+ * a null weak reference and the heap is empty.
+ */
+#define HAL_RAM_PAINTER \
+  void _hal_ram_paint(void) __attribute__((naked, used, section(".init1"))); \
+  void \
+  _hal_ram_paint(void) \
+  { \
+    __asm__ __volatile__( \
+      "ldi r30, lo8(__heap_start)\n\t" \
+      "ldi r31, hi8(__heap_start)\n\t" \
+      "ldi r24, %[paint]\n\t" \
+      "ldi r25, hi8(%[end])\n" \
+      "1:\tst Z+, r24\n\t" \
+      "cpi r30, lo8(%[end])\n\t" \
+      "cpc r31, r25\n\t" \
+      "brlo 1b" \
+      :: [paint] "M" (HAL_RAM_PAINT), [end] "i" (RAMEND + 1) \
+      : "r24", "r25", "r30", "r31", "memory"); \
+  }
+
+_HAL_INLINE void
+hal_ram_layout(hal_ram_t *ram)
+{
+  extern uint8_t __data_start[], __data_end[], __bss_start[], __bss_end[], __heap_start[];
+  extern char *__brkval __attribute__((weak));
+
+  ram->data = __data_end - __data_start;
+  ram->bss = __bss_end - __bss_start;
+  ram->heap = __heap_start;
+  ram->brk = ((&__brkval != NULL) && (__brkval != NULL)) ? (uint8_t *)__brkval : __heap_start;
+  ram->end = (uint8_t *)(RAMEND + 1);
+}
+
+_HAL_INLINE uint8_t *
+hal_stack_pointer(void)
+{
+  return (uint8_t *)SP;
+}
+
+#endif	/* __HAL_AVR_H__ */
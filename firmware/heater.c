@@ -0,0 +1,381 @@
+#include "heater.h"
+
+#include <avr/io.h>
+
+#include "relay.h"
+
+// PID is run every second
+#define HEATER_PID_PERIOD	(1000 / HEATER_PERIOD_MS)
+
+/*
+ * Autotune (relay method): the heater is switched fully on below
+ * setpoint - hysteresis and off above setpoint + hysteresis.  Cycles
+ * go from one switch on to the next.  After a first settling cycle,
+ * the oscillation period Pu and amplitude a are averaged over the
+ * HEATER_AUTOTUNE_CYCLES following cycles, then the ultimate gain
+ * is Ku = 4 d / (π a), d being half the output range.  Gains follow
+ * Tyreus-Luyben, which overshoots less than Ziegler-Nichols:
+ * Kp = Ku / 2.2, Ti = 2.2 Pu, Td = Pu / 6.3.
+ */
+#define HEATER_AUTOTUNE_HYSTERESIS	TEMPERATURE_C(1)
+#define HEATER_AUTOTUNE_CYCLES		3
+#define HEATER_AUTOTUNE_TIMEOUT		(7200000UL / HEATER_PERIOD_MS)
+
+static heater_state_t _heater_state = HEATER_OFF;
+static int16_t _heater_setpoint = HEATER_SETPOINT;
+static heater_gains_t _heater_gains = { HEATER_KP, HEATER_KI, HEATER_KD };
+
+// PID state
+static int32_t _heater_integral;	// Q8 per mille
+static int16_t _heater_last;		// previous measurement, for the derivative
+static bool _heater_has_last;
+static uint8_t _heater_pid_countdown;
+static uint16_t _heater_output;
+static int16_t _heater_trend;		// 0.1 °C per minute, see slope.h
+static bool _heater_cut = false;
+
+// Feed-forward
+static uint16_t _heater_ff_boost;	// per mille
+static uint16_t _heater_ff_duration;	// s
+static uint16_t _heater_ff_remaining;	// s
+
+// Time proportioning
+static uint16_t _heater_position;	// in window
+static uint16_t _heater_on_periods;	// in current window
+static bool _heater_on = false;
+static uint16_t _heater_since_switch = UINT16_MAX;
+static uint16_t _heater_switches = 0;
+
+// Autotune
+static struct {
+  uint32_t elapsed;	// heater_process() periods since start
+  uint32_t cycle_start;
+  uint32_t period_sum;
+  int32_t amplitude_sum;
+  int16_t high;
+  int16_t low;
+  uint8_t cycles;	// switches on, the first two delimit the settling cycle
+} _heater_tune;
+
+void
+heater_init(void)
+{
+  heater_enable(false);
+}
+
+static void
+_heater_switch(const bool on)
+{
+  if (_heater_since_switch < UINT16_MAX)
+    _heater_since_switch++;
+  if (on == _heater_on)
+    return;
+  _heater_on = on;
+  _heater_since_switch = 0;
+  if (on)
+    _heater_switches++;
+  relay_set(RELAY_HEATER, on);
+}
+
+void
+heater_enable(const bool enable)
+{
+  if (!enable) {
+    _heater_state = HEATER_OFF;
+    _heater_output = 0;
+    _heater_ff_remaining = 0;
+    _heater_switch(false);
+    relay_set(RELAY_HEATER, false);
+    return;
+  }
+  if (_heater_state == HEATER_OFF) {
+    _heater_state = HEATER_PID;
+    _heater_integral = 0;
+    _heater_has_last = false;
+    _heater_ff_remaining = 0;
+    _heater_pid_countdown = 1;
+    _heater_position = 0;
+  }
+  // relay_set_mode() may have changed it
+  relay_set(RELAY_HEATER, _heater_on);
+}
+
+static void
+_heater_pid(const int16_t temperature)
+{
+  const heater_gains_t *g = &_heater_gains;
+  const int32_t max = (int32_t)HEATER_OUTPUT_MAX << 8;
+  int32_t error = (int32_t)_heater_setpoint - temperature;
+  int32_t slope = _heater_has_last ? (int32_t)temperature - _heater_last : 0;
+
+  _heater_last = temperature;
+  _heater_has_last = true;
+  // Bounded, so that products with gains up to HEATER_GAIN_MAX fit
+  if (error > TEMPERATURE_C(100))
+    error = TEMPERATURE_C(100);
+  else if (error < -TEMPERATURE_C(100))
+    error = -TEMPERATURE_C(100);
+  if (slope > TEMPERATURE_C(10))
+    slope = TEMPERATURE_C(10);
+  else if (slope < -TEMPERATURE_C(10))
+    slope = -TEMPERATURE_C(10);
+
+  // Derivative on measurement: no kick when the setpoint changes
+  const int32_t pd = g->kp * error - g->kd * slope;
+
+  int32_t ff = 0;
+  if (_heater_ff_remaining != 0) {
+    ff = ((int32_t)_heater_ff_boost * _heater_ff_remaining / _heater_ff_duration) << 8;
+    const int32_t fall = -(int32_t)_heater_trend * (HEATER_FF_SLOPE_GAIN << 8);
+    if (fall > ff)
+      ff = fall;
+    _heater_ff_remaining--;
+  }
+
+  // Anti-windup: no integration while saturated in the error direction
+  const int32_t output = pd + _heater_integral + ff;
+  if (!((output >= max) && (error > 0)) && !((output <= 0) && (error < 0))) {
+    _heater_integral += g->ki * error;
+    if (_heater_integral > max)
+      _heater_integral = max;
+    else if (_heater_integral < 0)
+      _heater_integral = 0;
+  }
+
+  int32_t u = pd + _heater_integral + ff;
+  if (u > max)
+    u = max;
+  else if (u < 0)
+    u = 0;
+  _heater_output = u >> 8;
+}
+
+// On time of a window, within the minimum on and off times
+static uint16_t
+_heater_window_on(const uint16_t output)
+{
+  const uint16_t on = (uint32_t)output * HEATER_WINDOW / HEATER_OUTPUT_MAX;
+
+  if (on < HEATER_MIN_ON)
+    return 0;
+  if (HEATER_WINDOW - on < HEATER_MIN_OFF)
+    return HEATER_WINDOW;
+  return on;
+}
+
+static void
+_heater_autotune_done(void)
+{
+  const uint8_t n = _heater_tune.cycles - 2;
+  const int32_t pu = _heater_tune.period_sum * HEATER_PERIOD_MS / 1000 / n;	// s
+  const int32_t a = _heater_tune.amplitude_sum / n;				// 0.1 °C
+
+  _heater_state = HEATER_PID;
+  _heater_integral = (int32_t)_heater_output << 8;
+  _heater_has_last = false;
+  if ((pu == 0) || (a == 0))
+    return;
+
+  // Ku = 4 d / (π a), d = HEATER_OUTPUT_MAX / 2, Q8
+  const int32_t ku = (4L * (HEATER_OUTPUT_MAX / 2) * 256 * 100) / (314L * a);
+  heater_gains_t gains;
+  gains.kp = ku * 10 / 22;
+  gains.ki = gains.kp * 10 / (22 * pu);
+  gains.kd = gains.kp * pu * 10 / 63;
+  heater_set_gains(&gains);
+}
+
+static void
+_heater_autotune_process(const int16_t temperature)
+{
+  const int16_t high = _heater_setpoint + HEATER_AUTOTUNE_HYSTERESIS;
+  const int16_t low = _heater_setpoint - HEATER_AUTOTUNE_HYSTERESIS;
+
+  _heater_tune.elapsed++;
+  if (temperature > _heater_tune.high)
+    _heater_tune.high = temperature;
+  if (temperature < _heater_tune.low)
+    _heater_tune.low = temperature;
+
+  if (_heater_on && (temperature > high) && (_heater_since_switch >= HEATER_MIN_ON)) {
+    _heater_switch(false);
+    _heater_output = 0;
+  } else if (!_heater_on && (temperature < low) && (_heater_since_switch >= HEATER_MIN_OFF)) {
+    // A cycle ends at each switch on, the settling one is not counted
+    if (_heater_tune.cycles >= 2) {
+      _heater_tune.period_sum += _heater_tune.elapsed - _heater_tune.cycle_start;
+      _heater_tune.amplitude_sum += (_heater_tune.high - _heater_tune.low) / 2;
+    }
+    _heater_tune.cycle_start = _heater_tune.elapsed;
+    _heater_tune.high = _heater_tune.low = temperature;
+    if (++_heater_tune.cycles > HEATER_AUTOTUNE_CYCLES + 1) {
+      _heater_autotune_done();
+      return;
+    }
+    _heater_switch(true);
+    _heater_output = HEATER_OUTPUT_MAX;
+  } else {
+    _heater_switch(_heater_on);
+  }
+
+  if (_heater_tune.elapsed > HEATER_AUTOTUNE_TIMEOUT)
+    _heater_state = HEATER_PID;
+}
+
+/*
+ * Control step, every HEATER_PERIOD_MS, "slope" is the measured trend
+ * (0.1 °C per minute).  Without a valid temperature the heater is kept
+ * off.
+ */
+void
+heater_process(const int16_t temperature, const int16_t slope, const bool valid)
+{
+  if (_heater_state == HEATER_OFF)
+    return;
+  if (!valid) {
+    _heater_output = 0;
+    _heater_switch(false);
+    return;
+  }
+  _heater_trend = slope;
+  // An autotune cannot go on with the relay forced off
+  if (_heater_cut && (_heater_state == HEATER_AUTOTUNE))
+    _heater_state = HEATER_PID;
+  if (_heater_state == HEATER_AUTOTUNE) {
+    _heater_autotune_process(temperature);
+    return;
+  }
+
+  if (--_heater_pid_countdown == 0) {
+    _heater_pid_countdown = HEATER_PID_PERIOD;
+    _heater_pid(temperature);
+  }
+  if (_heater_position == 0)
+    _heater_on_periods = _heater_window_on(_heater_output);
+  _heater_switch(!_heater_cut && (_heater_position < _heater_on_periods));
+  if (++_heater_position == HEATER_WINDOW)
+    _heater_position = 0;
+}
+
+/*
+ * Boost the output for a known disturbance, starting now: the time
+ * proportioning window is restarted unless the heater has to stay off
+ * for its minimum off time.
+ */
+void
+heater_feedforward(const uint16_t boost, const uint16_t seconds)
+{
+  if ((_heater_state != HEATER_PID) || (seconds == 0))
+    return;
+  _heater_ff_boost = boost;
+  _heater_ff_duration = seconds;
+  _heater_ff_remaining = seconds;
+  _heater_pid_countdown = 1;
+  if (_heater_on || (_heater_since_switch >= HEATER_MIN_OFF))
+    _heater_position = 0;
+}
+
+/*
+ * Force the relay off, whatever the output and the minimum on time, the
+ * PID keeps running.
+ */
+void
+heater_cut(const bool cut)
+{
+  _heater_cut = cut;
+}
+
+bool
+heater_is_cut(void)
+{
+  return _heater_cut;
+}
+
+/*
+ * Setpoints outside HEATER_SETPOINT_MIN..HEATER_SETPOINT_MAX are
+ * rejected.
+ */
+bool
+heater_set_setpoint(const int16_t setpoint)
+{
+  if ((setpoint < HEATER_SETPOINT_MIN) || (setpoint > HEATER_SETPOINT_MAX))
+    return false;
+  _heater_setpoint = setpoint;
+  return true;
+}
+
+int16_t
+heater_setpoint(void)
+{
+  return _heater_setpoint;
+}
+
+static int32_t
+_heater_gain(const int32_t gain)
+{
+  if (gain < 0)
+    return 0;
+  if (gain > HEATER_GAIN_MAX)
+    return HEATER_GAIN_MAX;
+  return gain;
+}
+
+/*
+ * Gains are clamped between 0 and HEATER_GAIN_MAX.
+ */
+void
+heater_set_gains(const heater_gains_t *gains)
+{
+  _heater_gains.kp = _heater_gain(gains->kp);
+  _heater_gains.ki = _heater_gain(gains->ki);
+  _heater_gains.kd = _heater_gain(gains->kd);
+}
+
+void
+heater_gains(heater_gains_t *gains)
+{
+  *gains = _heater_gains;
+}
+
+/*
+ * Start an autotune around the setpoint, heating must be enabled.
+ */
+bool
+heater_autotune(void)
+{
+  if (_heater_state == HEATER_OFF)
+    return false;
+  _heater_state = HEATER_AUTOTUNE;
+  _heater_tune.elapsed = 0;
+  _heater_tune.cycle_start = 0;
+  _heater_tune.period_sum = 0;
+  _heater_tune.amplitude_sum = 0;
+  _heater_tune.high = INT16_MIN;
+  _heater_tune.low = INT16_MAX;
+  _heater_tune.cycles = 0;
+  return true;
+}
+
+heater_state_t
+heater_state(void)
+{
+  return _heater_state;
+}
+
+uint16_t
+heater_output(void)
+{
+  return _heater_output;
+}
+
+bool
+heater_on(void)
+{
+  return _heater_on;
+}
+
+uint16_t
+heater_switches(void)
+{
+  return _heater_switches;
+}
@@ -0,0 +1,89 @@
+#ifndef __HEATER_H__
+#define __HEATER_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "temperature.h"
+
+// heater_process() call period
+#define HEATER_PERIOD_MS	250
+
+// Oil temperature kept while heating is enabled
+#define HEATER_SETPOINT		TEMPERATURE_C(80)
+
+/*
+ * Setpoint range, a few degrees inside the oil temperatures where
+ * injection is ready, to leave room for the PID overshoot.
+ */
+#define HEATER_SETPOINT_MIN	TEMPERATURE_C(65)
+#define HEATER_SETPOINT_MAX	TEMPERATURE_C(88)
+
+/*
+ * Time proportioning: the heater relay is on for output/1000 of each
+ * window, once per window, and never for less than the minimum on or
+ * off times (in heater_process() periods).
+ */
+#define HEATER_WINDOW		(120000 / HEATER_PERIOD_MS)
+#define HEATER_MIN_ON		(10000 / HEATER_PERIOD_MS)
+#define HEATER_MIN_OFF		(10000 / HEATER_PERIOD_MS)
+
+// Full output
+#define HEATER_OUTPUT_MAX	1000
+
+/*
+ * PID gains, Q8 fixed point, output in per mille, error in 0.1 °C,
+ * integral and derivative per second:
+ * - kp: per mille per 0.1 °C of error,
+ * - ki: per mille per 0.1 °C of error, per second,
+ * - kd: per mille per 0.1 °C per second of measurement slope.
+ */
+typedef struct {
+  int32_t kp;
+  int32_t ki;
+  int32_t kd;
+} heater_gains_t;
+
+// Proportional band 5 °C, integral time 200 s, derivative time 30 s
+#define HEATER_KP		(20L * 256)
+#define HEATER_KI		(HEATER_KP / 200)
+#define HEATER_KD		(HEATER_KP * 30)
+
+/*
+ * Largest gain: with the error bounded to 100 °C and the slope to 10 °C
+ * per second, the PID terms stay far from overflowing.
+ */
+#define HEATER_GAIN_MAX		(1000L * 256)
+
+/*
+ * Feed-forward, added to the PID output without being integrated: a
+ * boost (per mille) decaying linearly over its duration, for known
+ * disturbances such as the valves opening.  While it lasts, a falling
+ * temperature raises it to at least -slope * HEATER_FF_SLOPE_GAIN
+ * (per mille per 0.1 °C/min).
+ */
+#define HEATER_FF_SLOPE_GAIN	20
+
+typedef enum {
+  HEATER_OFF,		// disabled, relay off
+  HEATER_PID,		// closed loop
+  HEATER_AUTOTUNE	// relay oscillation around the setpoint, gains are computed at the end
+} heater_state_t;
+
+void heater_init(void);
+void heater_enable(const bool enable);
+void heater_process(const int16_t temperature, const int16_t slope, const bool valid);
+void heater_cut(const bool cut);
+bool heater_is_cut(void);
+bool heater_set_setpoint(const int16_t setpoint);
+int16_t heater_setpoint(void);
+void heater_set_gains(const heater_gains_t *gains);
+void heater_gains(heater_gains_t *gains);
+void heater_feedforward(const uint16_t boost, const uint16_t seconds);
+bool heater_autotune(void);
+heater_state_t heater_state(void);
+uint16_t heater_output(void);
+bool heater_on(void);
+uint16_t heater_switches(void);
+
+#endif	/* __HEATER_H__ */
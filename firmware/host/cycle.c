@@ -0,0 +1,209 @@
+/*
+ * Closed loop runs, see cycle.h.
+ */
+
+#include "host.h"
+#include "cycle.h"
+#include "devices.h"
+
+#include "../sim/plant.h"
+#include "../utophuile.h"
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define HOST_CYCLE_MAX_STEPS	256
+
+// Mode changes within this delay after a button release are requested ones
+#define HOST_CYCLE_REQUEST_NS	HOST_S
+
+typedef enum {
+  _HOST_CYCLE_PRESS,
+  _HOST_CYCLE_AMBIENT,
+  _HOST_CYCLE_FUEL,
+  _HOST_CYCLE_LIMIT,
+  _HOST_CYCLE_QUIT
+} _host_cycle_action_t;
+
+typedef struct {
+  uint64_t date;
+  _host_cycle_action_t action;
+  double value;
+} _host_cycle_step_t;
+
+static _host_cycle_step_t _host_cycle_steps[HOST_CYCLE_MAX_STEPS];
+static unsigned _host_cycle_count = 0;
+static unsigned _host_cycle_next = 0;
+
+static const char *const _host_cycle_actions[] = {
+  [_HOST_CYCLE_PRESS] = "press",
+  [_HOST_CYCLE_AMBIENT] = "ambient",
+  [_HOST_CYCLE_FUEL] = "fuel",
+  [_HOST_CYCLE_LIMIT] = "limit",
+  [_HOST_CYCLE_QUIT] = "quit",
+};
+
+static const char *const _host_cycle_modes[] = {
+  [UTOPHUILE_MODE_OFF] = "off",
+  [UTOPHUILE_MODE_HEATING] = "heating",
+  [UTOPHUILE_MODE_READY] = "ready",
+  [UTOPHUILE_MODE_OIL] = "oil",
+  [UTOPHUILE_MODE_EMERGENCY] = "emergency",
+  [UTOPHUILE_MODE_ERROR] = "error",
+};
+
+#define HOST_CYCLE_MODE_COUNT	(sizeof(_host_cycle_modes) / sizeof(_host_cycle_modes[0]))
+
+// Metrics
+static double _host_cycle_limit = 94;
+static utophuile_mode_t _host_cycle_mode = UTOPHUILE_MODE_OFF;
+static uint64_t _host_cycle_request_end = 0;
+static uint64_t _host_cycle_heating_date = 0;
+static uint64_t _host_cycle_ready_date = 0;
+static bool _host_cycle_heating = false;
+static bool _host_cycle_ready = false;
+static uint32_t _host_cycle_transitions = 0;
+static uint32_t _host_cycle_flaps = 0;
+static uint32_t _host_cycle_entries[HOST_CYCLE_MODE_COUNT];
+static double _host_cycle_mode_s[HOST_CYCLE_MODE_COUNT];
+
+int
+host_cycle_load(const char *path)
+{
+  FILE *f = fopen(path, "r");
+  char line[256];
+  unsigned lineno = 0;
+
+  if (f == NULL) {
+    perror(path);
+    return -1;
+  }
+  while (fgets(line, sizeof(line), f) != NULL) {
+    double seconds;
+    char action[16];
+    _host_cycle_step_t step = { 0, _HOST_CYCLE_PRESS, 0 };
+    int n;
+
+    lineno++;
+    if ((line[0] == '#') || ((n = sscanf(line, "%lf %15s %lf", &seconds, action, &step.value)) < 2))
+      continue;
+    while ((step.action < _HOST_CYCLE_QUIT) && (strcmp(action, _host_cycle_actions[step.action]) != 0))
+      step.action++;
+    if ((strcmp(action, _host_cycle_actions[step.action]) != 0) || ((step.action != _HOST_CYCLE_QUIT) && (n != 3))) {
+      fprintf(stderr, "%s:%u: bad line\n", path, lineno);
+      fclose(f);
+      return -1;
+    }
+    if (_host_cycle_count == HOST_CYCLE_MAX_STEPS) {
+      fprintf(stderr, "%s:%u: too many lines\n", path, lineno);
+      break;
+    }
+    step.date = (uint64_t)(seconds * HOST_S);
+    _host_cycle_steps[_host_cycle_count++] = step;
+  }
+  fclose(f);
+  return 0;
+}
+
+static void
+_host_cycle_step(void *arg)
+{
+  (void)arg;
+  while ((_host_cycle_next < _host_cycle_count) && (_host_cycle_steps[_host_cycle_next].date <= host_now())) {
+    const _host_cycle_step_t *step = &_host_cycle_steps[_host_cycle_next++];
+    switch (step->action) {
+      case _HOST_CYCLE_PRESS: {
+        const uint64_t duration = (uint64_t)(step->value * HOST_MS);
+        host_button_press(duration);
+        _host_cycle_request_end = host_now() + duration + HOST_CYCLE_REQUEST_NS;
+        break;
+      }
+      case _HOST_CYCLE_AMBIENT:
+        sim_plant_set_ambient(step->value);
+        break;
+      case _HOST_CYCLE_FUEL:
+        sim_plant_set_fuel_flow(step->value);
+        break;
+      case _HOST_CYCLE_LIMIT:
+        _host_cycle_limit = step->value;
+        break;
+      case _HOST_CYCLE_QUIT:
+        host_exit(0);
+        break;
+    }
+  }
+  if (_host_cycle_next < _host_cycle_count)
+    host_schedule(_host_cycle_steps[_host_cycle_next].date - host_now(), _host_cycle_step, NULL);
+}
+
+// Firmware mode, sampled with the plant
+static void
+_host_cycle_sample(void *arg)
+{
+  const utophuile_mode_t mode = utophuile_mode();
+
+  (void)arg;
+  host_schedule(SIM_PLANT_STEP_NS, _host_cycle_sample, NULL);
+  if (mode < HOST_CYCLE_MODE_COUNT)
+    _host_cycle_mode_s[mode] += (double)SIM_PLANT_STEP_NS / SIM_S;
+  if (mode == _host_cycle_mode)
+    return;
+
+  host_trace("mode: %s", (mode < HOST_CYCLE_MODE_COUNT) ? _host_cycle_modes[mode] : "?");
+  _host_cycle_mode = mode;
+  _host_cycle_transitions++;
+  if (mode < HOST_CYCLE_MODE_COUNT)
+    _host_cycle_entries[mode]++;
+  // Changes the user did not ask for, once the oil was first ready
+  if (_host_cycle_ready && (host_now() > _host_cycle_request_end))
+    _host_cycle_flaps++;
+  if ((mode == UTOPHUILE_MODE_HEATING) && !_host_cycle_heating) {
+    _host_cycle_heating = true;
+    _host_cycle_heating_date = host_now();
+  }
+  if ((mode == UTOPHUILE_MODE_READY) && _host_cycle_heating && !_host_cycle_ready) {
+    _host_cycle_ready = true;
+    _host_cycle_ready_date = host_now();
+  }
+}
+
+// One "name value" line per metric, on stderr (stdout is the console)
+static void
+_host_cycle_report(void)
+{
+  sim_plant_stats_t stats;
+  const int fd = STDERR_FILENO;
+
+  sim_plant_stats(&stats);
+  dprintf(fd, "simulated_s %.1f\n", (double)host_now() / HOST_S);
+  if (_host_cycle_ready)
+    dprintf(fd, "time_to_ready_s %.1f\n", (double)(_host_cycle_ready_date - _host_cycle_heating_date) / HOST_S);
+  else
+    dprintf(fd, "time_to_ready_s -\n");
+  dprintf(fd, "peak_c %.2f\n", stats.peak_c);
+  dprintf(fd, "overshoot_c %.2f\n", (stats.peak_c > _host_cycle_limit) ? stats.peak_c - _host_cycle_limit : 0);
+  dprintf(fd, "final_c %.2f\n", stats.oil_c);
+  dprintf(fd, "transitions %" PRIu32 "\n", _host_cycle_transitions);
+  dprintf(fd, "flaps %" PRIu32 "\n", _host_cycle_flaps);
+  for (unsigned n = 0; n < HOST_CYCLE_MODE_COUNT; n++) {
+    dprintf(fd, "%s_entries %" PRIu32 "\n", _host_cycle_modes[n], _host_cycle_entries[n]);
+    dprintf(fd, "%s_s %.1f\n", _host_cycle_modes[n], _host_cycle_mode_s[n]);
+  }
+  dprintf(fd, "heater_on_s %.1f\n", stats.heater_on_s);
+  dprintf(fd, "heater_switches %" PRIu32 "\n", stats.heater_switches);
+  dprintf(fd, "relay_switches %" PRIu32 "\n", stats.relay_switches);
+  dprintf(fd, "fuel_g %.1f\n", stats.fuel_g);
+}
+
+void
+host_cycle_start(void)
+{
+  sim_plant_init(&host_env, &sim_plant_defaults);
+  host_schedule(SIM_PLANT_STEP_NS, _host_cycle_sample, NULL);
+  if (_host_cycle_count != 0)
+    host_schedule(_host_cycle_steps[0].date, _host_cycle_step, NULL);
+  host_at_exit(_host_cycle_report);
+}
@@ -0,0 +1,23 @@
+#ifndef __HOST_CYCLE_H__
+#define __HOST_CYCLE_H__
+
+/*
+ * Closed loop runs: thermal plant (sim/plant.h) on the simulated board,
+ * optional drive cycle script, and control metrics printed on stderr
+ * at exit.
+ *
+ * Drive cycle lines are "<seconds> <action> [argument]", sorted by
+ * time:
+ *   press <ms>		press the dashboard button
+ *   ambient <°C>	ambient and tank temperature
+ *   fuel <g/s>		engine consumption while the valves are open
+ *   limit <°C>		reference of the overshoot metric (default 94)
+ *   quit		end of the run
+ */
+
+#include <stdint.h>
+
+int host_cycle_load(const char *path);
+void host_cycle_start(void);
+
+#endif	/* __HOST_CYCLE_H__ */
@@ -0,0 +1,62 @@
+/*
+ * Board peripherals on the host build: sim/ models driven by the host
+ * clock, on the host I²C bus.
+ */
+
+#include "host.h"
+#include "devices.h"
+
+#include "../sim/board.h"
+
+#include <stdarg.h>
+#include <stdio.h>
+
+static void
+_host_trace(const char *fmt, ...)
+{
+  char line[256];
+  va_list ap;
+
+  if (!host_verbose)
+    return;
+  va_start(ap, fmt);
+  vsnprintf(line, sizeof(line), fmt, ap);
+  va_end(ap);
+  host_trace("%s", line);
+}
+
+const sim_env_t host_env = {
+  .schedule = host_schedule,
+  .cancel = host_cancel,
+  .trace = _host_trace,
+};
+
+static void
+_host_ads1115_rdy(const int level)
+{
+  host_pin_drive(HAL_PIN_ADS1115_RDY, level);
+}
+
+void
+host_devices_init(void)
+{
+  sim_board_init(&host_env, _host_ads1115_rdy);
+  sim_board_attach(host_i2c_attach);
+}
+
+static void
+_host_button_release(void *arg)
+{
+  (void)arg;
+  host_trace("button: released");
+  host_pin_drive(HAL_PIN_BUTTON0, -1);
+}
+
+void
+host_button_press(const uint64_t duration_ns)
+{
+  host_trace("button: pressed");
+  host_pin_drive(HAL_PIN_BUTTON0, 0);
+  host_cancel(_host_button_release, NULL);
+  host_schedule(duration_ns, _host_button_release, NULL);
+}
@@ -0,0 +1,21 @@
+#ifndef __HOST_DEVICES_H__
+#define __HOST_DEVICES_H__
+
+/*
+ * Board peripherals (sim/board.h) on the simulated I²C bus and pins,
+ * and the dashboard button.
+ */
+
+#include <stdint.h>
+
+#include "../sim/i2c_devices.h"
+
+// Host clock and traces, for the sim/ models
+extern const sim_env_t host_env;
+
+void host_devices_init(void);
+
+// Dashboard button, pressed for "duration_ns"
+void host_button_press(const uint64_t duration_ns);
+
+#endif	/* __HOST_DEVICES_H__ */
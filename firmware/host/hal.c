@@ -0,0 +1,705 @@
+/*
+ * Host implementation of hal.h: simulated atmega328p peripherals.
+ */
+
+#define _GNU_SOURCE
+
+#include "host.h"
+
+#include <errno.h>
+#include <poll.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+// Power-down sleep: clocks are stopped, see hal_sleep()
+static bool _host_power_down = false;
+static bool _host_pcint_wakeup = false;
+
+/*
+ * GPIO
+ */
+typedef struct {
+  const char *name;
+  bool output;
+  bool port;		// output level, or pull up enabled
+  int drive;		// level driven from outside, -1 if none
+  bool level;
+} _host_pin_t;
+
+static _host_pin_t _host_pins[HAL_PIN_COUNT] = {
+  [HAL_PIN_BUTTON0] = { "button", false, false, -1, true },
+  [HAL_PIN_ADS1115_RDY] = { "ads1115 rdy", false, false, -1, true },
+  [HAL_PIN_BEEP] = { "beep", false, false, -1, true },
+  [HAL_PIN_LEDS_COM] = { "leds com", false, false, -1, true },
+  [HAL_PIN_LED0] = { "green led", false, false, -1, true },
+  [HAL_PIN_LED1] = { "orange led", false, false, -1, true },
+  [HAL_PIN_LED2] = { "red led", false, false, -1, true },
+};
+
+// External interrupts: pin and sense (0 when not enabled)
+static const hal_pin_t _host_extint_pins[] = { HAL_PIN_BUTTON0, HAL_PIN_ADS1115_RDY };
+static hal_edge_t _host_extint_edges[] = { 0, 0 };
+
+/*
+ * Compute pin level (an input without pull up nor driver is read high)
+ * and raise external interrupts on edges, which need the I/O clock,
+ * and pin change interrupts.
+ */
+static void
+_host_pin_update(const hal_pin_t pin)
+{
+  _host_pin_t *p = &_host_pins[pin];
+  const bool level = p->output ? p->port : ((p->drive >= 0) ? (p->drive != 0) : true);
+
+  if (level == p->level)
+    return;
+  p->level = level;
+  if (p->output)
+    host_trace("%s: %s", p->name, level ? "high" : "low");
+  if ((pin == HAL_PIN_BUTTON0) && _host_pcint_wakeup)
+    host_irq_raise(HOST_IRQ_PCINT2);
+  if (_host_power_down)
+    return;
+
+  for (uint8_t n = 0; n < sizeof(_host_extint_pins) / sizeof(_host_extint_pins[0]); n++) {
+    if ((_host_extint_pins[n] == pin) && (_host_extint_edges[n] != 0)) {
+      const hal_edge_t edge = _host_extint_edges[n];
+      if ((edge == HAL_EDGE_ANY) || ((edge == HAL_EDGE_RISING) == level))
+        host_irq_raise(HOST_IRQ_INT0 + n);
+    }
+  }
+}
+
+void
+hal_pin_output(const hal_pin_t pin)
+{
+  _host_pins[pin].output = true;
+  _host_pin_update(pin);
+}
+
+void
+hal_pin_input_pullup(const hal_pin_t pin)
+{
+  _host_pins[pin].output = false;
+  _host_pins[pin].port = true;
+  _host_pin_update(pin);
+}
+
+void
+hal_pin_write(const hal_pin_t pin, const bool level)
+{
+  _host_pins[pin].port = level;
+  _host_pin_update(pin);
+}
+
+void
+hal_pin_toggle(const hal_pin_t pin)
+{
+  hal_pin_write(pin, !_host_pins[pin].port);
+}
+
+bool
+hal_pin_read(const hal_pin_t pin)
+{
+  return _host_pins[pin].level;
+}
+
+void
+host_pin_drive(const hal_pin_t pin, const int level)
+{
+  _host_pins[pin].drive = level;
+  _host_pin_update(pin);
+}
+
+bool
+host_pin_level(const hal_pin_t pin)
+{
+  return _host_pins[pin].level;
+}
+
+void
+hal_extint_enable(const hal_extint_t extint, const hal_edge_t edge)
+{
+  _host_extint_edges[extint] = edge;
+  host_irq_enable(HOST_IRQ_INT0 + extint, true);
+}
+
+/*
+ * Scheduler tick, stopped in power-down
+ */
+static uint64_t _host_tick_date = 0;
+
+static void
+_host_tick(void *arg)
+{
+  (void)arg;
+  _host_tick_date = host_now();
+  host_schedule(HOST_MS, _host_tick, NULL);
+  if (!_host_power_down)
+    host_irq_raise(HOST_IRQ_TIMER1_COMPA);
+}
+
+void
+hal_tick_init(void)
+{
+  _host_tick_date = host_now();
+  host_cancel(_host_tick, NULL);
+  host_schedule(HOST_MS, _host_tick, NULL);
+  host_irq_enable(HOST_IRQ_TIMER1_COMPA, true);
+}
+
+bool
+hal_tick_missed(void)
+{
+  return false;		/* interrupt handlers take no time */
+}
+
+uint8_t
+hal_tick_phase(void)
+{
+  return (host_now() - _host_tick_date) * HAL_TICK_PHASES / HOST_MS;
+}
+
+/*
+ * Tone timer
+ */
+static uint64_t _host_tone_period;
+static bool _host_tone_playing = false;
+
+static void
+_host_tone_match(void *arg)
+{
+  (void)arg;
+  host_schedule(_host_tone_period, _host_tone_match, NULL);
+  host_irq_raise(HOST_IRQ_TIMER0_COMPA);
+}
+
+void
+hal_tone_start(const uint8_t ocr, const bool output)
+{
+  if (output)
+    host_trace("beep: %u Hz", (unsigned)(HAL_TONE_HZ / (2 * ((unsigned)ocr + 1))));
+  else if (_host_tone_playing)
+    host_trace("beep: off");
+  _host_tone_playing = output;
+
+  host_cancel(_host_tone_match, NULL);
+  _host_tone_period = ((uint64_t)ocr + 1) * HOST_S / HAL_TONE_HZ;
+  host_schedule(_host_tone_period, _host_tone_match, NULL);
+  host_irq_enable(HOST_IRQ_TIMER0_COMPA, true);
+}
+
+void
+hal_tone_stop(void)
+{
+  if (_host_tone_playing)
+    host_trace("beep: off");
+  _host_tone_playing = false;
+  host_cancel(_host_tone_match, NULL);
+  host_irq_enable(HOST_IRQ_TIMER0_COMPA, false);
+  host_irq_clear(HOST_IRQ_TIMER0_COMPA);
+}
+
+/*
+ * UART, on the console file descriptors.  Characters take their
+ * transmission time at the configured baud rate, in both directions.
+ */
+#define HOST_CONSOLE_BUFSIZE	4096
+
+static int _host_console_in = -1;
+static int _host_console_out = -1;
+static bool _host_console_closed = true;
+
+static uint64_t _host_uart_char_ns = 10 * HOST_S / 38400;
+
+static uint8_t _host_uart_rx_fifo[HOST_CONSOLE_BUFSIZE];
+static size_t _host_uart_rx_fifo_head = 0;
+static size_t _host_uart_rx_fifo_tail = 0;
+static bool _host_uart_rx_busy = false;
+static bool _host_uart_rx_full = false;
+static uint8_t _host_uart_rx_data;
+static uint8_t _host_uart_rx_status = 0;
+
+static uint8_t _host_uart_tx_buf[HOST_CONSOLE_BUFSIZE];
+static size_t _host_uart_tx_len = 0;
+static bool _host_uart_tx_ready = true;
+static bool _host_uart_tx_done = false;
+static bool _host_uart_tx_irq = false;
+
+void
+host_console_init(const int in_fd, const int out_fd)
+{
+  _host_console_in = in_fd;
+  _host_console_out = out_fd;
+  _host_console_closed = (in_fd < 0);
+}
+
+bool
+host_console_closed(void)
+{
+  return _host_console_closed;
+}
+
+void
+host_console_flush(void)
+{
+  size_t done = 0;
+
+  while ((_host_console_out >= 0) && (done < _host_uart_tx_len)) {
+    const ssize_t n = write(_host_console_out, _host_uart_tx_buf + done, _host_uart_tx_len - done);
+    if ((n < 0) && (errno != EINTR) && (errno != EAGAIN))
+      break;
+    if (n > 0)
+      done += n;
+  }
+  _host_uart_tx_len = 0;
+}
+
+// Move the next received character into the data register, or lose
+// it in power-down
+static void
+_host_uart_rx_char(void *arg)
+{
+  (void)arg;
+  if (_host_uart_rx_fifo_tail == _host_uart_rx_fifo_head) {
+    _host_uart_rx_busy = false;
+    return;
+  }
+  if (_host_power_down) {
+    host_trace("uart: character lost in power-down");
+    if (_host_pcint_wakeup)
+      host_irq_raise(HOST_IRQ_PCINT2);
+  } else if (_host_uart_rx_full) {
+    _host_uart_rx_status |= HAL_UART_RX_OVERRUN;
+  } else {
+    _host_uart_rx_data = _host_uart_rx_fifo[_host_uart_rx_fifo_tail];
+    _host_uart_rx_full = true;
+    host_irq_level(HOST_IRQ_USART_RX, true);
+  }
+  _host_uart_rx_fifo_tail++;
+  host_schedule(_host_uart_char_ns, _host_uart_rx_char, NULL);
+}
+
+/*
+ * Wait up to "wait_ns" for console input, and start receiving it.
+ */
+void
+host_console_poll(const uint64_t wait_ns)
+{
+  struct pollfd pfd = { _host_console_in, POLLIN, 0 };
+  const struct timespec ts = { wait_ns / HOST_S, wait_ns % HOST_S };
+  const bool room = (_host_uart_rx_fifo_head < sizeof(_host_uart_rx_fifo));
+
+  host_console_flush();
+  if (_host_console_closed || !room) {
+    if (wait_ns != 0)
+      nanosleep(&ts, NULL);
+    return;
+  }
+  if (ppoll(&pfd, 1, (wait_ns == UINT64_MAX) ? NULL : &ts, NULL) <= 0)
+    return;
+
+  if (_host_uart_rx_fifo_tail == _host_uart_rx_fifo_head)
+    _host_uart_rx_fifo_head = _host_uart_rx_fifo_tail = 0;
+  const ssize_t n = read(_host_console_in, _host_uart_rx_fifo + _host_uart_rx_fifo_head, sizeof(_host_uart_rx_fifo) - _host_uart_rx_fifo_head);
+  if (n <= 0) {
+    if ((n == 0) || ((errno != EINTR) && (errno != EAGAIN)))
+      _host_console_closed = true;
+    return;
+  }
+  _host_uart_rx_fifo_head += n;
+  if (!_host_uart_rx_busy) {
+    _host_uart_rx_busy = true;
+    host_schedule(_host_uart_char_ns, _host_uart_rx_char, NULL);
+  }
+}
+
+static void
+_host_uart_tx_char(void *arg)
+{
+  (void)arg;
+  _host_uart_tx_ready = true;
+  _host_uart_tx_done = true;
+  host_irq_level(HOST_IRQ_USART_UDRE, _host_uart_tx_irq);
+}
+
+void
+hal_uart_init(const uint32_t baud)
+{
+  _host_uart_char_ns = 10 * HOST_S / baud;
+  host_irq_enable(HOST_IRQ_USART_RX, true);
+  host_irq_enable(HOST_IRQ_USART_UDRE, true);
+  host_irq_level(HOST_IRQ_USART_UDRE, false);
+}
+
+uint8_t
+hal_uart_rx_status(void)
+{
+  return _host_uart_rx_status;
+}
+
+uint8_t
+hal_uart_rx_data(void)
+{
+  _host_uart_rx_full = false;
+  _host_uart_rx_status = 0;
+  host_irq_level(HOST_IRQ_USART_RX, false);
+  return _host_uart_rx_data;
+}
+
+void
+hal_uart_tx_data(const uint8_t c)
+{
+  if (_host_uart_tx_len == sizeof(_host_uart_tx_buf))
+    host_console_flush();
+  _host_uart_tx_buf[_host_uart_tx_len++] = c;
+  _host_uart_tx_ready = false;
+  _host_uart_tx_done = false;
+  host_irq_level(HOST_IRQ_USART_UDRE, false);
+  host_schedule(_host_uart_char_ns, _host_uart_tx_char, NULL);
+}
+
+bool
+hal_uart_tx_ready(void)
+{
+  return _host_uart_tx_ready;
+}
+
+bool
+hal_uart_tx_done(void)
+{
+  return _host_uart_tx_done;
+}
+
+void
+hal_uart_tx_irq(const bool enable)
+{
+  _host_uart_tx_irq = enable;
+  host_irq_level(HOST_IRQ_USART_UDRE, enable && _host_uart_tx_ready);
+}
+
+/*
+ * TWI master, 100 kHz, on the attached I²C devices.
+ */
+#define HOST_TWI_BIT_NS		(10 * HOST_US)
+
+typedef enum {
+  _HOST_TWI_IDLE,		// no transfer in progress
+  _HOST_TWI_ADDRESS,		// next byte is SLA+R/W
+  _HOST_TWI_TRANSMIT,		// master transmitter
+  _HOST_TWI_RECEIVE		// master receiver
+} _host_twi_phase_t;
+
+static sim_i2c_device_t *_host_i2c_devices = NULL;
+static sim_i2c_device_t *_host_twi_device = NULL;
+static _host_twi_phase_t _host_twi_phase = _HOST_TWI_IDLE;
+static bool _host_twi_owner = false;
+static bool _host_twi_ack;
+static uint8_t _host_twi_data;
+static uint8_t _host_twi_status = TW_NO_INFO;
+
+void
+host_i2c_attach(sim_i2c_device_t *device)
+{
+  device->next = _host_i2c_devices;
+  _host_i2c_devices = device;
+}
+
+static void
+_host_twi_interrupt(const uint8_t status)
+{
+  _host_twi_status = status;
+  host_irq_level(HOST_IRQ_TWI, true);
+}
+
+static void
+_host_twi_started(void *arg)
+{
+  (void)arg;
+  _host_twi_phase = _HOST_TWI_ADDRESS;
+  _host_twi_interrupt(_host_twi_owner ? TW_REP_START : TW_START);
+  _host_twi_owner = true;
+}
+
+// Address or data byte transfered
+static void
+_host_twi_transfered(void *arg)
+{
+  (void)arg;
+  sim_i2c_device_t *device = _host_twi_device;
+
+  switch (_host_twi_phase) {
+    case _HOST_TWI_ADDRESS: {
+      const bool read = _host_twi_data & TW_READ;
+      device = _host_i2c_devices;
+      while ((device != NULL) && (device->address != (_host_twi_data >> 1)))
+        device = device->next;
+      if ((device != NULL) && device->start(device, read)) {
+        _host_twi_device = device;
+        _host_twi_phase = read ? _HOST_TWI_RECEIVE : _HOST_TWI_TRANSMIT;
+        _host_twi_interrupt(read ? TW_MR_SLA_ACK : TW_MT_SLA_ACK);
+      } else {
+        _host_twi_device = NULL;
+        _host_twi_phase = _HOST_TWI_IDLE;
+        _host_twi_interrupt(read ? TW_MR_SLA_NACK : TW_MT_SLA_NACK);
+      }
+      break;
+    }
+    case _HOST_TWI_TRANSMIT:
+      _host_twi_interrupt(device->write(device, _host_twi_data) ? TW_MT_DATA_ACK : TW_MT_DATA_NACK);
+      break;
+    case _HOST_TWI_RECEIVE:
+      _host_twi_data = device->read(device, _host_twi_ack);
+      _host_twi_interrupt(_host_twi_ack ? TW_MR_DATA_ACK : TW_MR_DATA_NACK);
+      break;
+    case _HOST_TWI_IDLE:
+      _host_twi_interrupt(TW_BUS_ERROR);
+      break;
+  }
+}
+
+static void
+_host_twi_release(void)
+{
+  host_cancel(_host_twi_started, NULL);
+  host_cancel(_host_twi_transfered, NULL);
+  host_irq_level(HOST_IRQ_TWI, false);
+  _host_twi_status = TW_NO_INFO;
+}
+
+void
+hal_twi_init(void)
+{
+  host_irq_enable(HOST_IRQ_TWI, true);
+  host_irq_level(HOST_IRQ_TWI, false);
+}
+
+void
+hal_twi_start(void)
+{
+  _host_twi_release();
+  host_schedule(HOST_TWI_BIT_NS, _host_twi_started, NULL);
+}
+
+void
+hal_twi_stop(void)
+{
+  _host_twi_release();
+  if (_host_twi_device != NULL)
+    _host_twi_device->stop(_host_twi_device);
+  _host_twi_device = NULL;
+  _host_twi_phase = _HOST_TWI_IDLE;
+  _host_twi_owner = false;
+}
+
+void
+hal_twi_stop_start(void)
+{
+  hal_twi_stop();
+  hal_twi_start();
+}
+
+void
+hal_twi_next(const bool ack)
+{
+  _host_twi_release();
+  _host_twi_ack = ack;
+  host_schedule(9 * HOST_TWI_BIT_NS, _host_twi_transfered, NULL);
+}
+
+void
+hal_twi_write(const uint8_t data)
+{
+  _host_twi_data = data;
+}
+
+uint8_t
+hal_twi_read(void)
+{
+  return _host_twi_data;
+}
+
+uint8_t
+hal_twi_status(void)
+{
+  return _host_twi_status;
+}
+
+/*
+ * EEPROM, erased (0xff) unless loaded from a file with
+ * host_eeprom_load(), which is then written back at exit.
+ */
+#define HOST_EEPROM_WRITE_NS	(3400 * HOST_US)
+
+static uint8_t _host_eeprom[HAL_EEPROM_SIZE];
+static bool _host_eeprom_busy = false;
+static bool _host_eeprom_irq = false;
+static const char *_host_eeprom_path = NULL;
+
+static void
+_host_eeprom_init(void)
+{
+  static bool done = false;
+  if (done)
+    return;
+  memset(_host_eeprom, 0xff, sizeof(_host_eeprom));
+  done = true;
+}
+
+static void
+_host_eeprom_save(void)
+{
+  FILE *f = fopen(_host_eeprom_path, "w");
+
+  if ((f == NULL) || (fwrite(_host_eeprom, sizeof(_host_eeprom), 1, f) != 1))
+    perror(_host_eeprom_path);
+  if (f != NULL)
+    fclose(f);
+}
+
+/*
+ * A missing file is an erased EEPROM, created at exit.
+ */
+int
+host_eeprom_load(const char *path)
+{
+  FILE *f = fopen(path, "r");
+
+  _host_eeprom_init();
+  if (f != NULL) {
+    const size_t n = fread(_host_eeprom, 1, sizeof(_host_eeprom), f);
+    fclose(f);
+    if (n != sizeof(_host_eeprom)) {
+      fprintf(stderr, "%s: not a %u bytes EEPROM image\n", path, HAL_EEPROM_SIZE);
+      return -1;
+    }
+  } else if (errno != ENOENT) {
+    perror(path);
+    return -1;
+  }
+  _host_eeprom_path = path;
+  host_at_exit(_host_eeprom_save);
+  return 0;
+}
+
+static void
+_host_eeprom_written(void *arg)
+{
+  (void)arg;
+  _host_eeprom_busy = false;
+  host_irq_level(HOST_IRQ_EE_READY, _host_eeprom_irq);
+}
+
+bool
+hal_eeprom_ready(void)
+{
+  return !_host_eeprom_busy;
+}
+
+uint8_t
+hal_eeprom_read(const uint16_t address)
+{
+  _host_eeprom_init();
+  return _host_eeprom[address % HAL_EEPROM_SIZE];
+}
+
+void
+hal_eeprom_write(const uint16_t address, const uint8_t data)
+{
+  _host_eeprom_init();
+  if (_host_eeprom_busy)
+    return;
+  _host_eeprom[address % HAL_EEPROM_SIZE] = data;
+  _host_eeprom_busy = true;
+  host_irq_level(HOST_IRQ_EE_READY, false);
+  host_schedule(HOST_EEPROM_WRITE_NS, _host_eeprom_written, NULL);
+}
+
+void
+hal_eeprom_irq(const bool enable)
+{
+  _host_eeprom_irq = enable;
+  host_irq_enable(HOST_IRQ_EE_READY, true);
+  host_irq_level(HOST_IRQ_EE_READY, enable && !_host_eeprom_busy);
+}
+
+/*
+ * Reset: the simulation always starts from power on.
+ */
+uint8_t
+hal_reset_cause(void)
+{
+  static uint8_t cause = HAL_RESET_POWER_ON;
+  const uint8_t c = cause;
+
+  cause = 0;
+  return c;
+}
+
+/*
+ * Power management
+ */
+static void
+_host_wdt(void *arg)
+{
+  (void)arg;
+  host_schedule(HAL_WDT_MS * HOST_MS, _host_wdt, NULL);
+  host_irq_raise(HOST_IRQ_WDT);
+}
+
+void
+hal_sleep(const hal_sleep_t mode)
+{
+  _host_power_down = (mode == HAL_SLEEP_POWER_DOWN);
+  sei();
+  host_sleep();
+  _host_power_down = false;
+}
+
+void
+hal_wdt_wakeup(const bool enable)
+{
+  host_cancel(_host_wdt, NULL);
+  host_irq_clear(HOST_IRQ_WDT);
+  host_irq_enable(HOST_IRQ_WDT, enable);
+  if (enable)
+    host_schedule(HAL_WDT_MS * HOST_MS, _host_wdt, NULL);
+}
+
+void
+hal_pcint_wakeup(const bool enable)
+{
+  _host_pcint_wakeup = enable;
+  host_irq_clear(HOST_IRQ_PCINT2);
+  host_irq_enable(HOST_IRQ_PCINT2, enable);
+}
+
+void
+hal_power_reduce(void)
+{
+}
+
+/*
+ * RAM: firmware variables and stack live in host memory.  A painted
+ * image, without .data nor .bss, stands for the atmega328p RAM, and
+ * its stack is always empty.
+ */
+static uint8_t _host_ram[HAL_RAM_SIZE] = { [0 ... HAL_RAM_SIZE - 1] = HAL_RAM_PAINT };
+
+void
+hal_ram_layout(hal_ram_t *ram)
+{
+  ram->data = 0;
+  ram->bss = 0;
+  ram->heap = _host_ram;
+  ram->brk = _host_ram;
+  ram->end = _host_ram + HAL_RAM_SIZE;
+}
+
+uint8_t *
+hal_stack_pointer(void)
+{
+  return _host_ram + HAL_RAM_SIZE - 1;
+}
@@ -0,0 +1,73 @@
+#ifndef __HAL_HOST_H__
+#define __HAL_HOST_H__
+
+/*
+ * Host implementation of hal.h, on simulated hardware (see hal.c).
+ */
+
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <util/twi.h>
+
+void hal_pin_output(const hal_pin_t pin);
+void hal_pin_input_pullup(const hal_pin_t pin);
+void hal_pin_write(const hal_pin_t pin, const bool level);
+void hal_pin_toggle(const hal_pin_t pin);
+bool hal_pin_read(const hal_pin_t pin);
+
+void hal_extint_enable(const hal_extint_t extint, const hal_edge_t edge);
+
+#define HAL_TICK_PHASES	250
+
+void hal_tick_init(void);
+bool hal_tick_missed(void);
+uint8_t hal_tick_phase(void);
+
+void hal_tone_start(const uint8_t ocr, const bool output);
+void hal_tone_stop(void);
+
+#define HAL_UART_RX_FRAME_ERROR	0x01
+#define HAL_UART_RX_OVERRUN	0x02
+
+void hal_uart_init(const uint32_t baud);
+uint8_t hal_uart_rx_status(void);
+uint8_t hal_uart_rx_data(void);
+void hal_uart_tx_data(const uint8_t c);
+bool hal_uart_tx_ready(void);
+bool hal_uart_tx_done(void);
+void hal_uart_tx_irq(const bool enable);
+
+void hal_twi_init(void);
+void hal_twi_start(void);
+void hal_twi_stop(void);
+void hal_twi_stop_start(void);
+void hal_twi_next(const bool ack);
+void hal_twi_write(const uint8_t data);
+uint8_t hal_twi_read(void);
+uint8_t hal_twi_status(void);
+
+bool hal_eeprom_ready(void);
+uint8_t hal_eeprom_read(const uint16_t address);
+void hal_eeprom_write(const uint16_t address, const uint8_t data);
+void hal_eeprom_irq(const bool enable);
+
+#define HAL_RESET_POWER_ON	0x01
+#define HAL_RESET_EXTERNAL	0x02
+#define HAL_RESET_BROWN_OUT	0x04
+#define HAL_RESET_WATCHDOG	0x08
+
+uint8_t hal_reset_cause(void);
+
+void hal_busy_wait(void);
+
+void hal_sleep(const hal_sleep_t mode);
+void hal_wdt_wakeup(const bool enable);
+void hal_pcint_wakeup(const bool enable);
+void hal_power_reduce(void);
+
+#define HAL_RAM_PAINTER		/* see hal.c */
+
+void hal_ram_layout(hal_ram_t *ram);
+uint8_t *hal_stack_pointer(void);
+
+#endif	/* __HAL_HOST_H__ */
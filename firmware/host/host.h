@@ -0,0 +1,87 @@
+#ifndef __HOST_H__
+#define __HOST_H__
+
+/*
+ * Simulated machine running the firmware on the host: virtual clock,
+ * timed events, interrupts, pins, console and I²C bus.
+ *
+ * Firmware code never blocks in the simulation: time only passes when
+ * the CPU sleeps or busy waits, and jumps straight to the next event,
+ * so the firmware runs as fast as the host allows unless a speed
+ * factor is set with host_set_speed().
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "../hal.h"
+#include "../sim/i2c_devices.h"
+
+#define HOST_US		1000ULL
+#define HOST_MS		1000000ULL
+#define HOST_S		1000000000ULL
+
+// Virtual clock, in ns since reset
+uint64_t host_now(void);
+
+// Timed events, "fct" is called with "arg" when virtual time reaches its date
+typedef void (*host_event_fct)(void *arg);
+void host_schedule(const uint64_t delay_ns, host_event_fct fct, void *arg);
+void host_cancel(host_event_fct fct, void *arg);
+
+// Interrupt sources, by decreasing priority (atmega328p vector order)
+typedef enum {
+  HOST_IRQ_INT0,
+  HOST_IRQ_INT1,
+  HOST_IRQ_PCINT2,
+  HOST_IRQ_WDT,
+  HOST_IRQ_TIMER1_COMPA,
+  HOST_IRQ_TIMER0_COMPA,
+  HOST_IRQ_USART_RX,
+  HOST_IRQ_USART_UDRE,
+  HOST_IRQ_EE_READY,
+  HOST_IRQ_TWI,
+  HOST_IRQ_COUNT
+} host_irq_t;
+
+void host_irq_raise(const host_irq_t irq);
+void host_irq_clear(const host_irq_t irq);
+void host_irq_enable(const host_irq_t irq, const bool enable);
+// Level triggered sources: pending as long as "flag" is set
+void host_irq_level(const host_irq_t irq, const bool flag);
+
+// Run pending interrupts, or let time pass until there is one
+void host_sleep(void);
+// Let time pass until the next event, running pending interrupts if enabled
+void host_step(void);
+
+// Wall clock pacing: 0 as fast as possible, 1 real time, 10 ten times faster, ...
+void host_set_speed(const double speed);
+// Stop simulation at this virtual time (0: never)
+void host_set_time_limit(const uint64_t ns);
+// Called at each step, for external inputs (console, signals)
+void host_set_poll(void (*fct)(const uint64_t wait_ns));
+void host_exit(const int status);
+void host_at_exit(void (*fct)(void));
+
+// Pins driven from outside: level 0 or 1, or -1 to release the pin
+void host_pin_drive(const hal_pin_t pin, const int level);
+bool host_pin_level(const hal_pin_t pin);
+
+// Console (UART)
+void host_console_init(const int in_fd, const int out_fd);
+void host_console_poll(const uint64_t wait_ns);	// wait for input, see host_set_poll()
+void host_console_flush(void);
+bool host_console_closed(void);
+
+// I²C bus, with the devices of sim/i2c_devices.h
+void host_i2c_attach(sim_i2c_device_t *device);
+
+// EEPROM contents, kept in "path" across runs (see hal.c)
+int host_eeprom_load(const char *path);
+
+// Trace on stderr, prefixed by virtual time
+extern bool host_verbose;
+void host_trace(const char *fmt, ...) __attribute__((format(printf, 1, 2)));
+
+#endif	/* __HOST_H__ */
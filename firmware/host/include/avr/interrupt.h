@@ -0,0 +1,18 @@
+#ifndef __HOST_AVR_INTERRUPT_H__
+#define __HOST_AVR_INTERRUPT_H__
+
+/*
+ * Host build: interrupt handlers are plain functions, run by the
+ * simulated CPU (see host/sim.c) with interrupts disabled.
+ */
+
+#include <avr/io.h>
+
+#define sei()		(SREG |= _BV(SREG_I))
+#define cli()		(SREG &= ~_BV(SREG_I))
+
+#define ISR(vector, ...) \
+  void vector(void); \
+  void vector(void)
+
+#endif	/* __HOST_AVR_INTERRUPT_H__ */
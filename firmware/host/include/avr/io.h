@@ -0,0 +1,21 @@
+#ifndef __HOST_AVR_IO_H__
+#define __HOST_AVR_IO_H__
+
+/*
+ * Host build: the part of avr-libc <avr/io.h> which is not about
+ * peripherals.  Registers are deliberately missing, drivers go through
+ * hal.h.
+ */
+
+#include <stdint.h>
+
+#define _BV(bit)			(1 << (bit))
+#define bit_is_set(sfr, bit)		((sfr) & _BV(bit))
+#define bit_is_clear(sfr, bit)		(!((sfr) & _BV(bit)))
+
+// Status register, only the global interrupt enable bit is used
+extern volatile uint8_t host_sreg;
+#define SREG		host_sreg
+#define SREG_I		7
+
+#endif	/* __HOST_AVR_IO_H__ */
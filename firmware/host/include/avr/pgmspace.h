@@ -0,0 +1,28 @@
+#ifndef __HOST_AVR_PGMSPACE_H__
+#define __HOST_AVR_PGMSPACE_H__
+
+/*
+ * Host build: program memory is ordinary memory.
+ */
+
+#include <avr/io.h>
+
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+
+#define PROGMEM
+#define PGM_P			const char *
+#define PSTR(s)			(s)
+
+#define pgm_read_byte(addr)	(*(const uint8_t *)(addr))
+#define pgm_read_word(addr)	(*(const uint16_t *)(addr))
+#define pgm_read_dword(addr)	(*(const uint32_t *)(addr))
+#define pgm_read_ptr(addr)	(*(void *const *)(addr))
+
+#define strcmp_P		strcmp
+#define strncmp_P		strncmp
+#define strlen_P		strlen
+#define memcpy_P		memcpy
+
+#endif	/* __HOST_AVR_PGMSPACE_H__ */
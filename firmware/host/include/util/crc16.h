@@ -0,0 +1,20 @@
+#ifndef __HOST_UTIL_CRC16_H__
+#define __HOST_UTIL_CRC16_H__
+
+/*
+ * Host build: avr-libc <util/crc16.h>, from the C equivalents given in
+ * its documentation.
+ */
+
+#include <stdint.h>
+
+// CRC-CCITT, polynomial x^16 + x^12 + x^5 + 1 (0x8408, reflected)
+static inline uint16_t
+_crc_ccitt_update(uint16_t crc, uint8_t data)
+{
+  data ^= crc & 0xff;
+  data ^= data << 4;
+  return ((((uint16_t)data << 8) | (crc >> 8)) ^ (uint8_t)(data >> 4) ^ ((uint16_t)data << 3));
+}
+
+#endif	/* __HOST_UTIL_CRC16_H__ */
@@ -0,0 +1,210 @@
+/*
+ * Host build entry point: options, console and simulated devices, then
+ * the firmware main().
+ */
+
+#define _GNU_SOURCE
+
+#include "host.h"
+#include "cycle.h"
+#include "devices.h"
+#include "../sim/board.h"
+
+#include <fcntl.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <termios.h>
+#include <unistd.h>
+
+// Firmware main(), see Makefile
+int utophuile_main(void);
+
+// Console stays open this long after its input is closed
+#define HOST_DRAIN_NS		HOST_S
+
+// Button presses requested with SIGUSR1 (short) and SIGUSR2 (long)
+#define HOST_SHORT_PRESS_NS	(100 * HOST_MS)
+#define HOST_LONG_PRESS_NS	(1500 * HOST_MS)
+
+static volatile sig_atomic_t _host_short_press = 0;
+static volatile sig_atomic_t _host_long_press = 0;
+static volatile sig_atomic_t _host_quit = 0;
+
+// A drive cycle ends the run itself, even without console input
+static bool _host_cycle_run = false;
+
+static int _host_tty_fd = -1;
+static struct termios _host_tty_saved;
+
+static void
+usage(const char *name)
+{
+  fprintf(stderr,
+          "usage: %s [-p] [-s speed] [-t seconds] [-T celsius] [-P] [-c cycle] [-f ms] [-e eeprom] [-v]\n"
+          "  -p          console on a new pseudo terminal instead of stdin/stdout\n"
+          "  -s speed    wall clock pacing: 1 real time (default), 0 as fast as possible\n"
+          "  -t seconds  stop after this simulated time\n"
+          "  -T celsius  oil temperature (default 20)\n"
+          "  -P          oil temperature from the thermal plant model (sim/plant.h)\n"
+          "  -c cycle    run this drive cycle on the plant, see host/cycle.h\n"
+          "  -f ms       relay feedback delay (default 10)\n"
+          "  -e eeprom   EEPROM image, loaded at start and saved at exit\n"
+          "  -v          trace hardware events on stderr\n"
+          "SIGUSR1 and SIGUSR2 press the dashboard button (short and long press).\n",
+          name);
+  exit(2);
+}
+
+static void
+_host_signal(int sig)
+{
+  if (sig == SIGUSR1)
+    _host_short_press = 1;
+  else if (sig == SIGUSR2)
+    _host_long_press = 1;
+  else
+    _host_quit = 1;
+}
+
+static void
+_host_drained(void *arg)
+{
+  (void)arg;
+  host_exit(0);
+}
+
+static void
+_host_poll(const uint64_t wait_ns)
+{
+  static bool draining = false;
+
+  host_console_poll(wait_ns);
+
+  if (_host_quit)
+    host_exit(0);
+  if (_host_short_press) {
+    _host_short_press = 0;
+    host_button_press(HOST_SHORT_PRESS_NS);
+  }
+  if (_host_long_press) {
+    _host_long_press = 0;
+    host_button_press(HOST_LONG_PRESS_NS);
+  }
+  if (host_console_closed() && !draining && !_host_cycle_run) {
+    draining = true;
+    host_schedule(HOST_DRAIN_NS, _host_drained, NULL);
+  }
+}
+
+static void
+_host_tty_restore(void)
+{
+  host_console_flush();
+  if (_host_tty_fd >= 0)
+    tcsetattr(_host_tty_fd, TCSANOW, &_host_tty_saved);
+}
+
+// Raw terminal: the firmware does echo and line editing, ^C still quits
+static void
+_host_tty_raw(const int fd, const bool save)
+{
+  struct termios t;
+
+  if (tcgetattr(fd, &t) != 0)
+    return;
+  if (save) {
+    _host_tty_fd = fd;
+    _host_tty_saved = t;
+  }
+  cfmakeraw(&t);
+  t.c_lflag |= ISIG;
+  tcsetattr(fd, TCSANOW, &t);
+}
+
+int
+main(int argc, char *argv[])
+{
+  bool pty = false;
+  double speed = 1;
+  double oil = 20;
+  bool plant = false;
+  uint64_t feedback_delay = SIM_BOARD_FEEDBACK_DELAY_NS;
+  int opt;
+
+  while ((opt = getopt(argc, argv, "ps:t:T:Pc:f:e:v")) != -1) {
+    switch (opt) {
+      case 'p':
+        pty = true;
+        break;
+      case 's':
+        speed = atof(optarg);
+        break;
+      case 't':
+        host_set_time_limit((uint64_t)(atof(optarg) * HOST_S));
+        break;
+      case 'T':
+        oil = atof(optarg);
+        break;
+      case 'c':
+        if (host_cycle_load(optarg) != 0)
+          return 1;
+        _host_cycle_run = true;
+        /* fall through */
+      case 'P':
+        plant = true;
+        break;
+      case 'f':
+        feedback_delay = (uint64_t)(atof(optarg) * HOST_MS);
+        break;
+      case 'e':
+        if (host_eeprom_load(optarg) != 0)
+          return 1;
+        break;
+      case 'v':
+        host_verbose = true;
+        break;
+      default:
+        usage(argv[0]);
+    }
+  }
+  if (optind != argc)
+    usage(argv[0]);
+
+  if (pty) {
+    const int fd = posix_openpt(O_RDWR | O_NOCTTY);
+    if ((fd < 0) || (grantpt(fd) != 0) || (unlockpt(fd) != 0)) {
+      perror("posix_openpt");
+      return 1;
+    }
+    // Keep the slave side open, so that the master never sees a hang up
+    const int slave = open(ptsname(fd), O_RDWR | O_NOCTTY);
+    if (slave >= 0)
+      _host_tty_raw(slave, false);
+    fprintf(stderr, "console: %s\n", ptsname(fd));
+    host_console_init(fd, fd);
+  } else {
+    if (isatty(STDIN_FILENO))
+      _host_tty_raw(STDIN_FILENO, true);
+    host_console_init(STDIN_FILENO, STDOUT_FILENO);
+  }
+  host_at_exit(_host_tty_restore);
+
+  signal(SIGUSR1, _host_signal);
+  signal(SIGUSR2, _host_signal);
+  signal(SIGINT, _host_signal);
+  signal(SIGTERM, _host_signal);
+
+  host_set_speed(speed);
+  host_set_poll(_host_poll);
+
+  host_devices_init();
+  sim_board_set_feedback_delay(feedback_delay);
+  if (plant)
+    host_cycle_start();
+  else
+    sim_board_set_oil_temperature(oil);
+
+  return utophuile_main();
+}
@@ -0,0 +1,317 @@
+/*
+ * Simulated CPU: virtual clock, timed events and interrupt dispatch.
+ */
+
+#include "host.h"
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+volatile uint8_t host_sreg = 0;
+
+bool host_verbose = false;
+
+// Interrupt vectors, defined by the firmware with ISR()
+extern void INT0_vect(void) __attribute__((weak));
+extern void INT1_vect(void) __attribute__((weak));
+extern void PCINT2_vect(void) __attribute__((weak));
+extern void WDT_vect(void) __attribute__((weak));
+extern void TIMER1_COMPA_vect(void) __attribute__((weak));
+extern void TIMER0_COMPA_vect(void) __attribute__((weak));
+extern void USART_RX_vect(void) __attribute__((weak));
+extern void USART_UDRE_vect(void) __attribute__((weak));
+extern void EE_READY_vect(void) __attribute__((weak));
+extern void TWI_vect(void) __attribute__((weak));
+
+typedef struct {
+  void (*vector)(void);
+  bool enabled;
+  bool flag;
+  bool level;	// flag is not cleared when the vector is run
+} _host_irq_t;
+
+static _host_irq_t _host_irqs[HOST_IRQ_COUNT];
+
+#define HOST_MAX_EVENTS	64
+
+typedef struct {
+  uint64_t date;
+  uint64_t seq;		// events due at the same date run in scheduling order
+  host_event_fct fct;
+  void *arg;
+  bool used;
+} _host_event_t;
+
+static _host_event_t _host_events[HOST_MAX_EVENTS];
+static uint64_t _host_event_seq = 0;
+static uint64_t _host_now = 0;
+
+// Something happened while waiting for the wall clock
+static bool _host_wakeup = false;
+
+static double _host_speed = 0;
+static uint64_t _host_time_limit = 0;
+static struct timespec _host_wall_start;
+static void (*_host_poll)(const uint64_t wait_ns) = NULL;
+
+#define HOST_MAX_AT_EXIT	4
+static void (*_host_at_exit[HOST_MAX_AT_EXIT])(void);
+static uint8_t _host_at_exit_count = 0;
+
+static void
+_host_init_vectors(void)
+{
+  static bool done = false;
+  if (done)
+    return;
+  _host_irqs[HOST_IRQ_INT0].vector = INT0_vect;
+  _host_irqs[HOST_IRQ_INT1].vector = INT1_vect;
+  _host_irqs[HOST_IRQ_PCINT2].vector = PCINT2_vect;
+  _host_irqs[HOST_IRQ_WDT].vector = WDT_vect;
+  _host_irqs[HOST_IRQ_TIMER1_COMPA].vector = TIMER1_COMPA_vect;
+  _host_irqs[HOST_IRQ_TIMER0_COMPA].vector = TIMER0_COMPA_vect;
+  _host_irqs[HOST_IRQ_USART_RX].vector = USART_RX_vect;
+  _host_irqs[HOST_IRQ_USART_UDRE].vector = USART_UDRE_vect;
+  _host_irqs[HOST_IRQ_EE_READY].vector = EE_READY_vect;
+  _host_irqs[HOST_IRQ_TWI].vector = TWI_vect;
+  clock_gettime(CLOCK_MONOTONIC, &_host_wall_start);
+  done = true;
+}
+
+uint64_t
+host_now(void)
+{
+  return _host_now;
+}
+
+void
+host_schedule(const uint64_t delay_ns, host_event_fct fct, void *arg)
+{
+  for (uint8_t n = 0; n < HOST_MAX_EVENTS; n++) {
+    _host_event_t *e = &_host_events[n];
+    if (!e->used) {
+      e->date = _host_now + delay_ns;
+      e->seq = _host_event_seq++;
+      e->fct = fct;
+      e->arg = arg;
+      e->used = true;
+      _host_wakeup = true;
+      return;
+    }
+  }
+  dprintf(STDERR_FILENO, "host: too many events\n");
+  host_exit(1);
+}
+
+/*
+ * Cancel every event scheduled with "fct" and "arg".
+ */
+void
+host_cancel(host_event_fct fct, void *arg)
+{
+  for (uint8_t n = 0; n < HOST_MAX_EVENTS; n++) {
+    _host_event_t *e = &_host_events[n];
+    if (e->used && (e->fct == fct) && (e->arg == arg))
+      e->used = false;
+  }
+}
+
+void
+host_irq_raise(const host_irq_t irq)
+{
+  _host_irqs[irq].flag = true;
+  _host_wakeup = true;
+}
+
+void
+host_irq_clear(const host_irq_t irq)
+{
+  _host_irqs[irq].flag = false;
+}
+
+void
+host_irq_enable(const host_irq_t irq, const bool enable)
+{
+  _host_irqs[irq].enabled = enable;
+}
+
+void
+host_irq_level(const host_irq_t irq, const bool flag)
+{
+  _host_irqs[irq].level = true;
+  _host_irqs[irq].flag = flag;
+  if (flag)
+    _host_wakeup = true;
+}
+
+/*
+ * Run pending interrupts, highest priority first, if interrupts are
+ * enabled.  Returns true if at least one vector was run.
+ */
+static bool
+_host_dispatch(void)
+{
+  bool run = false;
+
+  _host_init_vectors();
+  while (bit_is_set(host_sreg, SREG_I)) {
+    uint8_t irq = 0;
+    while ((irq < HOST_IRQ_COUNT) && !(_host_irqs[irq].enabled && _host_irqs[irq].flag))
+      irq++;
+    if (irq == HOST_IRQ_COUNT)
+      break;
+    _host_irq_t *i = &_host_irqs[irq];
+    if (!i->level)
+      i->flag = false;
+    if (i->vector == NULL) {
+      i->enabled = false;	/* no handler in the firmware */
+      continue;
+    }
+    host_sreg &= ~_BV(SREG_I);
+    i->vector();
+    host_sreg |= _BV(SREG_I);	/* reti */
+    run = true;
+  }
+  return run;
+}
+
+static uint64_t
+_host_wall_elapsed(void)
+{
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (uint64_t)(now.tv_sec - _host_wall_start.tv_sec) * HOST_S + now.tv_nsec - _host_wall_start.tv_nsec;
+}
+
+/*
+ * Move virtual time to the next event and run it, waiting for the
+ * wall clock first if a speed factor is set.  Returns early, without
+ * running the event, if external inputs arrived meanwhile.
+ */
+static void
+_host_advance(void)
+{
+  _host_init_vectors();
+
+  _host_event_t *next = NULL;
+  for (uint8_t n = 0; n < HOST_MAX_EVENTS; n++) {
+    _host_event_t *e = &_host_events[n];
+    if (e->used && ((next == NULL) || (e->date < next->date) || ((e->date == next->date) && (e->seq < next->seq))))
+      next = e;
+  }
+
+  if ((_host_time_limit != 0) && ((next == NULL) || (next->date > _host_time_limit))) {
+    _host_now = _host_time_limit;
+    host_exit(0);
+  }
+
+  uint64_t wait = 0;
+  if (next == NULL) {
+    wait = UINT64_MAX;
+  } else if (_host_speed > 0) {
+    const uint64_t wall = _host_wall_elapsed();
+    const uint64_t target = (uint64_t)(next->date / _host_speed);
+    wait = (target > wall) ? (target - wall) : 0;
+  }
+
+  _host_wakeup = false;
+  if (_host_poll != NULL) {
+    _host_poll(wait);
+  } else if (wait == UINT64_MAX) {
+    dprintf(STDERR_FILENO, "host: nothing left to simulate\n");
+    host_exit(1);
+  } else if (wait != 0) {
+    const struct timespec ts = { wait / HOST_S, wait % HOST_S };
+    nanosleep(&ts, NULL);
+  }
+  if (_host_wakeup || (next == NULL))
+    return;
+  if ((_host_speed > 0) && (_host_wall_elapsed() < (uint64_t)(next->date / _host_speed)))
+    return;
+
+  _host_now = next->date;
+  next->used = false;
+  next->fct(next->arg);
+}
+
+/*
+ * CPU sleep: run pending interrupts, or let time pass until an
+ * interrupt wakes the CPU up.
+ */
+void
+host_sleep(void)
+{
+  if (bit_is_clear(host_sreg, SREG_I)) {
+    dprintf(STDERR_FILENO, "host: sleeping with interrupts disabled\n");
+    host_exit(1);
+  }
+  while (!_host_dispatch())
+    _host_advance();
+}
+
+void
+host_step(void)
+{
+  if (!_host_dispatch())
+    _host_advance();
+}
+
+void
+hal_busy_wait(void)
+{
+  host_step();
+}
+
+void
+host_set_speed(const double speed)
+{
+  _host_speed = speed;
+}
+
+void
+host_set_time_limit(const uint64_t ns)
+{
+  _host_time_limit = ns;
+}
+
+void
+host_set_poll(void (*fct)(const uint64_t wait_ns))
+{
+  _host_poll = fct;
+}
+
+void
+host_at_exit(void (*fct)(void))
+{
+  if (_host_at_exit_count < HOST_MAX_AT_EXIT)
+    _host_at_exit[_host_at_exit_count++] = fct;
+}
+
+void
+host_exit(const int status)
+{
+  while (_host_at_exit_count != 0)
+    _host_at_exit[--_host_at_exit_count]();
+  exit(status);
+}
+
+/*
+ * Traces are written to the stderr file descriptor, unbuffered.
+ */
+void
+host_trace(const char *fmt, ...)
+{
+  char line[256];
+  va_list ap;
+
+  if (!host_verbose)
+    return;
+  const int n = snprintf(line, sizeof(line), "[%11.6f] ", (double)_host_now / HOST_S);
+  va_start(ap, fmt);
+  vsnprintf(line + n, sizeof(line) - n, fmt, ap);
+  va_end(ap);
+  dprintf(STDERR_FILENO, "%s\n", line);
+}
@@ -1,28 +1,27 @@
 #include "leds.h"
 
-#include <avr/io.h>
-#include <avr/interrupt.h>
-
-#include "bitfield.h"
+#include "hal.h"
 
 #include "scheduler.h"
 
 #include <stdio.h>
 
 // Common LEDs (Low = active, High = inactive)
-#define LEDS_COM	GET_BIT(PORTC).bit0 	// Arduino Analog Input 0
+#define LEDS_COM	HAL_PIN_LEDS_COM 	// Arduino Analog Input 0
 // Green LED
-#define LED0		GET_BIT(PORTC).bit1 	// Arduino Analog Input 1
+#define LED0		HAL_PIN_LED0 	// Arduino Analog Input 1
 // Orange LED
-#define LED1		GET_BIT(PORTC).bit2 	// Arduino Analog Input 2
+#define LED1		HAL_PIN_LED1 	// Arduino Analog Input 2
 // Red LED
-#define LED2		GET_BIT(PORTC).bit3 	// Arduino Analog Input 3
+#define LED2		HAL_PIN_LED2 	// Arduino Analog Input 3
 
 #define LED_ENABLED	0
 #define LED_DISABLED	1
 
 #define BLINK_MASK	0x80
 
+#define LEDS_BLINK_HALF_PERIOD_MS	250
+
 enum { UP, DOWN };
 
 static leds_mode_t _leds_mode = LED_ALL_OFF;
@@ -33,9 +32,12 @@ void
 leds_init(void)
 {
   /* Enable LEDs port as output. */
-  DDRC |= (_BV(PC0) | _BV(PC1) | _BV(PC2) | _BV(PC3));
+  hal_pin_output(LEDS_COM);
+  hal_pin_output(LED0);
+  hal_pin_output(LED1);
+  hal_pin_output(LED2);
 
-  scheduler_add_hook_fct(leds_process);
+  scheduler_add_hook_fct(leds_process, LEDS_BLINK_HALF_PERIOD_MS, SCHEDULER_CONTEXT_ISR);
 }
 
 void
@@ -44,55 +46,55 @@ leds_set(const leds_mode_t mode)
   switch (mode) {
     case LED_ALL_OFF:
 // 				leds_pwm_stop();
-      LEDS_COM = 1;
-      LED0 = LED_DISABLED;
-      LED1 = LED_DISABLED;
-      LED2 = LED_DISABLED;
+      hal_pin_write(LEDS_COM, 1);
+      hal_pin_write(LED0, LED_DISABLED);
+      hal_pin_write(LED1, LED_DISABLED);
+      hal_pin_write(LED2, LED_DISABLED);
       break;
     case LED_ALL_BLINK:
 // 				leds_pwm_start();
-      LED0 = LED_ENABLED;
-      LED1 = LED_ENABLED;
-      LED2 = LED_ENABLED;
+      hal_pin_write(LED0, LED_ENABLED);
+      hal_pin_write(LED1, LED_ENABLED);
+      hal_pin_write(LED2, LED_ENABLED);
       break;
     case LED_GREEN_ON:
 // 				leds_pwm_stop();
-      LEDS_COM = 1;
-      LED0 = LED_ENABLED;
-      LED1 = LED_DISABLED;
-      LED2 = LED_DISABLED;
+      hal_pin_write(LEDS_COM, 1);
+      hal_pin_write(LED0, LED_ENABLED);
+      hal_pin_write(LED1, LED_DISABLED);
+      hal_pin_write(LED2, LED_DISABLED);
       break;
     case LED_GREEN_BLINK:
 // 				leds_pwm_start();
-      LED0 = LED_ENABLED;
-      LED1 = LED_DISABLED;
-      LED2 = LED_DISABLED;
+      hal_pin_write(LED0, LED_ENABLED);
+      hal_pin_write(LED1, LED_DISABLED);
+      hal_pin_write(LED2, LED_DISABLED);
       break;
     case LED_ORANGE_ON:
 // 				leds_pwm_stop();
-      LEDS_COM = 1;
-      LED0 = LED_DISABLED;
-      LED1 = LED_ENABLED;
-      LED2 = LED_DISABLED;
+      hal_pin_write(LEDS_COM, 1);
+      hal_pin_write(LED0, LED_DISABLED);
+      hal_pin_write(LED1, LED_ENABLED);
+      hal_pin_write(LED2, LED_DISABLED);
       break;
     case LED_ORANGE_BLINK:
 // 				leds_pwm_start();
-      LED0 = LED_DISABLED;
-      LED1 = LED_ENABLED;
-      LED2 = LED_DISABLED;
+      hal_pin_write(LED0, LED_DISABLED);
+      hal_pin_write(LED1, LED_ENABLED);
+      hal_pin_write(LED2, LED_DISABLED);
       break;
     case LED_RED_ON:
 // 				leds_pwm_stop();
-      LEDS_COM = 1;
-      LED0 = LED_DISABLED;
-      LED1 = LED_DISABLED;
-      LED2 = LED_ENABLED;
+      hal_pin_write(LEDS_COM, 1);
+      hal_pin_write(LED0, LED_DISABLED);
+      hal_pin_write(LED1, LED_DISABLED);
+      hal_pin_write(LED2, LED_ENABLED);
       break;
     case LED_RED_BLINK:
 // 				leds_pwm_start();
-      LED0 = LED_DISABLED;
-      LED1 = LED_DISABLED;
-      LED2 = LED_ENABLED;
+      hal_pin_write(LED0, LED_DISABLED);
+      hal_pin_write(LED1, LED_DISABLED);
+      hal_pin_write(LED2, LED_ENABLED);
       break;
   };
   _leds_mode = mode;
@@ -101,12 +103,7 @@ leds_set(const leds_mode_t mode)
 void
 leds_process(void)
 {
-  if (_leds_mode & BLINK_MASK) {
-    if (LEDS_COM) {
-      LEDS_COM = 0;
-    } else {
-      LEDS_COM = 1;
-    }
-  }
+  if (_leds_mode & BLINK_MASK)
+    hal_pin_toggle(LEDS_COM);
 }
 
@@ -0,0 +1,78 @@
+#include "mem.h"
+
+#include "hal.h"
+
+#include "scheduler.h"
+
+#define MEM_PERIOD_MS	1
+
+HAL_RAM_PAINTER
+
+// Stack must stay above this address
+static uint8_t *_mem_limit;
+
+static volatile bool _mem_low = false;
+
+static void mem_process(void);
+
+void
+mem_init(void)
+{
+  hal_ram_t ram;
+
+  hal_ram_layout(&ram);
+  _mem_limit = ram.brk + MEM_MARGIN_MIN;
+
+  scheduler_add_hook_fct(mem_process, MEM_PERIOD_MS, SCHEDULER_CONTEXT_ISR);
+}
+
+/*
+ * Canary check, from the tick interrupt.  The canary catches stack
+ * excursions between two ticks, the stack pointer catches large
+ * buffers which are not entirely written.
+ */
+static void
+mem_process(void)
+{
+  const uint8_t *canary = _mem_limit - MEM_CANARY_SIZE;
+
+  if (hal_stack_pointer() < _mem_limit) {
+    _mem_low = true;
+    return;
+  }
+  for (uint8_t n = 0; n < MEM_CANARY_SIZE; n++) {
+    if (canary[n] != HAL_RAM_PAINT)
+      _mem_low = true;
+  }
+}
+
+/*
+ * The stack came within MEM_MARGIN_MIN bytes of the heap since reset.
+ */
+bool
+mem_low(void)
+{
+  return _mem_low;
+}
+
+void
+mem_usage(mem_usage_t *usage)
+{
+  hal_ram_t ram;
+
+  hal_ram_layout(&ram);
+  const uint8_t *sp = hal_stack_pointer();
+
+  // Painted bytes from the heap end up were never used by the stack
+  const uint8_t *p = ram.brk;
+  while ((p <= sp) && (*p == HAL_RAM_PAINT))
+    p++;
+
+  usage->data = ram.data;
+  usage->bss = ram.bss;
+  usage->heap = ram.brk - ram.heap;
+  usage->stack = ram.end - 1 - sp;
+  usage->stack_max = ram.end - p;
+  usage->free = sp + 1 - ram.brk;
+  usage->margin = p - ram.brk;
+}
@@ -0,0 +1,35 @@
+#ifndef __MEM_H__
+#define __MEM_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/*
+ * RAM usage.  RAM above .bss is painted at reset (see hal.h), the
+ * bytes the stack never reached still hold the paint: the high-water
+ * mark is where it stops.
+ *
+ * At each tick, the stack pointer and a canary (the last
+ * MEM_CANARY_SIZE painted bytes of the MEM_MARGIN_MIN bytes above the
+ * heap) are checked: once the stack came that close to the heap,
+ * mem_low() is set until reset.
+ */
+
+#define MEM_MARGIN_MIN		64	// bytes
+#define MEM_CANARY_SIZE		4
+
+typedef struct {
+  uint16_t data;	// .data, bytes
+  uint16_t bss;		// .bss
+  uint16_t heap;
+  uint16_t stack;	// now
+  uint16_t stack_max;	// high-water mark
+  uint16_t free;	// between heap and stack, now
+  uint16_t margin;	// between heap and stack, never used
+} mem_usage_t;
+
+void mem_init(void);
+bool mem_low(void);
+void mem_usage(mem_usage_t *usage);
+
+#endif	/* __MEM_H__ */
@@ -0,0 +1,137 @@
+#include "power.h"
+
+#include "hal.h"
+
+#include "scheduler.h"
+#include "twi.h"
+#include "uart.h"
+
+// No power-down before this date (ms, see scheduler_millis())
+static uint32_t _power_awake_until = 0;
+
+static volatile power_wakeup_t _power_wakeup = POWER_WAKEUP_NONE;
+
+// Time asleep: idle time is measured to the tick phase
+static uint32_t _power_idle_ms = 0;
+static int16_t _power_idle_phases = 0;	// from 0 to HAL_TICK_PHASES - 1
+static volatile uint32_t _power_down_ms = 0;
+static volatile uint16_t _power_timer_wakeups = 0;
+static volatile uint16_t _power_pin_wakeups = 0;
+
+/*
+ * Watchdog and pin change interrupts are only enabled in power-down.
+ * The tick being stopped, the watchdog period is added to the time.
+ */
+ISR(WDT_vect)
+{
+  scheduler_advance(HAL_WDT_MS);
+  _power_down_ms += HAL_WDT_MS;
+  if (_power_wakeup == POWER_WAKEUP_NONE) {
+    _power_wakeup = POWER_WAKEUP_TIMER;
+    _power_timer_wakeups++;
+  }
+}
+
+ISR(PCINT2_vect)
+{
+  if (_power_wakeup == POWER_WAKEUP_NONE) {
+    _power_wakeup = POWER_WAKEUP_PIN;
+    _power_pin_wakeups++;
+  }
+}
+
+/*
+ * Stop the clock of the peripherals which are never used.
+ */
+void
+power_init(void)
+{
+  hal_power_reduce();
+}
+
+/*
+ * Do not enter power-down for the next "ms" ms, at least.
+ */
+void
+power_stay_awake(const uint16_t ms)
+{
+  const uint32_t until = scheduler_millis() + ms;
+
+  if ((int32_t)(until - _power_awake_until) > 0)
+    _power_awake_until = until;
+}
+
+/*
+ * Time (ms, and the phase in the current ms), interrupts disabled.  A
+ * pending tick is counted, the phase is then read again after the
+ * timer wrapped.
+ */
+static uint32_t
+_power_clock(uint8_t *phase)
+{
+  uint32_t ms = scheduler_millis();
+
+  *phase = hal_tick_phase();
+  if (hal_tick_missed()) {
+    ms++;
+    *phase = hal_tick_phase();
+  }
+  return ms;
+}
+
+/*
+ * Sleep until the next interrupt.  Called from the main loop with
+ * interrupts disabled, returns with interrupts enabled.
+ *
+ * Power-down is entered if "deepest" allows it, once power_stay_awake()
+ * delays are over and no UART or TWI transfer is in progress: the
+ * caller then gets the wake-up source, and must catch up with what
+ * was missed (external interrupts, sensors).
+ */
+power_wakeup_t
+power_sleep(const power_state_t deepest)
+{
+  if ((deepest == POWER_DOWN) && ((int32_t)(scheduler_millis() - _power_awake_until) >= 0)
+      && uart_tx_idle() && twi_idle()) {
+    _power_wakeup = POWER_WAKEUP_NONE;
+    hal_wdt_wakeup(true);
+    hal_pcint_wakeup(true);
+    hal_sleep(HAL_SLEEP_POWER_DOWN);
+    cli();
+    hal_wdt_wakeup(false);
+    hal_pcint_wakeup(false);
+    sei();
+    return _power_wakeup;
+  }
+
+  uint8_t before_phase;
+  uint8_t after_phase;
+  const uint32_t before = _power_clock(&before_phase);
+  hal_sleep(HAL_SLEEP_IDLE);
+  cli();
+  const uint32_t after = _power_clock(&after_phase);
+  sei();
+
+  _power_idle_ms += after - before;
+  _power_idle_phases += (int16_t)after_phase - before_phase;
+  if (_power_idle_phases < 0) {
+    _power_idle_phases += HAL_TICK_PHASES;
+    _power_idle_ms--;
+  } else if (_power_idle_phases >= HAL_TICK_PHASES) {
+    _power_idle_phases -= HAL_TICK_PHASES;
+    _power_idle_ms++;
+  }
+  return POWER_WAKEUP_NONE;
+}
+
+void
+power_stats(power_stats_t *stats)
+{
+  const uint8_t sreg = SREG;
+  cli();
+  stats->idle_ms = _power_idle_ms;
+  stats->down_ms = _power_down_ms;
+  stats->timer_wakeups = _power_timer_wakeups;
+  stats->pin_wakeups = _power_pin_wakeups;
+  SREG = sreg;
+}
@@ -0,0 +1,42 @@
+#ifndef __POWER_H__
+#define __POWER_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/*
+ * Sleep between interrupts, in the deepest mode allowed by the caller
+ * and by the peripherals still at work, with the time spent in each
+ * state accounted.
+ *
+ * In power-down, the tick is stopped: the CPU wakes up every
+ * HAL_WDT_MS on the watchdog, which keeps scheduler_millis() going,
+ * or on a change of the button or UART RXD pins.  The character
+ * waking the CPU up is lost.
+ */
+
+typedef enum {
+  POWER_ACTIVE,
+  POWER_IDLE,		// CPU stopped, tick running
+  POWER_DOWN		// everything stopped but the watchdog
+} power_state_t;
+
+typedef enum {
+  POWER_WAKEUP_NONE,	// not from power-down
+  POWER_WAKEUP_TIMER,	// watchdog
+  POWER_WAKEUP_PIN	// button or console
+} power_wakeup_t;
+
+typedef struct {
+  uint32_t idle_ms;
+  uint32_t down_ms;	// in whole watchdog periods
+  uint16_t timer_wakeups;
+  uint16_t pin_wakeups;
+} power_stats_t;
+
+void power_init(void);
+void power_stay_awake(const uint16_t ms);
+power_wakeup_t power_sleep(const power_state_t deepest);
+void power_stats(power_stats_t *stats);
+
+#endif	/* __POWER_H__ */
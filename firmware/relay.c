@@ -5,34 +5,61 @@
 
 #define PCF_ADDRESS 0x40
 
+#define RELAY_PERIOD_MS	100
+
 #include <stdio.h>
 #include <avr/pgmspace.h>
 
+#include "hal.h"
+
+volatile twi_connection_state relay_connection_state;
+
 static volatile uint8_t _relay_mode;
 
+static uint8_t _relay_pcf_output;
+static uint8_t _relay_pcf_input;
+static void _relay_transaction_done(twi_transaction_t *transaction);
+// Write outputs, then read inputs
+static twi_transaction_t _relay_transaction = {
+  .addr = PCF_ADDRESS,
+  .write_len = 1,
+  .write_buf = &_relay_pcf_output,
+  .read_len = 1,
+  .read_buf = &_relay_pcf_input,
+  .callback = _relay_transaction_done,
+  .status = TWI_OK
+};
+
 void relay_process(void);
 
 void
 relay_init(void)
 {
   relay_connection_state = CONNECTION_OK;
-  scheduler_add_hook_fct(relay_process);
+  scheduler_add_hook_fct(relay_process, RELAY_PERIOD_MS, SCHEDULER_CONTEXT_MAIN);
 }
 
 void
 relay_set_mode(const uint8_t relay_mode)
 {
-  // We keep 4 inputs bits (lsb) as it: these pins are inputs (feedback)
+  // We keep 4 inputs bits (lsb) as it: these pins are inputs (feedback),
+  // updated from TWI interrupt context
+  const uint8_t sreg = SREG;
+  cli();
   _relay_mode = (relay_mode & 0xf0) | (_relay_mode & 0x0f);
+  SREG = sreg;
 }
 
 void
 relay_set(const uint8_t relay, const bool on)
 {
+  const uint8_t sreg = SREG;
+  cli();
   if (on)
     _relay_mode |= _BV(relay);
   else
     _relay_mode &= ~(_BV(relay));
+  SREG = sreg;
 }
 
 uint8_t
@@ -41,22 +68,27 @@ relay_mode()
   return _relay_mode;
 }
 
+static void
+_relay_transaction_done(twi_transaction_t *transaction)
+{
+  if (transaction->status != TWI_OK) {
+    relay_connection_state = CONNECTION_BROKEN;
+  } else {
+    relay_connection_state = CONNECTION_OK;
+    _relay_mode = (_relay_mode & 0xf0) | (_relay_pcf_input & 0x0f);
+  }
+}
+
 void
 relay_process(void)
 {
+  // Previous exchange is still on the bus
+  if (_relay_transaction.status == TWI_PENDING)
+    return;
+
   // Inputs must be HIGH to be read
-  uint8_t pcf_data = (~_relay_mode) | 0x0f;
-  // Write outputs
-  if (-1 == twi_write_bytes(PCF_ADDRESS, 1, &pcf_data)) {
+  _relay_pcf_output = (~_relay_mode) | 0x0f;
+  if (TWI_OK != twi_submit(&_relay_transaction)) {
     relay_connection_state = CONNECTION_BROKEN;
-  } else {
-    relay_connection_state = CONNECTION_OK;
-    // Read inputs
-    if (-1 == twi_read_bytes(PCF_ADDRESS, 1, &pcf_data)) {
-      relay_connection_state = CONNECTION_BROKEN;
-    } else {
-      relay_connection_state = CONNECTION_OK;
-      _relay_mode = (_relay_mode & 0xf0) | (pcf_data & 0x0f);
-    }
   }
 }
@@ -21,7 +21,7 @@
 #define RELAY_FB_PUMP		2
 #define RELAY_FB_HEATER		3
 
-volatile twi_connection_state relay_connection_state;
+extern volatile twi_connection_state relay_connection_state;
 
 void relay_init(void);
 void relay_set(const uint8_t relay, const bool on);
@@ -1,49 +1,146 @@
 #include "scheduler.h"
 
-#include <avr/io.h>
-#include <avr/interrupt.h>
-
-#include "scheduler.h"
-
-#define SCHEDULER_MAX_HOOK_FCT		10
-#define SCHEDULER_TCNT (0xFFFF - 62500) // Interrupt occurs (16 000 000 / 256) / 62500 = 1 hz
-
-void scheduler_process_hooks(void);
+#include "hal.h"
 
 typedef void (*_scheduler_hook_fct)(void);
 
+typedef struct {
+  _scheduler_hook_fct fct;
+  uint16_t period;		// ms
+  uint16_t countdown;		// ms before next run
+  scheduler_context_t context;
+  uint8_t due;			// main context hook waiting for dispatch
+  uint16_t misses;		// periods elapsed without the hook being run
+} _scheduler_hook_t;
+
 static volatile uint8_t	_scheduler_hook_fct_count = 0;
-static volatile _scheduler_hook_fct _scheduler_hook_fcts[SCHEDULER_MAX_HOOK_FCT];
+static volatile _scheduler_hook_t _scheduler_hooks[SCHEDULER_MAX_HOOK_FCT];
+
+static volatile uint32_t _scheduler_millis = 0;
 
-ISR(TIMER1_OVF_vect)
+/*
+ * Tick interrupt, every ms: ISR context hooks are run at once, main
+ * context hooks are only marked as due.  A hook is late (deadline
+ * miss) when it becomes due again before being dispatched, or, for ISR
+ * context hooks, when it is still running at the next tick.
+ */
+ISR(TIMER1_COMPA_vect)
 {
-  TCNT1 = SCHEDULER_TCNT;
-  scheduler_process_hooks();
+  _scheduler_millis++;
+
+  for (uint8_t i = 0; i < _scheduler_hook_fct_count; i++) {
+    volatile _scheduler_hook_t *hook = &_scheduler_hooks[i];
+    if (--hook->countdown != 0)
+      continue;
+    hook->countdown = hook->period;
+    if (hook->context == SCHEDULER_CONTEXT_ISR) {
+      hook->fct();
+      if (hal_tick_missed())
+        hook->misses++;
+    } else {
+      if (hook->due)
+        hook->misses++;
+      hook->due = 1;
+    }
+  }
 }
 
 void
 scheduler_init(void)
 {
-  TCCR1B = _BV(CS12);    // Timer1 clock use prescaled clock at clk/256 (i.e. 16 000 000 / 256 = 62500 hz)
+  hal_tick_init();	/* 1 kHz tick interrupt */
+}
+
+/*
+ * Register "fct" to be run every "period_ms" ms (from 1 to 65535) in
+ * "context".  Main context hooks are dispatched by registration order:
+ * hooks registered first have the highest priority.
+ *
+ * Returns the hook number, or -1 if there is no room left.
+ */
+int8_t
+scheduler_add_hook_fct(void (*fct)(void), const uint16_t period_ms, const scheduler_context_t context)
+{
+  if (_scheduler_hook_fct_count == SCHEDULER_MAX_HOOK_FCT)
+    return -1;
 
-  TCNT1 = SCHEDULER_TCNT;
+  const uint8_t sreg = SREG;
+  cli();
+  volatile _scheduler_hook_t *hook = &_scheduler_hooks[_scheduler_hook_fct_count];
+  hook->fct = fct;
+  hook->period = period_ms;
+  hook->countdown = period_ms;
+  hook->context = context;
+  hook->due = 0;
+  hook->misses = 0;
+  const int8_t n = _scheduler_hook_fct_count++;
+  SREG = sreg;
 
-  TIMSK1 |= _BV(TOIE1);	/* Enable interrupt */
+  return n;
 }
 
+/*
+ * Run main context hooks which are due, highest priority first.  Must
+ * be called from the main loop, with interrupts enabled.
+ */
 void
-scheduler_add_hook_fct(void (*fct)(void))
+scheduler_process(void)
 {
-  _scheduler_hook_fcts[_scheduler_hook_fct_count++] = fct;
+  uint8_t i = 0;
+  while (i < _scheduler_hook_fct_count) {
+    volatile _scheduler_hook_t *hook = &_scheduler_hooks[i];
+    if (hook->due) {
+      cli();
+      hook->due = 0;
+      sei();
+      hook->fct();
+      // Look again for higher priority hooks
+      i = 0;
+    } else {
+      i++;
+    }
+  }
 }
 
+/*
+ * Time since scheduler start, in ms.
+ */
+uint32_t
+scheduler_millis(void)
+{
+  const uint8_t sreg = SREG;
+  cli();
+  const uint32_t ms = _scheduler_millis;
+  SREG = sreg;
+  return ms;
+}
 
+/*
+ * Account "ms" elapsed while the tick was stopped (power-down sleep).
+ * Hooks are not run for them.
+ */
 void
-scheduler_process_hooks(void)
+scheduler_advance(const uint16_t ms)
 {
-  for (uint8_t i = 0; i < _scheduler_hook_fct_count; i++) {
-    _scheduler_hook_fcts[i]();
-  }
+  const uint8_t sreg = SREG;
+  cli();
+  _scheduler_millis += ms;
+  SREG = sreg;
 }
 
+uint8_t
+scheduler_hook_count(void)
+{
+  return _scheduler_hook_fct_count;
+}
 
+void
+scheduler_hook_info(const uint8_t hook, uint16_t *period_ms, scheduler_context_t *context, uint16_t *misses)
+{
+  const uint8_t sreg = SREG;
+  cli();
+  *period_ms = _scheduler_hooks[hook].period;
+  *context = _scheduler_hooks[hook].context;
+  *misses = _scheduler_hooks[hook].misses;
+  SREG = sreg;
+}
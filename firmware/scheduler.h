@@ -3,6 +3,20 @@
 
 #include <stdint.h>
 
+// Where a hook function is executed
+typedef enum {
+  SCHEDULER_CONTEXT_ISR,	// directly from the tick interrupt, must be short
+  SCHEDULER_CONTEXT_MAIN	// from scheduler_process(), called by the main loop
+} scheduler_context_t;
+
+#define SCHEDULER_MAX_HOOK_FCT		10
+
 void		scheduler_init(void);
-void		scheduler_add_hook_fct(void (*fct)(void));
+int8_t		scheduler_add_hook_fct(void (*fct)(void), const uint16_t period_ms, const scheduler_context_t context);
+void		scheduler_process(void);
+uint32_t	scheduler_millis(void);
+void		scheduler_advance(const uint16_t ms);
+uint8_t		scheduler_hook_count(void);
+void		scheduler_hook_info(const uint8_t hook, uint16_t *period_ms, scheduler_context_t *context, uint16_t *misses);
+
 #endif
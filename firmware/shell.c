@@ -1,65 +1,270 @@
 #include "shell.h"
 
-#include <stdlib.h>
-#include <stdio.h>
 #include <string.h>
-#include <ctype.h>
-#include <inttypes.h>
 
-#include "config.h"
+#include "fmt.h"
+#include "shell_commands.h"
+#include "uart.h"
 
 #define SHELL_MAX_COMMAND_LINE_LENGTH   160
-#ifndef SHELL_COMMAND_COUNT
-#error Please set SHELL_COMMAND_COUNT and check your shell_commands[] array
-#endif
 
-extern shell_command_t shell_commands[];
+// Line being edited
+static char _shell_line[SHELL_MAX_COMMAND_LINE_LENGTH + 1];
+static uint8_t _shell_length = 0;
+static bool _shell_after_cr = false;
 
+// Handlers
+#define SHELL_COMMAND_FUNCTION(TEXT, DESCRIPTION, DEBUG, FUNCTION) \
+  void FUNCTION(const uint8_t argc, char *argv[]);
+SHELL_COMMANDS(SHELL_COMMAND_FUNCTION)
+
+// Names and descriptions
+#define SHELL_COMMAND_STRINGS(TEXT, DESCRIPTION, DEBUG, FUNCTION) \
+  static const char FUNCTION##_text[] PROGMEM = TEXT; \
+  static const char FUNCTION##_description[] PROGMEM = DESCRIPTION;
+SHELL_COMMANDS(SHELL_COMMAND_STRINGS)
+
+#define SHELL_COMMAND_ENTRY(TEXT, DESCRIPTION, DEBUG, FUNCTION) \
+  { FUNCTION##_text, FUNCTION##_description, FUNCTION, DEBUG },
+
+static const shell_command_t _shell_commands[] PROGMEM = {
+  SHELL_COMMANDS(SHELL_COMMAND_ENTRY)
+};
+
+#define SHELL_COMMAND_COUNT	(sizeof(_shell_commands) / sizeof(_shell_commands[0]))
+
+uint8_t
+shell_command_count(void)
+{
+  return SHELL_COMMAND_COUNT;
+}
+
+// Copy of the n-th command, by name order
 void
-shell_loop(void)
+shell_command(const uint8_t n, shell_command_t *command)
 {
-  char buffer[SHELL_MAX_COMMAND_LINE_LENGTH + 1];
-  char command[SHELL_MAX_COMMAND_LINE_LENGTH + 1];
+  memcpy_P(command, &_shell_commands[n], sizeof(*command));
+}
 
-  printf_P(PSTR("$ "));
-  if (fgets(buffer, sizeof(buffer) - 1, stdin) == NULL) {
-    if (ferror(stdin) != 0) {
-      printf_P(PSTR("\n!!! UART data overrun !!!\nresetting shell...\n"));
-      clearerr(stdin);
-    }
-    if (feof(stdin) != 0) {
-      clearerr(stdin);
-    }
+// Binary search by name, -1 if "text" is not a command
+static int8_t
+shell_find(const char *text)
+{
+  uint8_t low = 0;
+  uint8_t high = SHELL_COMMAND_COUNT;
+
+  while (low < high) {
+    const uint8_t middle = (low + high) / 2;
+    const int c = strcmp_P(text, (PGM_P)pgm_read_ptr(&_shell_commands[middle].text));
+    if (c == 0)
+      return middle;
+    if (c < 0)
+      high = middle;
+    else
+      low = middle + 1;
+  }
+  return -1;
+}
+
+/*
+ * Split "line" in place, words are separated by spaces: returns the
+ * number of words, or SHELL_MAX_ARGS + 1 if there are too many.
+ */
+static uint8_t
+shell_split(char *line, char *argv[])
+{
+  uint8_t argc = 0;
+
+  for (;;) {
+    while ((*line == ' ') || (*line == '\t') || (*line == '\r') || (*line == '\n'))
+      *line++ = '\0';
+    if (*line == '\0')
+      return argc;
+    if (argc == SHELL_MAX_ARGS)
+      return SHELL_MAX_ARGS + 1;
+    argv[argc++] = line;
+    while ((*line != '\0') && (*line != ' ') && (*line != '\t') && (*line != '\r') && (*line != '\n'))
+      line++;
+  }
+}
+
+bool
+shell_arg_is_P(const char *arg, PGM_P text)
+{
+  return 0 == strcmp_P(arg, text);
+}
+
+static bool
+shell_arg_range(const char *arg, const int32_t min, const int32_t max, int32_t *value)
+{
+  const char *end = fmt_int(arg, value);
+  return (end != NULL) && (*end == '\0') && (*value >= min) && (*value <= max);
+}
+
+bool
+shell_arg_uint8(const char *arg, uint8_t *value)
+{
+  int32_t v;
+  if (!shell_arg_range(arg, 0, UINT8_MAX, &v))
+    return false;
+  *value = v;
+  return true;
+}
+
+bool
+shell_arg_uint16(const char *arg, uint16_t *value)
+{
+  int32_t v;
+  if (!shell_arg_range(arg, 0, UINT16_MAX, &v))
+    return false;
+  *value = v;
+  return true;
+}
+
+bool
+shell_arg_int16(const char *arg, int16_t *value)
+{
+  int32_t v;
+  if (!shell_arg_range(arg, INT16_MIN, INT16_MAX, &v))
+    return false;
+  *value = v;
+  return true;
+}
+
+bool
+shell_arg_int32(const char *arg, int32_t *value)
+{
+  return shell_arg_range(arg, INT32_MIN, INT32_MAX, value);
+}
+
+// Run a complete command line
+static void
+shell_execute(char *line)
+{
+  char *argv[SHELL_MAX_ARGS];
+  const uint8_t argc = shell_split(line, argv);
+
+  if (argc == 0)
+    return;
+  if (argc > SHELL_MAX_ARGS) {
+    fmt_P(PSTR("%s: too many arguments\n"), argv[0]);
     return;
   }
-  buffer[SHELL_MAX_COMMAND_LINE_LENGTH] = '\0';
-
-  if (sscanf_P(buffer, PSTR("%s "), command) > 0) {
-    // Look for an exact match
-    for (size_t n = 0; n < SHELL_COMMAND_COUNT; n++) {
-      if (0 == strcmp_P(command, shell_commands[n].text)) {
-        (shell_commands[n].function)(buffer);
-        return;
-      }
+  const int8_t n = shell_find(argv[0]);
+  if (n < 0) {
+    fmt_P(PSTR("%s: unknown command\n"), argv[0]);
+    return;
+  }
+  shell_command_t entry;
+  shell_command(n, &entry);
+  entry.function(argc, argv);
+}
+
+static void
+shell_prompt(void)
+{
+  fmt_str_P(PSTR("$ "));
+}
+
+// Erase the last character of the line, on the terminal too
+static void
+shell_rubout(void)
+{
+  _shell_length--;
+  fmt_str_P(PSTR("\b \b"));
+}
+
+void
+shell_init(void)
+{
+  _shell_length = 0;
+  shell_prompt();
+}
+
+/*
+ * Line editor, one received character at a time.  Printable characters
+ * are echoed, CR or NL runs the line, and:
+ *
+ * . \b (BS) or \177 (DEL) delete the previous character
+ * . ^u kills the entire line
+ * . ^w deletes the previous word
+ * . ^r reprints the prompt and the line
+ * . ^c discards the line
+ * . \t is replaced by a single space
+ *
+ * Other control characters are ignored.  When the line is full, \a
+ * (BEL) is echoed instead of further characters.  NL right after CR is
+ * ignored, so that CR NL ends a single line.
+ */
+void
+shell_input(const uint8_t c)
+{
+  const bool after_cr = _shell_after_cr;
+
+  _shell_after_cr = (c == '\r');
+  if ((c == '\r') || (c == '\n')) {
+    if ((c == '\n') && after_cr)
+      return;
+    fmt_char('\n');
+    _shell_line[_shell_length] = '\0';
+    shell_execute(_shell_line);
+    _shell_length = 0;
+    shell_prompt();
+    return;
+  }
+
+  const uint8_t printable = (c == '\t') ? ' ' : c;
+  if (((printable >= ' ') && (printable <= '\x7e')) || (printable >= 0xa0)) {
+    if (_shell_length == SHELL_MAX_COMMAND_LINE_LENGTH) {
+      fmt_char('\a');
+      return;
     }
-    printf_P(PSTR("%s: unknown command\n"), command);
-//     // Look for a single match on left characters of input command (support partial command)
-//     void (*function)(const char*);
-//     function = NULL;
-//     for(size_t n = 0; n < SHELL_COMMAND_COUNT; n++) {
-//       if(0 == strncmp(shell_commands[n].text, command, strlen(command))) {
-//         if(function != NULL) {
-//           printf("%s: multiple command match\n", command);
-//           return;
-//         } else {
-//           function = shell_commands[n].function;
-//         }
-//       }
-//     }
-//     if(function != NULL) {
-//       (function)(buffer);
-//     } else {
-//       printf("%s: unknown command\n", command);
-//     }
+    _shell_line[_shell_length++] = printable;
+    fmt_char(printable);
+    return;
+  }
+
+  switch (c) {
+    case '\b':
+    case '\x7f':
+      if (_shell_length > 0)
+        shell_rubout();
+      break;
+
+    case 'u' & 0x1f:
+      while (_shell_length > 0)
+        shell_rubout();
+      break;
+
+    case 'w' & 0x1f:
+      while ((_shell_length > 0) && (_shell_line[_shell_length - 1] != ' '))
+        shell_rubout();
+      break;
+
+    case 'r' & 0x1f:
+      fmt_char('\r');
+      shell_prompt();
+      for (uint8_t i = 0; i < _shell_length; i++)
+        fmt_char(_shell_line[i]);
+      break;
+
+    case 'c' & 0x1f:
+      fmt_str_P(PSTR("^C\n"));
+      _shell_length = 0;
+      shell_prompt();
+      break;
   }
 }
+
+/*
+ * Feed the line editor with the characters received so far, returns
+ * at once when there are none.
+ */
+void
+shell_process(void)
+{
+  uint8_t c;
+
+  while (uart_read(&c))
+    shell_input(c);
+}
@@ -3,23 +3,46 @@
 
 #include <avr/pgmspace.h>
 #include <stdbool.h>
+#include <stdint.h>
+
+// Words of a command line, the command itself included
+#define SHELL_MAX_ARGS	8
+
+/*
+ * Commands are defined in shell_commands.def, the table is generated
+ * sorted by name and lives in program memory, see shell_command().
+ *
+ * The command line is split in place: handlers get its words in
+ * argv[0] (the command) to argv[argc - 1], valid until they return.
+ */
+typedef void (*shell_function_t)(const uint8_t argc, char *argv[]);
 
 typedef struct {
-  const char *text;
-  const char *description;
-  void (*function)(const char *);
+  PGM_P text;
+  PGM_P description;
+  shell_function_t function;
   bool debug;
 } shell_command_t;
 
-#define SHELL_COMMAND_DECL(ID, TEXT, DESCRIPTION, DEBUG, FUNCTION) \
-  static const char menu##ID##_text[] PROGMEM = TEXT; \
-  static const char menu##ID##_description[] PROGMEM = DESCRIPTION; \
-  shell_commands[ID].text = menu##ID##_text; \
-  shell_commands[ID].description = menu##ID##_description; \
-  shell_commands[ID].debug = DEBUG; \
-  shell_commands[ID].function = FUNCTION;
+uint8_t shell_command_count(void);
+void    shell_command(const uint8_t n, shell_command_t *command);
 
+/*
+ * Argument helpers: decimal integers with an optional sign, false if
+ * "arg" is anything else or out of range for the type.
+ */
+bool    shell_arg_is_P(const char *arg, PGM_P text);
+bool    shell_arg_uint8(const char *arg, uint8_t *value);
+bool    shell_arg_uint16(const char *arg, uint16_t *value);
+bool    shell_arg_int16(const char *arg, int16_t *value);
+bool    shell_arg_int32(const char *arg, int32_t *value);
 
-void    shell_loop(void);
+/*
+ * Non-blocking: shell_process() handles the received characters and
+ * returns, the main loop calls it whenever it wakes up.
+ */
+void    shell_init(void);
+void    shell_input(const uint8_t c);
+void    shell_process(void);
 
 #endif // __SHELL_H__
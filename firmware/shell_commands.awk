@@ -0,0 +1,53 @@
+# Generate the shell command table (see shell.h) from its definitions
+# (see shell_commands.def).
+#
+# Commands are sorted by name, so that the shell finds them with a
+# binary search.  Names are restricted to lower case letters, digits and
+# '_', which sort the same way with awk and strcmp().
+
+function quote(s) {
+  gsub(/[\\"]/, "\\\\&", s)
+  return "\"" s "\""
+}
+
+BEGIN {
+  FS = "\t"
+  n = 0
+}
+
+/^[ \t]*(#|$)/ { next }
+
+{
+  if (NF != 4 || $1 !~ /^[a-z][a-z0-9_]*$/ || ($2 != "debug" && $2 != "-") || $3 !~ /^[A-Za-z_][A-Za-z0-9_]*$/) {
+    printf("%s:%d: expected name, \"debug\" or \"-\", handler and description\n", FILENAME, FNR) > "/dev/stderr"
+    error = 1
+    exit 1
+  }
+  # Insertion sort, there are a few dozens of commands at most
+  for (i = n; i > 0 && name[i - 1] > $1; i--) {
+    name[i] = name[i - 1]
+    line[i] = line[i - 1]
+  }
+  if (i > 0 && name[i - 1] == $1) {
+    printf("%s:%d: command \"%s\" defined twice\n", FILENAME, FNR, $1) > "/dev/stderr"
+    error = 1
+    exit 1
+  }
+  name[i] = $1
+  line[i] = sprintf("X(%s, %s, %s, %s)", quote($1), quote($4), ($2 == "debug") ? "true" : "false", $3)
+  n++
+}
+
+END {
+  if (error)
+    exit 1
+  if (n == 0 || n > 127) {
+    printf("%s: from 1 to 127 commands\n", FILENAME) > "/dev/stderr"
+    exit 1
+  }
+  printf("/* Generated from %s, do not edit */\n\n", FILENAME)
+  printf("// X(text, description, debug, function), sorted by text\n")
+  printf("#define SHELL_COMMANDS(X) \\\n")
+  for (i = 0; i < n; i++)
+    printf("  %s%s\n", line[i], (i < n - 1) ? " \\" : "")
+}
@@ -0,0 +1,565 @@
+/*
+ * Cycle accurate benchmark of the firmware under simavr.
+ *
+ * utophuile.out is run on a simulated atmega328p, fed with a script of
+ * console lines and button presses.  Every instruction is traced to
+ * account, for each tracked function and interrupt handler, the cycles
+ * spent per call, and the longest stretches with interrupts disabled.
+ *
+ * Function cycles include called functions, but neither nested
+ * interrupt handlers nor sleep.  Results are printed as a tab separated
+ * table, and may be checked against a baseline table.
+ */
+
+#include <fcntl.h>
+#include <gelf.h>
+#include <libelf.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <sim_avr.h>
+#include <sim_elf.h>
+#include <sim_irq.h>
+#include <sim_cycle_timers.h>
+#include <avr_ioport.h>
+#include <avr_uart.h>
+
+#include "board.h"
+#include "simavr_i2c.h"
+
+#define BENCH_MCU		"atmega328p"
+#define BENCH_FREQUENCY		16000000
+#define BENCH_FLASH_SIZE	0x8000
+#define BENCH_BAUD		38400
+
+#define BENCH_MAX_FUNCTIONS	64
+#define BENCH_MAX_DEPTH		32
+#define BENCH_MAX_SCRIPT	256
+
+// Tracked by default, with every interrupt handler
+static const char *const _bench_default_functions[] = {
+  "scheduler_process",
+  "utophuile_process",
+  "relay_process",
+  "ads1115_process",
+  "buttons_process",
+  "leds_process",
+  "shell_process",
+  "fmt_P",
+  "filter_process",
+  "temperature_from_adc",
+  "twi_submit",
+  "telemetry_process",
+  "eventlog_add",
+  NULL
+};
+
+// atmega328p interrupt vectors
+static const char *const _bench_vectors[26] = {
+  "RESET", "INT0", "INT1", "PCINT0", "PCINT1", "PCINT2", "WDT",
+  "TIMER2_COMPA", "TIMER2_COMPB", "TIMER2_OVF", "TIMER1_CAPT",
+  "TIMER1_COMPA", "TIMER1_COMPB", "TIMER1_OVF", "TIMER0_COMPA",
+  "TIMER0_COMPB", "TIMER0_OVF", "SPI_STC", "USART_RX", "USART_UDRE",
+  "USART_TX", "ADC", "EE_READY", "ANALOG_COMP", "TWI", "SPM_READY"
+};
+
+typedef struct {
+  char name[64];
+  int isr;
+  uint32_t address;
+  uint64_t calls;
+  uint64_t min;
+  uint64_t max;
+  uint64_t total;
+  uint64_t irqoff_max;
+} bench_function_t;
+
+typedef struct {
+  bench_function_t *function;
+  uint16_t sp;
+  uint64_t start;
+  uint64_t excluded;	// nested interrupt handlers and sleep
+} bench_frame_t;
+
+static bench_function_t _bench_functions[BENCH_MAX_FUNCTIONS];
+static unsigned _bench_function_count = 0;
+static bench_function_t *_bench_entries[BENCH_FLASH_SIZE / 2];
+
+static bench_frame_t _bench_stack[BENCH_MAX_DEPTH];
+static unsigned _bench_depth = 0;
+
+// Interrupts disabled stretches, counted once interrupts were first enabled
+static bench_function_t _bench_irqoff = { "*", 0, 0, 0, UINT64_MAX, 0, 0, 0 };
+static int _bench_irqoff_tracking = 0;
+static uint64_t _bench_irqoff_start;
+
+typedef enum {
+  BENCH_SEND,
+  BENCH_PRESS,
+  BENCH_RELEASE,
+  BENCH_QUIT
+} bench_action_t;
+
+typedef struct {
+  uint64_t cycle;
+  bench_action_t action;
+  char text[128];
+} bench_step_t;
+
+static bench_step_t _bench_script[BENCH_MAX_SCRIPT];
+static unsigned _bench_script_count = 0;
+static unsigned _bench_script_next = 0;
+static int _bench_done = 0;
+
+static avr_irq_t *_bench_uart_in;
+static avr_irq_t *_bench_button;
+static FILE *_bench_console = NULL;
+
+static void
+usage(const char *name)
+{
+  fprintf(stderr,
+          "usage: %s [-s script] [-f function]... [-o console] [-T celsius] [-d ms] [-v] [-b baseline] [-r percent] firmware.elf\n"
+          "  -s script    inputs, see sim/bench.script\n"
+          "  -f function  track this function (default: main hooks, shell, filters)\n"
+          "  -o console   save firmware console output\n"
+          "  -T celsius   oil temperature (default 20)\n"
+          "  -d ms        relay feedback delay (default 10)\n"
+          "  -v           trace board devices on stderr\n"
+          "  -b baseline  fail if a maximum exceeds this previous table by more than\n"
+          "  -r percent   this tolerance (default 10)\n",
+          name);
+  exit(2);
+}
+
+static bench_function_t *
+_bench_add(const char *name, const uint32_t address, const int isr)
+{
+  if ((_bench_function_count == BENCH_MAX_FUNCTIONS) || (address >= BENCH_FLASH_SIZE))
+    return NULL;
+  bench_function_t *f = &_bench_functions[_bench_function_count++];
+  snprintf(f->name, sizeof(f->name), "%s", name);
+  f->isr = isr;
+  f->address = address;
+  f->min = UINT64_MAX;
+  _bench_entries[address / 2] = f;
+  return f;
+}
+
+/*
+ * Look up tracked functions and interrupt handlers (__vector_N) in the
+ * ELF symbol table.
+ */
+static int
+_bench_load_symbols(const char *path, const char *const *names)
+{
+  const int fd = open(path, O_RDONLY);
+  if (fd < 0) {
+    perror(path);
+    return -1;
+  }
+  elf_version(EV_CURRENT);
+  Elf *elf = elf_begin(fd, ELF_C_READ, NULL);
+  Elf_Scn *scn = NULL;
+
+  while ((elf != NULL) && ((scn = elf_nextscn(elf, scn)) != NULL)) {
+    GElf_Shdr shdr;
+    if ((gelf_getshdr(scn, &shdr) == NULL) || (shdr.sh_type != SHT_SYMTAB))
+      continue;
+    Elf_Data *data = elf_getdata(scn, NULL);
+    for (size_t i = 0; i < shdr.sh_size / shdr.sh_entsize; i++) {
+      GElf_Sym sym;
+      gelf_getsym(data, i, &sym);
+      if (GELF_ST_TYPE(sym.st_info) != STT_FUNC)
+        continue;
+      const char *name = elf_strptr(elf, shdr.sh_link, sym.st_name);
+      unsigned vector;
+      if (sscanf(name, "__vector_%u", &vector) == 1) {
+        char isr[64];
+        snprintf(isr, sizeof(isr), "%s_vect", (vector < 26) ? _bench_vectors[vector] : name);
+        _bench_add(isr, sym.st_value, 1);
+        continue;
+      }
+      for (unsigned n = 0; names[n] != NULL; n++) {
+        if (strcmp(name, names[n]) == 0)
+          _bench_add(name, sym.st_value, 0);
+      }
+    }
+  }
+  if (elf != NULL)
+    elf_end(elf);
+  close(fd);
+  return 0;
+}
+
+/*
+ * Script lines: "<ms> send <text>", "<ms> press <duration ms>" or
+ * "<ms> quit", sorted by time.
+ */
+static int
+_bench_load_script(const char *path)
+{
+  FILE *f = fopen(path, "r");
+  char line[256];
+  unsigned lineno = 0;
+
+  if (f == NULL) {
+    perror(path);
+    return -1;
+  }
+  while (fgets(line, sizeof(line), f) != NULL) {
+    unsigned long ms, duration;
+    int offset = 0;
+    char action[16];
+
+    lineno++;
+    if ((line[0] == '#') || (sscanf(line, "%lu %15s %n", &ms, action, &offset) < 2))
+      continue;
+    if (_bench_script_count + 2 > BENCH_MAX_SCRIPT)
+      break;
+    bench_step_t *step = &_bench_script[_bench_script_count++];
+    step->cycle = (uint64_t)ms * (BENCH_FREQUENCY / 1000);
+    if (strcmp(action, "send") == 0) {
+      step->action = BENCH_SEND;
+      snprintf(step->text, sizeof(step->text), "%s", line + offset);
+    } else if ((strcmp(action, "press") == 0) && (sscanf(line + offset, "%lu", &duration) == 1)) {
+      step->action = BENCH_PRESS;
+      bench_step_t *release = &_bench_script[_bench_script_count++];
+      release->cycle = step->cycle + (uint64_t)duration * (BENCH_FREQUENCY / 1000);
+      release->action = BENCH_RELEASE;
+    } else if (strcmp(action, "quit") == 0) {
+      step->action = BENCH_QUIT;
+    } else {
+      fprintf(stderr, "%s:%u: unknown action \"%s\"\n", path, lineno, action);
+      fclose(f);
+      return -1;
+    }
+  }
+  fclose(f);
+
+  // Releases are inserted out of order
+  for (unsigned i = 1; i < _bench_script_count; i++) {
+    const bench_step_t step = _bench_script[i];
+    unsigned j = i;
+    for (; (j > 0) && (_bench_script[j - 1].cycle > step.cycle); j--)
+      _bench_script[j] = _bench_script[j - 1];
+    _bench_script[j] = step;
+  }
+  return 0;
+}
+
+// Console characters are sent at line rate
+static avr_cycle_count_t
+_bench_send_char(avr_t *avr, avr_cycle_count_t when, void *param)
+{
+  const char *text = param;
+  (void)when;
+
+  if (*text == '\0')
+    return 0;
+  avr_raise_irq(_bench_uart_in, (*text == '\n') ? '\r' : *text);
+  avr_cycle_timer_register(avr, BENCH_FREQUENCY * 10 / BENCH_BAUD, _bench_send_char, (void *)(text + 1));
+  return 0;
+}
+
+static avr_cycle_count_t
+_bench_script_step(avr_t *avr, avr_cycle_count_t when, void *param)
+{
+  (void)param;
+  while ((_bench_script_next < _bench_script_count) && (_bench_script[_bench_script_next].cycle <= when)) {
+    bench_step_t *step = &_bench_script[_bench_script_next++];
+    switch (step->action) {
+      case BENCH_SEND:
+        _bench_send_char(avr, when, step->text);
+        break;
+      case BENCH_PRESS:
+        avr_raise_irq(_bench_button, 0);
+        break;
+      case BENCH_RELEASE:
+        avr_raise_irq(_bench_button, 1);
+        break;
+      case BENCH_QUIT:
+        _bench_done = 1;
+        break;
+    }
+  }
+  if (_bench_script_next == _bench_script_count)
+    return 0;
+  return _bench_script[_bench_script_next].cycle;
+}
+
+static void
+_bench_uart_out(avr_irq_t *irq, uint32_t value, void *param)
+{
+  (void)irq;
+  (void)param;
+  if (_bench_console != NULL)
+    fputc(value, _bench_console);
+}
+
+static void
+_bench_irqoff_end(const uint64_t cycle)
+{
+  const uint64_t length = cycle - _bench_irqoff_start;
+  bench_function_t *owner = (_bench_depth != 0) ? _bench_stack[_bench_depth - 1].function : NULL;
+
+  _bench_irqoff.calls++;
+  _bench_irqoff.total += length;
+  if (length < _bench_irqoff.min)
+    _bench_irqoff.min = length;
+  if (length > _bench_irqoff.max)
+    _bench_irqoff.max = length;
+  if ((owner != NULL) && (length > owner->irqoff_max))
+    owner->irqoff_max = length;
+}
+
+static void
+_bench_frame_end(const uint64_t cycle)
+{
+  bench_frame_t *frame = &_bench_stack[--_bench_depth];
+  bench_function_t *f = frame->function;
+  const uint64_t inclusive = cycle - frame->start;
+  const uint64_t cycles = inclusive - frame->excluded;
+
+  f->calls++;
+  f->total += cycles;
+  if (cycles < f->min)
+    f->min = cycles;
+  if (cycles > f->max)
+    f->max = cycles;
+
+  // Interrupt handlers are not accounted to the code they interrupted
+  if (f->isr) {
+    for (unsigned n = 0; n < _bench_depth; n++)
+      _bench_stack[n].excluded += inclusive;
+  }
+}
+
+/*
+ * Account one instruction (or one sleep period): interrupts flag
+ * changes, returns from tracked functions, then entries.
+ */
+static void
+_bench_trace(avr_t *avr, const int was_enabled, const int was_sleeping, const uint64_t before)
+{
+  const uint16_t sp = avr->data[R_SPL] | (avr->data[R_SPH] << 8);
+  const int enabled = avr->sreg[S_I];
+
+  if (was_sleeping) {
+    for (unsigned n = 0; n < _bench_depth; n++)
+      _bench_stack[n].excluded += avr->cycle - before;
+  }
+
+  if (enabled && !was_enabled) {
+    if (_bench_irqoff_tracking)
+      _bench_irqoff_end(avr->cycle);
+    _bench_irqoff_tracking = 1;
+  } else if (!enabled && was_enabled) {
+    _bench_irqoff_start = before;
+  }
+
+  while ((_bench_depth != 0) && (sp > _bench_stack[_bench_depth - 1].sp))
+    _bench_frame_end(avr->cycle);
+
+  if (avr->pc >= BENCH_FLASH_SIZE)
+    return;
+  bench_function_t *f = _bench_entries[avr->pc / 2];
+  if ((f == NULL) || (_bench_depth == BENCH_MAX_DEPTH))
+    return;
+  // Loop back to the first instruction, not a call
+  if ((_bench_depth != 0) && (_bench_stack[_bench_depth - 1].function == f) && (_bench_stack[_bench_depth - 1].sp == sp))
+    return;
+  bench_frame_t *frame = &_bench_stack[_bench_depth++];
+  frame->function = f;
+  frame->sp = sp;
+  frame->start = avr->cycle;
+  frame->excluded = 0;
+}
+
+static void
+_bench_print_row(const bench_function_t *f, const char *kind)
+{
+  if (f->calls == 0) {
+    printf("%s\t%s\t0\t-\t-\t-\t-\n", f->name, kind);
+    return;
+  }
+  printf("%s\t%s\t%llu\t%llu\t%llu\t%llu\t%llu\n", f->name, kind,
+         (unsigned long long)f->calls, (unsigned long long)f->min,
+         (unsigned long long)(f->total / f->calls), (unsigned long long)f->max,
+         (unsigned long long)f->irqoff_max);
+}
+
+static void
+_bench_report(const char *firmware, const char *script, const uint64_t cycles)
+{
+  printf("# %s, script %s, %llu cycles at %u Hz\n", firmware, script, (unsigned long long)cycles, BENCH_FREQUENCY);
+  printf("# cycles per call, excluding interrupts and sleep; irqoff_max: longest interrupts disabled stretch ended there\n");
+  printf("name\tkind\tcalls\tmin\tavg\tmax\tirqoff_max\n");
+  for (unsigned n = 0; n < _bench_function_count; n++)
+    _bench_print_row(&_bench_functions[n], _bench_functions[n].isr ? "isr" : "function");
+  _bench_irqoff.irqoff_max = _bench_irqoff.max;
+  _bench_print_row(&_bench_irqoff, "irqoff");
+}
+
+static const bench_function_t *
+_bench_find(const char *name, const char *kind)
+{
+  if (strcmp(kind, "irqoff") == 0)
+    return &_bench_irqoff;
+  for (unsigned n = 0; n < _bench_function_count; n++) {
+    if (strcmp(_bench_functions[n].name, name) == 0)
+      return &_bench_functions[n];
+  }
+  return NULL;
+}
+
+/*
+ * Compare maxima with a previous report, returns the number of
+ * regressions.
+ */
+static int
+_bench_check(const char *path, const double tolerance)
+{
+  FILE *f = fopen(path, "r");
+  char line[256];
+  int regressions = 0;
+
+  if (f == NULL) {
+    perror(path);
+    return 1;
+  }
+  while (fgets(line, sizeof(line), f) != NULL) {
+    char name[64], kind[16];
+    unsigned long long max, irqoff_max;
+    if (sscanf(line, "%63s %15s %*s %*s %*s %llu %llu", name, kind, &max, &irqoff_max) != 4)
+      continue;
+    const bench_function_t *b = _bench_find(name, kind);
+    if ((b == NULL) || (b->calls == 0))
+      continue;
+    const uint64_t new_irqoff = (b == &_bench_irqoff) ? b->max : b->irqoff_max;
+    if (b->max > max * (1 + tolerance / 100)) {
+      fprintf(stderr, "regression: %s max %llu cycles (was %llu)\n", name, (unsigned long long)b->max, max);
+      regressions++;
+    }
+    if (new_irqoff > irqoff_max * (1 + tolerance / 100)) {
+      fprintf(stderr, "regression: %s irqoff_max %llu cycles (was %llu)\n", name, (unsigned long long)new_irqoff, irqoff_max);
+      regressions++;
+    }
+  }
+  fclose(f);
+  return regressions;
+}
+
+int
+main(int argc, char *argv[])
+{
+  const char *names[BENCH_MAX_FUNCTIONS + 1];
+  unsigned name_count = 0;
+  const char *script = "sim/bench.script";
+  const char *baseline = NULL;
+  double tolerance = 10;
+  double oil = 20;
+  uint64_t feedback_delay = SIM_BOARD_FEEDBACK_DELAY_NS;
+  int opt;
+
+  while ((opt = getopt(argc, argv, "s:f:o:T:d:vb:r:")) != -1) {
+    switch (opt) {
+      case 's':
+        script = optarg;
+        break;
+      case 'f':
+        if (name_count < BENCH_MAX_FUNCTIONS)
+          names[name_count++] = optarg;
+        break;
+      case 'o':
+        _bench_console = fopen(optarg, "w");
+        if (_bench_console == NULL) {
+          perror(optarg);
+          return 1;
+        }
+        break;
+      case 'T':
+        oil = atof(optarg);
+        break;
+      case 'd':
+        feedback_delay = (uint64_t)(atof(optarg) * SIM_MS);
+        break;
+      case 'v':
+        simavr_verbose = true;
+        break;
+      case 'b':
+        baseline = optarg;
+        break;
+      case 'r':
+        tolerance = atof(optarg);
+        break;
+      default:
+        usage(argv[0]);
+    }
+  }
+  if (optind + 1 != argc)
+    usage(argv[0]);
+  const char *firmware = argv[optind];
+  names[name_count] = NULL;
+
+  if ((_bench_load_symbols(firmware, (name_count != 0) ? names : _bench_default_functions) != 0) || (_bench_load_script(script) != 0))
+    return 1;
+
+  elf_firmware_t elf;
+  memset(&elf, 0, sizeof(elf));
+  if (elf_read_firmware(firmware, &elf) != 0) {
+    fprintf(stderr, "%s: cannot load firmware\n", firmware);
+    return 1;
+  }
+  avr_t *avr = avr_make_mcu_by_name(BENCH_MCU);
+  if (avr == NULL)
+    return 1;
+  avr_init(avr);
+  elf.frequency = BENCH_FREQUENCY;
+  avr_load_firmware(avr, &elf);
+  avr->frequency = BENCH_FREQUENCY;
+
+  // Relay board and ADS1115
+  simavr_board_init(avr);
+  sim_board_set_feedback_delay(feedback_delay);
+  sim_board_set_oil_temperature(oil);
+
+  // Console: no echo of simavr itself, output optionally saved
+  uint32_t flags = 0;
+  avr_ioctl(avr, AVR_IOCTL_UART_GET_FLAGS('0'), &flags);
+  flags &= ~AVR_UART_FLAG_STDIO;
+  avr_ioctl(avr, AVR_IOCTL_UART_SET_FLAGS('0'), &flags);
+  _bench_uart_in = avr_io_getirq(avr, AVR_IOCTL_UART_GETIRQ('0'), UART_IRQ_INPUT);
+  avr_irq_register_notify(avr_io_getirq(avr, AVR_IOCTL_UART_GETIRQ('0'), UART_IRQ_OUTPUT), _bench_uart_out, NULL);
+
+  // Dashboard button on PD2, released
+  _bench_button = avr_io_getirq(avr, AVR_IOCTL_IOPORT_GETIRQ('D'), 2);
+  avr_raise_irq(_bench_button, 1);
+
+  if (_bench_script_count != 0)
+    avr_cycle_timer_register(avr, _bench_script[0].cycle, _bench_script_step, NULL);
+
+  int state = cpu_Running;
+  while (!_bench_done && (state != cpu_Done) && (state != cpu_Crashed)) {
+    const int was_enabled = avr->sreg[S_I];
+    const int was_sleeping = (avr->state == cpu_Sleeping);
+    const uint64_t before = avr->cycle;
+    state = avr_run(avr);
+    _bench_trace(avr, was_enabled, was_sleeping, before);
+  }
+  if (state == cpu_Crashed) {
+    fprintf(stderr, "%s: crashed at pc 0x%04x\n", firmware, (unsigned)avr->pc);
+    return 1;
+  }
+
+  _bench_report(firmware, script, avr->cycle);
+  if (_bench_console != NULL)
+    fclose(_bench_console);
+
+  if ((baseline != NULL) && (_bench_check(baseline, tolerance) != 0))
+    return 1;
+  return 0;
+}
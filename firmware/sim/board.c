@@ -0,0 +1,99 @@
+/*
+ * UtopHuile board, see board.h.
+ */
+
+#include "board.h"
+
+#include <stddef.h>
+
+#include "../relay.h"
+
+#define SIM_BOARD_PCF8574_ADDRESS	0x20
+#define SIM_BOARD_ADS1115_ADDRESS	0x48
+#define SIM_BOARD_OIL_AIN		1
+
+static const sim_env_t *_sim_board_env;
+static sim_pcf8574_t _sim_board_pcf8574;
+static sim_ads1115_t _sim_board_ads1115;
+
+static uint64_t _sim_board_feedback_delay = SIM_BOARD_FEEDBACK_DELAY_NS;
+static void (*_sim_board_relays_changed)(const uint8_t relays) = NULL;
+
+// Event arguments, one per relay
+static uint8_t _sim_board_relay_index[4] = { 0, 1, 2, 3 };
+
+static const char *const _sim_board_relay_names[4] = { "valve input", "valve output", "pump", "heater" };
+
+uint8_t
+sim_board_relays(void)
+{
+  // Outputs are active low
+  return (~_sim_board_pcf8574.latch >> RELAY_VALVE_INPUT) & 0x0f;
+}
+
+// Feedback input n is high while relay n is on
+static void
+_sim_board_feedback(void *arg)
+{
+  const uint8_t n = *(const uint8_t *)arg;
+  const uint8_t mask = 1 << (RELAY_FB_VALVE_INPUT + n);
+
+  sim_pcf8574_drive(&_sim_board_pcf8574, mask, (sim_board_relays() & (1 << n)) ? mask : 0);
+}
+
+static void
+_sim_board_relays_written(sim_pcf8574_t *pcf, const uint8_t changed)
+{
+  for (uint8_t n = 0; n < 4; n++) {
+    if (!(changed & (1 << (RELAY_VALVE_INPUT + n))))
+      continue;
+    _sim_board_env->trace("relay %s: %s", _sim_board_relay_names[n], (pcf->latch & (1 << (RELAY_VALVE_INPUT + n))) ? "off" : "on");
+    _sim_board_env->cancel(_sim_board_feedback, &_sim_board_relay_index[n]);
+    _sim_board_env->schedule(_sim_board_feedback_delay, _sim_board_feedback, &_sim_board_relay_index[n]);
+  }
+  if ((changed & 0xf0) && (_sim_board_relays_changed != NULL))
+    _sim_board_relays_changed(sim_board_relays());
+}
+
+void
+sim_board_init(const sim_env_t *env, void (*rdy)(const int level))
+{
+  _sim_board_env = env;
+  sim_pcf8574_init(&_sim_board_pcf8574, SIM_BOARD_PCF8574_ADDRESS);
+  _sim_board_pcf8574.written = _sim_board_relays_written;
+  // Relays are off at power up, so are their feedbacks
+  sim_pcf8574_drive(&_sim_board_pcf8574, 0x0f, 0x00);
+  sim_ads1115_init(&_sim_board_ads1115, env, SIM_BOARD_ADS1115_ADDRESS, rdy);
+}
+
+void
+sim_board_attach(void (*attach)(sim_i2c_device_t *device))
+{
+  attach(&_sim_board_pcf8574.device);
+  attach(&_sim_board_ads1115.device);
+}
+
+void
+sim_board_set_feedback_delay(const uint64_t delay_ns)
+{
+  _sim_board_feedback_delay = delay_ns;
+}
+
+void
+sim_board_on_relays(void (*fct)(const uint8_t relays))
+{
+  _sim_board_relays_changed = fct;
+}
+
+void
+sim_board_set_input(const uint8_t ain, const int16_t counts)
+{
+  sim_ads1115_set_input(&_sim_board_ads1115, ain, counts);
+}
+
+// As the former linear conversion of the firmware (see temperature.cal)
+void
+sim_board_set_oil_temperature(const double celsius)
+{
+  sim_board_set_input(SIM_BOARD_OIL_AIN, (int16_t)((celsius + 259.74025974) / 0.0217220010422 + 0.5));
+}
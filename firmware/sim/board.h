@@ -0,0 +1,29 @@
+#ifndef __SIM_BOARD_H__
+#define __SIM_BOARD_H__
+
+/*
+ * Simulated peripherals of the UtopHuile board: relay board PCF8574
+ * at 0x20 (8 bits address 0x40, see relay.h) and ADS1115 at 0x48 with
+ * ALERT/RDY on INT1.
+ */
+
+#include "i2c_devices.h"
+
+// Relay feedback inputs follow the relay outputs after this delay
+#define SIM_BOARD_FEEDBACK_DELAY_NS	(10 * SIM_MS)
+
+// "rdy" drives the ADS1115 ALERT/RDY line (0, or -1 to release it)
+void sim_board_init(const sim_env_t *env, void (*rdy)(const int level));
+void sim_board_attach(void (*attach)(sim_i2c_device_t *device));
+
+void sim_board_set_feedback_delay(const uint64_t delay_ns);
+// Called with relays on (bit n: relay n, see RELAY_VALVE_INPUT) when they change
+void sim_board_on_relays(void (*fct)(const uint8_t relays));
+uint8_t sim_board_relays(void);
+
+// Conversion result of ADS1115 input "ain" (0 to 3, single ended), in counts
+void sim_board_set_input(const uint8_t ain, const int16_t counts);
+// Oil temperature sensor, on AIN1
+void sim_board_set_oil_temperature(const double celsius);
+
+#endif	/* __SIM_BOARD_H__ */
@@ -0,0 +1,216 @@
+/*
+ * I²C device models, see i2c_devices.h.
+ */
+
+#include "i2c_devices.h"
+
+#include <string.h>
+
+/*
+ * PCF8574
+ */
+static bool
+_sim_pcf8574_start(sim_i2c_device_t *device, const bool read)
+{
+  (void)device;
+  (void)read;
+  return true;
+}
+
+static bool
+_sim_pcf8574_write(sim_i2c_device_t *device, const uint8_t data)
+{
+  sim_pcf8574_t *pcf = (sim_pcf8574_t *)device;
+  const uint8_t changed = pcf->latch ^ data;
+
+  pcf->latch = data;
+  if ((changed != 0) && (pcf->written != NULL))
+    pcf->written(pcf, changed);
+  return true;
+}
+
+static uint8_t
+_sim_pcf8574_read(sim_i2c_device_t *device, const bool ack)
+{
+  (void)ack;
+  return sim_pcf8574_pins((sim_pcf8574_t *)device);
+}
+
+static void
+_sim_pcf8574_stop(sim_i2c_device_t *device)
+{
+  (void)device;
+}
+
+void
+sim_pcf8574_init(sim_pcf8574_t *pcf, const uint8_t address)
+{
+  memset(pcf, 0, sizeof(*pcf));
+  pcf->device.address = address;
+  pcf->device.start = _sim_pcf8574_start;
+  pcf->device.write = _sim_pcf8574_write;
+  pcf->device.read = _sim_pcf8574_read;
+  pcf->device.stop = _sim_pcf8574_stop;
+  pcf->latch = 0xff;
+  pcf->external = 0xff;
+}
+
+uint8_t
+sim_pcf8574_pins(const sim_pcf8574_t *pcf)
+{
+  // Wired AND of the port (strong 0, weak 1) and of the outside
+  return pcf->latch & pcf->external;
+}
+
+void
+sim_pcf8574_drive(sim_pcf8574_t *pcf, const uint8_t mask, const uint8_t levels)
+{
+  pcf->external = (pcf->external & ~mask) | (levels & mask);
+}
+
+/*
+ * ADS1115
+ */
+#define ADS1115_OS		0x8000
+#define ADS1115_MUX(config)	(((config) >> 12) & 7)
+#define ADS1115_MODE		0x0100
+#define ADS1115_DR(config)	(((config) >> 5) & 7)
+#define ADS1115_COMP_QUE(config)	((config) & 3)
+
+#define ADS1115_RDY_PULSE_NS	(8 * SIM_US)
+
+static const uint16_t _sim_ads1115_rates[8] = { 8, 16, 32, 64, 128, 250, 475, 860 };
+
+static void _sim_ads1115_converted(void *arg);
+
+static bool
+_sim_ads1115_rdy_mode(const sim_ads1115_t *ads)
+{
+  return (ads->regs[3] & 0x8000) && !(ads->regs[2] & 0x8000) && (ADS1115_COMP_QUE(ads->regs[1]) != 3);
+}
+
+static void
+_sim_ads1115_alert(const sim_ads1115_t *ads, const int level)
+{
+  if (ads->alert != NULL)
+    ads->alert(level);
+}
+
+static void
+_sim_ads1115_rdy_release(void *arg)
+{
+  _sim_ads1115_alert(arg, -1);
+}
+
+static void
+_sim_ads1115_convert(sim_ads1115_t *ads)
+{
+  ads->env->cancel(_sim_ads1115_converted, ads);
+  ads->env->schedule(SIM_S / _sim_ads1115_rates[ADS1115_DR(ads->regs[1])], _sim_ads1115_converted, ads);
+}
+
+static void
+_sim_ads1115_converted(void *arg)
+{
+  sim_ads1115_t *ads = arg;
+  const uint8_t mux = ADS1115_MUX(ads->regs[1]);
+
+  // Single ended inputs only, differential ones read 0
+  ads->regs[0] = (mux & 4) ? ads->inputs[mux & 3] : 0;
+
+  if (ads->regs[1] & ADS1115_MODE) {
+    ads->regs[1] |= ADS1115_OS;
+    if (_sim_ads1115_rdy_mode(ads))
+      _sim_ads1115_alert(ads, 0);	/* until next conversion start */
+  } else {
+    _sim_ads1115_convert(ads);
+    if (_sim_ads1115_rdy_mode(ads)) {
+      _sim_ads1115_alert(ads, 0);
+      ads->env->schedule(ADS1115_RDY_PULSE_NS, _sim_ads1115_rdy_release, ads);
+    }
+  }
+}
+
+static bool
+_sim_ads1115_start(sim_i2c_device_t *device, const bool read)
+{
+  (void)read;
+  ((sim_ads1115_t *)device)->index = 0;
+  return true;
+}
+
+// Config register written: start, restart or stop conversions
+static void
+_sim_ads1115_configured(sim_ads1115_t *ads)
+{
+  if (!(ads->regs[1] & ADS1115_MODE)) {
+    _sim_ads1115_convert(ads);
+  } else if (ads->regs[1] & ADS1115_OS) {
+    ads->regs[1] &= ~ADS1115_OS;
+    _sim_ads1115_alert(ads, -1);
+    _sim_ads1115_convert(ads);
+  } else {
+    // Power down, a conversion in progress would be lost
+    ads->regs[1] |= ADS1115_OS;
+    ads->env->cancel(_sim_ads1115_converted, ads);
+  }
+}
+
+static bool
+_sim_ads1115_write(sim_i2c_device_t *device, const uint8_t data)
+{
+  sim_ads1115_t *ads = (sim_ads1115_t *)device;
+
+  if (ads->index == 0) {
+    ads->pointer = data & 3;
+  } else if (ads->pointer == 0) {
+    // Conversion register is read only
+  } else if (ads->index == 1) {
+    ads->regs[ads->pointer] = (ads->regs[ads->pointer] & 0x00ff) | (data << 8);
+  } else if (ads->index == 2) {
+    ads->regs[ads->pointer] = (ads->regs[ads->pointer] & 0xff00) | data;
+    if (ads->pointer == 1)
+      _sim_ads1115_configured(ads);
+  }
+  ads->index++;
+  return ads->index <= 3;
+}
+
+static uint8_t
+_sim_ads1115_read(sim_i2c_device_t *device, const bool ack)
+{
+  sim_ads1115_t *ads = (sim_ads1115_t *)device;
+  const uint16_t value = ads->regs[ads->pointer];
+
+  (void)ack;
+  return (ads->index++ & 1) ? (value & 0xff) : (value >> 8);
+}
+
+static void
+_sim_ads1115_stop(sim_i2c_device_t *device)
+{
+  (void)device;
+}
+
+void
+sim_ads1115_init(sim_ads1115_t *ads, const sim_env_t *env, const uint8_t address, void (*alert)(const int level))
+{
+  memset(ads, 0, sizeof(*ads));
+  ads->device.address = address;
+  ads->device.start = _sim_ads1115_start;
+  ads->device.write = _sim_ads1115_write;
+  ads->device.read = _sim_ads1115_read;
+  ads->device.stop = _sim_ads1115_stop;
+  ads->env = env;
+  ads->alert = alert;
+  // Power up values: single shot, powered down, ±2.048 V, 128 SPS
+  ads->regs[1] = 0x8583;
+  ads->regs[2] = 0x8000;
+  ads->regs[3] = 0x7fff;
+}
+
+void
+sim_ads1115_set_input(sim_ads1115_t *ads, const uint8_t ain, const int16_t counts)
+{
+  ads->inputs[ain & 3] = counts;
+}
@@ -0,0 +1,77 @@
+#ifndef __SIM_I2C_DEVICES_H__
+#define __SIM_I2C_DEVICES_H__
+
+/*
+ * Register level models of the I²C devices of the board, independent
+ * of the simulator: the host build (host/) and simavr (sim/simavr_i2c.c)
+ * provide the bus and the clock.
+ *
+ * Models only depend on the simulated time, so a run is replayed
+ * identically whatever the wall clock does.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define SIM_US		1000ULL
+#define SIM_MS		1000000ULL
+#define SIM_S		1000000000ULL
+
+// Simulator services: timed events (in ns of simulated time) and traces
+typedef void (*sim_event_fct)(void *arg);
+typedef struct {
+  void (*schedule)(const uint64_t delay_ns, sim_event_fct fct, void *arg);
+  void (*cancel)(sim_event_fct fct, void *arg);
+  void (*trace)(const char *fmt, ...);
+} sim_env_t;
+
+// I²C slave, "address" is 7 bits
+typedef struct sim_i2c_device_s sim_i2c_device_t;
+struct sim_i2c_device_s {
+  uint8_t address;
+  bool (*start)(sim_i2c_device_t *device, const bool read);	// selected, returns ACK
+  bool (*write)(sim_i2c_device_t *device, const uint8_t data);	// returns ACK
+  uint8_t (*read)(sim_i2c_device_t *device, const bool ack);
+  void (*stop)(sim_i2c_device_t *device);
+  sim_i2c_device_t *next;
+};
+
+/*
+ * PCF8574: quasi-bidirectional port.  A pin written 1 is only pulled up
+ * weakly and reads what drives it from outside, a pin written 0 is
+ * driven low.
+ */
+typedef struct sim_pcf8574_s sim_pcf8574_t;
+struct sim_pcf8574_s {
+  sim_i2c_device_t device;
+  uint8_t latch;	// last byte written, 0xff at power up
+  uint8_t external;	// levels driven from outside, 1 where released
+  void (*written)(sim_pcf8574_t *pcf, const uint8_t changed);	// optional
+};
+
+void sim_pcf8574_init(sim_pcf8574_t *pcf, const uint8_t address);
+uint8_t sim_pcf8574_pins(const sim_pcf8574_t *pcf);
+// Drive the pins of "mask" from outside to "levels"
+void sim_pcf8574_drive(sim_pcf8574_t *pcf, const uint8_t mask, const uint8_t levels);
+
+/*
+ * ADS1115: conversion, config and threshold registers, single shot and
+ * continuous modes timed by the configured data rate, and ALERT/RDY as
+ * a conversion ready output when the thresholds MSBs select it.  Only
+ * single ended inputs are modelled (differential ones read 0); inputs
+ * are given in counts, the PGA is not modelled.
+ */
+typedef struct {
+  sim_i2c_device_t device;
+  const sim_env_t *env;
+  uint8_t pointer;
+  uint16_t regs[4];	// conversion, config, lo_thresh, hi_thresh
+  uint8_t index;	// byte index in current transfer
+  int16_t inputs[4];
+  void (*alert)(const int level);	// open drain: 0 or -1 (released)
+} sim_ads1115_t;
+
+void sim_ads1115_init(sim_ads1115_t *ads, const sim_env_t *env, const uint8_t address, void (*alert)(const int level));
+void sim_ads1115_set_input(sim_ads1115_t *ads, const uint8_t ain, const int16_t counts);
+
+#endif	/* __SIM_I2C_DEVICES_H__ */
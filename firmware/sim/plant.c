@@ -0,0 +1,125 @@
+/*
+ * Thermal plant, see plant.h.  Explicit Euler integration at
+ * SIM_PLANT_STEP_NS, far below the time constants of the model (tens
+ * of seconds and more).
+ */
+
+#include "plant.h"
+#include "board.h"
+
+#include <stddef.h>
+
+#include "../relay.h"
+
+/*
+ * Defaults: 400 W heater on ~2 kg of oil.  Heating from 20 °C to READY
+ * takes about 10 minutes; with the heater and the pump left on, the
+ * circuit settles well above the firmware maximum temperature, unless
+ * the engine draws oil.
+ */
+const sim_plant_config_t sim_plant_defaults = {
+  .ambient_c = 20,
+  .heater_w = 400,
+  .heater_j_k = 400,
+  .oil_j_k = 4000,
+  .exchange_w_k = 2,
+  .exchange_pump_w_k = 30,
+  .loss_w_k = 3,
+  .fuel_g_s = 1.5,
+  .lines_g = 300,
+  .oil_j_g_k = 2.0,
+};
+
+static const sim_env_t *_sim_plant_env;
+static sim_plant_config_t _sim_plant_config;
+
+static double _sim_plant_heater_c;
+static bool _sim_plant_drawing = false;
+static uint8_t _sim_plant_relays = 0;
+static sim_plant_stats_t _sim_plant_stats;
+
+static void
+_sim_plant_relays_changed(const uint8_t relays)
+{
+  const uint8_t heater = 1 << (RELAY_HEATER - RELAY_VALVE_INPUT);
+
+  if ((relays & heater) && !(_sim_plant_relays & heater))
+    _sim_plant_stats.heater_switches++;
+  for (uint8_t changed = relays ^ _sim_plant_relays; changed != 0; changed &= changed - 1)
+    _sim_plant_stats.relay_switches++;
+  _sim_plant_relays = relays;
+}
+
+static bool
+_sim_plant_relay(const uint8_t relay)
+{
+  return (_sim_plant_relays & (1 << (relay - RELAY_VALVE_INPUT))) != 0;
+}
+
+static void
+_sim_plant_step(void *arg)
+{
+  const sim_plant_config_t *c = &_sim_plant_config;
+  const double dt = (double)SIM_PLANT_STEP_NS / SIM_S;
+  const bool heater = _sim_plant_relay(RELAY_HEATER);
+  const bool draw = _sim_plant_relay(RELAY_VALVE_INPUT) && _sim_plant_relay(RELAY_VALVE_OUTPUT);
+  double *oil = &_sim_plant_stats.oil_c;
+
+  (void)arg;
+  _sim_plant_env->schedule(SIM_PLANT_STEP_NS, _sim_plant_step, NULL);
+
+  if (draw && !_sim_plant_drawing) {
+    const double lines_j_k = c->lines_g * c->oil_j_g_k;
+    *oil = (*oil * c->oil_j_k + c->ambient_c * lines_j_k) / (c->oil_j_k + lines_j_k);
+  }
+  _sim_plant_drawing = draw;
+
+  // Heat flows, in W
+  const double exchange = (_sim_plant_relay(RELAY_PUMP) ? c->exchange_pump_w_k : c->exchange_w_k) * (_sim_plant_heater_c - *oil);
+  const double loss = c->loss_w_k * (*oil - c->ambient_c);
+  const double fuel = draw ? c->fuel_g_s * c->oil_j_g_k * (*oil - c->ambient_c) : 0;
+
+  _sim_plant_heater_c += ((heater ? c->heater_w : 0) - exchange) * dt / c->heater_j_k;
+  *oil += (exchange - loss - fuel) * dt / c->oil_j_k;
+
+  if (*oil > _sim_plant_stats.peak_c)
+    _sim_plant_stats.peak_c = *oil;
+  if (heater)
+    _sim_plant_stats.heater_on_s += dt;
+  if (draw)
+    _sim_plant_stats.fuel_g += c->fuel_g_s * dt;
+
+  sim_board_set_oil_temperature(*oil);
+}
+
+void
+sim_plant_init(const sim_env_t *env, const sim_plant_config_t *config)
+{
+  _sim_plant_env = env;
+  _sim_plant_config = *config;
+  _sim_plant_heater_c = config->ambient_c;
+  _sim_plant_stats.oil_c = config->ambient_c;
+  _sim_plant_stats.peak_c = config->ambient_c;
+
+  sim_board_on_relays(_sim_plant_relays_changed);
+  sim_board_set_oil_temperature(config->ambient_c);
+  env->schedule(SIM_PLANT_STEP_NS, _sim_plant_step, NULL);
+}
+
+void
+sim_plant_set_ambient(const double celsius)
+{
+  _sim_plant_config.ambient_c = celsius;
+}
+
+void
+sim_plant_set_fuel_flow(const double g_s)
+{
+  _sim_plant_config.fuel_g_s = g_s;
+}
+
+void
+sim_plant_stats(sim_plant_stats_t *stats)
+{
+  *stats = _sim_plant_stats;
+}
@@ -0,0 +1,52 @@
+#ifndef __SIM_PLANT_H__
+#define __SIM_PLANT_H__
+
+/*
+ * Lumped thermal model of the oil circuit, driven by the relays of the
+ * simulated board (board.h) and feeding its oil temperature sensor.
+ *
+ * Two nodes: the heater block (element and the oil around it) and the
+ * oil circuit, where the sensor is.  The pump moves heat from one to
+ * the other, the circuit loses heat to ambient, and while the valves
+ * are open the engine draws hot oil, replaced by cold oil from the
+ * tank.  Opening the valves also mixes the cold oil standing in the
+ * lines into the circuit.
+ */
+
+#include <stdint.h>
+
+#include "i2c_devices.h"
+
+#define SIM_PLANT_STEP_NS	(100 * SIM_MS)
+
+typedef struct {
+  double ambient_c;		// ambient and tank temperature
+  double heater_w;		// heater power
+  double heater_j_k;		// heater block heat capacity
+  double oil_j_k;		// oil circuit heat capacity
+  double exchange_w_k;		// heater block to circuit, pump stopped
+  double exchange_pump_w_k;	// heater block to circuit, pump running
+  double loss_w_k;		// circuit to ambient
+  double fuel_g_s;		// engine consumption, valves open
+  double lines_g;		// cold oil in the lines, mixed in when the valves open
+  double oil_j_g_k;		// oil specific heat
+} sim_plant_config_t;
+
+extern const sim_plant_config_t sim_plant_defaults;
+
+typedef struct {
+  double oil_c;			// current oil circuit temperature
+  double peak_c;		// highest oil circuit temperature
+  double heater_on_s;		// heater energized time
+  uint32_t heater_switches;	// heater relay off to on transitions
+  uint32_t relay_switches;	// all relays, both ways
+  double fuel_g;		// oil drawn by the engine
+} sim_plant_stats_t;
+
+// Starts at ambient temperature, "config" is copied
+void sim_plant_init(const sim_env_t *env, const sim_plant_config_t *config);
+void sim_plant_set_ambient(const double celsius);
+void sim_plant_set_fuel_flow(const double g_s);
+void sim_plant_stats(sim_plant_stats_t *stats);
+
+#endif	/* __SIM_PLANT_H__ */
@@ -0,0 +1,193 @@
+/*
+ * simavr glue, see simavr_i2c.h.
+ */
+
+#include "simavr_i2c.h"
+#include "board.h"
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <sim_irq.h>
+#include <sim_cycle_timers.h>
+#include <avr_ioport.h>
+#include <avr_twi.h>
+
+bool simavr_verbose = false;
+
+static avr_t *_simavr;
+
+/*
+ * Timed events: each one holds a cycle timer until it runs or is
+ * cancelled.
+ */
+#define SIMAVR_MAX_EVENTS	32
+
+typedef struct {
+  sim_event_fct fct;
+  void *arg;
+  bool used;
+} _simavr_event_t;
+
+static _simavr_event_t _simavr_events[SIMAVR_MAX_EVENTS];
+
+static avr_cycle_count_t
+_simavr_event_run(avr_t *avr, avr_cycle_count_t when, void *param)
+{
+  _simavr_event_t *e = param;
+
+  (void)avr;
+  (void)when;
+  e->used = false;
+  e->fct(e->arg);
+  return 0;
+}
+
+static void
+_simavr_schedule(const uint64_t delay_ns, sim_event_fct fct, void *arg)
+{
+  for (unsigned n = 0; n < SIMAVR_MAX_EVENTS; n++) {
+    _simavr_event_t *e = &_simavr_events[n];
+    if (!e->used) {
+      e->fct = fct;
+      e->arg = arg;
+      e->used = true;
+      // Never 0, which would not be run
+      const avr_cycle_count_t cycles = delay_ns * _simavr->frequency / SIM_S;
+      avr_cycle_timer_register(_simavr, (cycles != 0) ? cycles : 1, _simavr_event_run, e);
+      return;
+    }
+  }
+  fprintf(stderr, "simavr: too many events\n");
+  exit(1);
+}
+
+static void
+_simavr_cancel(sim_event_fct fct, void *arg)
+{
+  for (unsigned n = 0; n < SIMAVR_MAX_EVENTS; n++) {
+    _simavr_event_t *e = &_simavr_events[n];
+    if (e->used && (e->fct == fct) && (e->arg == arg)) {
+      avr_cycle_timer_cancel(_simavr, _simavr_event_run, e);
+      e->used = false;
+    }
+  }
+}
+
+static void
+_simavr_trace(const char *fmt, ...)
+{
+  char line[256];
+  va_list ap;
+
+  if (!simavr_verbose)
+    return;
+  va_start(ap, fmt);
+  vsnprintf(line, sizeof(line), fmt, ap);
+  va_end(ap);
+  fprintf(stderr, "[%11.6f] %s\n", (double)_simavr->cycle / _simavr->frequency, line);
+}
+
+static const sim_env_t _simavr_env = {
+  .schedule = _simavr_schedule,
+  .cancel = _simavr_cancel,
+  .trace = _simavr_trace,
+};
+
+const sim_env_t *
+simavr_env_init(avr_t *avr)
+{
+  _simavr = avr;
+  return &_simavr_env;
+}
+
+/*
+ * TWI bridge: simavr sends bus conditions as messages on the TWI
+ * output irq, slaves answer (ACK, read data) on its input irq.
+ */
+static sim_i2c_device_t *_simavr_i2c_devices = NULL;
+static sim_i2c_device_t *_simavr_i2c_selected = NULL;
+static avr_irq_t *_simavr_i2c_irq;
+
+static const char *_simavr_i2c_irq_names[2] = {
+  [TWI_IRQ_INPUT] = "8>sim.i2c.in",
+  [TWI_IRQ_OUTPUT] = "32<sim.i2c.out",
+};
+
+void
+simavr_i2c_attach(sim_i2c_device_t *device)
+{
+  device->next = _simavr_i2c_devices;
+  _simavr_i2c_devices = device;
+}
+
+static void
+_simavr_i2c_answer(const uint8_t msg, const uint8_t addr, const uint8_t data)
+{
+  avr_raise_irq(_simavr_i2c_irq + TWI_IRQ_INPUT, avr_twi_irq_msg(msg, addr, data));
+}
+
+static void
+_simavr_i2c_message(avr_irq_t *irq, uint32_t value, void *param)
+{
+  avr_twi_msg_irq_t v;
+  sim_i2c_device_t *device = _simavr_i2c_selected;
+
+  (void)irq;
+  (void)param;
+  v.u.v = value;
+
+  if (v.u.twi.msg & TWI_COND_STOP) {
+    if (device != NULL)
+      device->stop(device);
+    device = _simavr_i2c_selected = NULL;
+  }
+  if (v.u.twi.msg & TWI_COND_START) {
+    _simavr_i2c_selected = NULL;
+    for (device = _simavr_i2c_devices; device != NULL; device = device->next) {
+      if (device->address == (v.u.twi.addr >> 1))
+        break;
+    }
+    if ((device != NULL) && device->start(device, v.u.twi.addr & 1)) {
+      _simavr_i2c_selected = device;
+      _simavr_i2c_answer(TWI_COND_ACK, v.u.twi.addr, 1);
+    }
+    return;
+  }
+  if (device == NULL)
+    return;
+  if (v.u.twi.msg & TWI_COND_WRITE) {
+    if (device->write(device, v.u.twi.data))
+      _simavr_i2c_answer(TWI_COND_ACK, v.u.twi.addr, 1);
+  }
+  if (v.u.twi.msg & TWI_COND_READ)
+    _simavr_i2c_answer(TWI_COND_READ, v.u.twi.addr, device->read(device, v.u.twi.msg & TWI_COND_ACK));
+}
+
+/*
+ * Board
+ */
+static avr_irq_t *_simavr_rdy;
+
+// Open drain, with the INT1 pull up enabled by the firmware
+static void
+_simavr_board_rdy(const int level)
+{
+  avr_raise_irq(_simavr_rdy, (level == 0) ? 0 : 1);
+}
+
+void
+simavr_board_init(avr_t *avr)
+{
+  _simavr_i2c_irq = avr_alloc_irq(&avr->irq_pool, 0, 2, _simavr_i2c_irq_names);
+  avr_irq_register_notify(_simavr_i2c_irq + TWI_IRQ_OUTPUT, _simavr_i2c_message, NULL);
+  avr_connect_irq(_simavr_i2c_irq + TWI_IRQ_INPUT, avr_io_getirq(avr, AVR_IOCTL_TWI_GETIRQ(0), TWI_IRQ_INPUT));
+  avr_connect_irq(avr_io_getirq(avr, AVR_IOCTL_TWI_GETIRQ(0), TWI_IRQ_OUTPUT), _simavr_i2c_irq + TWI_IRQ_OUTPUT);
+
+  _simavr_rdy = avr_io_getirq(avr, AVR_IOCTL_IOPORT_GETIRQ('D'), 3);
+  _simavr_board_rdy(-1);
+
+  sim_board_init(simavr_env_init(avr), _simavr_board_rdy);
+  sim_board_attach(simavr_i2c_attach);
+}
@@ -0,0 +1,24 @@
+#ifndef __SIM_SIMAVR_I2C_H__
+#define __SIM_SIMAVR_I2C_H__
+
+/*
+ * simavr glue for the device models of i2c_devices.h: simulator
+ * services on simavr cycle timers, and a bridge from the TWI module of
+ * the simulated MCU to the attached devices.  One MCU per process.
+ */
+
+#include <stdbool.h>
+
+#include <sim_avr.h>
+
+#include "i2c_devices.h"
+
+extern bool simavr_verbose;
+
+const sim_env_t *simavr_env_init(avr_t *avr);
+void simavr_i2c_attach(sim_i2c_device_t *device);
+
+// Board peripherals of board.h on TWI, ALERT/RDY on PD3 (INT1)
+void simavr_board_init(avr_t *avr);
+
+#endif	/* __SIM_SIMAVR_I2C_H__ */
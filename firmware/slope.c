@@ -0,0 +1,102 @@
+#include "slope.h"
+
+/*
+ * Forget past samples, there is no estimate until SLOPE_MIN_SAMPLES
+ * new ones.
+ */
+void
+slope_reset(slope_t *slope)
+{
+  slope->index = 0;
+  slope->count = 0;
+  slope->slope = 0;
+  slope->value = 0;
+}
+
+/*
+ * Feed a new sample, every SLOPE_PERIOD_MS.  With abscissae doubled and
+ * centered (x = 2 i - (n - 1), odd integers), sum(x) = 0 and
+ * sum(x²) = n (n² - 1) / 3, so the fit only needs sum(x y) and sum(y):
+ * slope = 2 sum(x y) / sum(x²) per sample, and the fitted newest value
+ * is sum(y) / n + (n - 1) sum(x y) / sum(x²).
+ */
+void
+slope_process(slope_t *slope, const int16_t sample)
+{
+  slope->window[slope->index] = sample;
+  if (++slope->index == SLOPE_WINDOW)
+    slope->index = 0;
+  if (slope->count < SLOPE_WINDOW)
+    slope->count++;
+  if (slope->count < SLOPE_MIN_SAMPLES)
+    return;
+
+  const int8_t n = slope->count;
+  uint8_t i = (slope->count < SLOPE_WINDOW) ? 0 : slope->index;	// oldest
+  int32_t sxy = 0;
+  int32_t sy = 0;
+  for (int8_t x = 1 - n; x < n; x += 2) {
+    const int16_t y = slope->window[i];
+    sxy += (int32_t)x * y;
+    sy += y;
+    if (++i == SLOPE_WINDOW)
+      i = 0;
+  }
+  const int32_t sxx = (int32_t)n * ((int32_t)n * n - 1) / 3;
+
+  // Scaled to minutes in two steps, sxy alone can take 25 bits
+  const int32_t scale = 2L * 60000 / SLOPE_PERIOD_MS;
+  int32_t per_minute = sxy / sxx * scale + sxy % sxx * scale / sxx;
+  if (per_minute > INT16_MAX)
+    per_minute = INT16_MAX;
+  else if (per_minute < -INT16_MAX)
+    per_minute = -INT16_MAX;
+  slope->slope = per_minute;
+  slope->value = sy / n + sxy * (n - 1) / sxx;
+}
+
+bool
+slope_valid(const slope_t *slope)
+{
+  return slope->count >= SLOPE_MIN_SAMPLES;
+}
+
+// 0.1 °C per minute, 0 without an estimate
+int16_t
+slope_per_minute(const slope_t *slope)
+{
+  return slope->slope;
+}
+
+/*
+ * Value expected "seconds" from now if the trend holds.
+ */
+int16_t
+slope_predict(const slope_t *slope, const uint16_t seconds)
+{
+  int32_t value = slope->value + (int32_t)slope->slope * seconds / 60;
+
+  if (value > INT16_MAX)
+    value = INT16_MAX;
+  else if (value < INT16_MIN)
+    value = INT16_MIN;
+  return value;
+}
+
+/*
+ * Seconds before the value rises to "target", 0 if already above, or
+ * SLOPE_ETA_NONE if it does not rise or the estimate is not valid.
+ */
+uint16_t
+slope_eta(const slope_t *slope, const int16_t target)
+{
+  if (!slope_valid(slope))
+    return SLOPE_ETA_NONE;
+  if (slope->value >= target)
+    return 0;
+  if (slope->slope <= 0)
+    return SLOPE_ETA_NONE;
+
+  const int32_t eta = ((int32_t)target - slope->value) * 60 / slope->slope;
+  return (eta >= SLOPE_ETA_NONE) ? SLOPE_ETA_NONE - 1 : eta;
+}
@@ -0,0 +1,40 @@
+#ifndef __SLOPE_H__
+#define __SLOPE_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// slope_process() call period
+#define SLOPE_PERIOD_MS		1000
+
+// Samples in the least squares window, and before any estimate
+#define SLOPE_WINDOW		32
+#define SLOPE_MIN_SAMPLES	8
+
+// slope_eta() when the target is not being approached
+#define SLOPE_ETA_NONE		UINT16_MAX
+
+/*
+ * Trend of a sampled value (0.1 °C): least squares line over the last
+ * SLOPE_WINDOW samples, in fixed point.  The fitted value at the
+ * newest sample is less noisy than the sample itself, predictions start
+ * from it.
+ */
+typedef struct {
+  // State
+  int16_t window[SLOPE_WINDOW];
+  uint8_t index;
+  uint8_t count;
+  // Estimate, valid once SLOPE_MIN_SAMPLES were fed
+  int16_t slope;	// 0.1 °C per minute
+  int16_t value;	// 0.1 °C
+} slope_t;
+
+void slope_reset(slope_t *slope);
+void slope_process(slope_t *slope, const int16_t sample);
+bool slope_valid(const slope_t *slope);
+int16_t slope_per_minute(const slope_t *slope);
+int16_t slope_predict(const slope_t *slope, const uint16_t seconds);
+uint16_t slope_eta(const slope_t *slope, const int16_t target);
+
+#endif	/* __SLOPE_H__ */
@@ -0,0 +1,117 @@
+#include "telemetry.h"
+
+#include <util/crc16.h>
+
+#include "scheduler.h"
+#include "uart.h"
+
+#define TELEMETRY_PERIOD_MS	(1000 / TELEMETRY_MAX_HZ)
+
+static telemetry_sample_fct _telemetry_sample = 0;
+static uint8_t _telemetry_divider = 0;	// 0: stopped
+static uint8_t _telemetry_countdown = 1;
+static uint16_t _telemetry_sequence = 0;
+static uint16_t _telemetry_dropped = 0;
+
+static void telemetry_process(void);
+
+void
+telemetry_init(telemetry_sample_fct fct)
+{
+  _telemetry_sample = fct;
+  scheduler_add_hook_fct(telemetry_process, TELEMETRY_PERIOD_MS, SCHEDULER_CONTEXT_MAIN);
+}
+
+/*
+ * Frames per second, rounded to a divisor of TELEMETRY_MAX_HZ, 0 stops
+ * the stream.
+ */
+void
+telemetry_set_rate(const uint8_t hz)
+{
+  if (hz == 0) {
+    _telemetry_divider = 0;
+    return;
+  }
+  _telemetry_divider = (hz >= TELEMETRY_MAX_HZ) ? 1 : TELEMETRY_MAX_HZ / hz;
+  _telemetry_countdown = 1;
+}
+
+uint8_t
+telemetry_rate(void)
+{
+  return (_telemetry_divider == 0) ? 0 : TELEMETRY_MAX_HZ / _telemetry_divider;
+}
+
+// Frames not sent because the UART transmit buffer was full
+uint16_t
+telemetry_dropped(void)
+{
+  return _telemetry_dropped;
+}
+
+/*
+ * COBS: each zero byte of "in" is replaced by the distance to the next
+ * one, the first distance being prepended.  "out" holds len + 1 bytes,
+ * "len" is below 254.
+ */
+static void
+_telemetry_cobs(uint8_t *out, const uint8_t *in, const uint8_t len)
+{
+  uint8_t code = 0;	// index of the pending distance
+
+  for (uint8_t i = 0; i < len; i++) {
+    if (in[i] == 0) {
+      out[code] = i + 1 - code;
+      code = i + 1;
+    } else {
+      out[i + 1] = in[i];
+    }
+  }
+  out[code] = len + 1 - code;
+}
+
+static void
+telemetry_process(void)
+{
+  telemetry_sample_t sample;
+  uint8_t payload[TELEMETRY_STATE_SIZE + 2];
+  uint8_t frame[TELEMETRY_FRAME_MAX];
+
+  if ((_telemetry_divider == 0) || (--_telemetry_countdown != 0))
+    return;
+  _telemetry_countdown = _telemetry_divider;
+
+  _telemetry_sample(&sample);
+  const uint32_t time = scheduler_millis();
+  const uint16_t sequence = _telemetry_sequence++;
+  payload[0] = TELEMETRY_FRAME_STATE;
+  payload[1] = sequence;
+  payload[2] = sequence >> 8;
+  payload[3] = time;
+  payload[4] = time >> 8;
+  payload[5] = time >> 16;
+  payload[6] = time >> 24;
+  payload[7] = sample.temperature;
+  payload[8] = (uint16_t)sample.temperature >> 8;
+  payload[9] = sample.status;
+  payload[10] = sample.mode;
+  payload[11] = sample.relays;
+  payload[12] = sample.connections;
+  payload[13] = sample.slope;
+  payload[14] = (uint16_t)sample.slope >> 8;
+  payload[15] = sample.eta;
+  payload[16] = sample.eta >> 8;
+
+  uint16_t crc = 0xffff;
+  for (uint8_t i = 0; i < TELEMETRY_STATE_SIZE; i++)
+    crc = _crc_ccitt_update(crc, payload[i]);
+  payload[TELEMETRY_STATE_SIZE] = crc;
+  payload[TELEMETRY_STATE_SIZE + 1] = crc >> 8;
+
+  frame[0] = 0;
+  _telemetry_cobs(frame + 1, payload, sizeof(payload));
+  frame[sizeof(frame) - 1] = 0;
+  if (!uart_write(frame, sizeof(frame)))
+    _telemetry_dropped++;
+}
@@ -0,0 +1,61 @@
+#ifndef __TELEMETRY_H__
+#define __TELEMETRY_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/*
+ * Binary telemetry on the console UART, interleaved with the shell
+ * output.
+ *
+ * Each frame is COBS encoded, so that it holds no zero byte, and sent
+ * between two zero bytes: the leading one resynchronizes the receiver
+ * after text output.  Decoded, a frame is a payload followed by its
+ * CRC-CCITT (_crc_ccitt_update(), 0xffff initial value), little
+ * endian.
+ *
+ * State payload, little endian:
+ *   0  type		uint8, TELEMETRY_FRAME_STATE
+ *   1  sequence	uint16, incremented at each frame, sent or dropped
+ *   3  time		uint32, ms since boot
+ *   7  temperature	int16, oil (0.1 °C)
+ *   9  status		uint8, temperature_status_t
+ *   10 mode		uint8, utophuile_mode_t
+ *   11 relays		uint8, relay_mode(): commands in bits 4-7,
+ *			feedback in bits 0-3
+ *   12 connections	uint8, TELEMETRY_CONNECTION_* set when OK
+ *   13 slope		int16, oil temperature trend (0.1 °C/min)
+ *   15 eta		uint16, seconds to READY, 0xffff if unknown
+ */
+#define TELEMETRY_FRAME_STATE		1
+#define TELEMETRY_STATE_SIZE		17
+
+#define TELEMETRY_CONNECTION_ADS1115	0x01
+#define TELEMETRY_CONNECTION_RELAY	0x02
+
+// Zero, COBS code, payload, CRC, zero
+#define TELEMETRY_FRAME_MAX		(TELEMETRY_STATE_SIZE + 5)
+
+// Frame rates are divisors of TELEMETRY_MAX_HZ
+#define TELEMETRY_MAX_HZ		100
+#define TELEMETRY_DEFAULT_HZ		50
+
+typedef struct {
+  int16_t temperature;
+  uint8_t status;
+  uint8_t mode;
+  uint8_t relays;
+  uint8_t connections;
+  int16_t slope;
+  uint16_t eta;
+} telemetry_sample_t;
+
+// Called to fill each frame, in main context
+typedef void (*telemetry_sample_fct)(telemetry_sample_t *sample);
+
+void telemetry_init(telemetry_sample_fct fct);
+void telemetry_set_rate(const uint8_t hz);
+uint8_t telemetry_rate(void);
+uint16_t telemetry_dropped(void);
+
+#endif	/* __TELEMETRY_H__ */
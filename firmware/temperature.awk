@@ -0,0 +1,45 @@
+# Generate the piecewise linear temperature conversion table from
+# calibration points (see temperature.cal).
+#
+# Each segment gives its first ADC count, its temperature at this count
+# (0.1 °C) and its slope (0.1 °C per count, Q16), so that conversion
+# only needs a multiplication and a shift.
+
+function round(x) {
+  return (x < 0) ? -int(-x + 0.5) : int(x + 0.5)
+}
+
+BEGIN {
+  n = 0
+}
+
+/^[ \t]*(#|$)/ { next }
+
+{
+  if (n > 0 && $1 <= adc[n - 1]) {
+    printf("%s:%d: calibration points must be sorted by ADC counts\n", FILENAME, FNR) > "/dev/stderr"
+    error = 1
+    exit 1
+  }
+  adc[n] = $1
+  t[n] = round($2 * 10)
+  n++
+}
+
+END {
+  if (error)
+    exit 1
+  if (n < 2) {
+    printf("%s: at least two calibration points are needed\n", FILENAME) > "/dev/stderr"
+    exit 1
+  }
+  printf("/* Generated from %s, do not edit */\n\n", FILENAME)
+  printf("#define TEMPERATURE_SEGMENTS_TABLE \\\n")
+  for (i = 0; i < n - 1; i++)
+    printf("  { %d, %d, %dL }%s\n", adc[i], t[i], round((t[i + 1] - t[i]) * 65536 / (adc[i + 1] - adc[i])), (i < n - 2) ? ", \\" : "")
+  printf("\n#define TEMPERATURE_SEGMENTS %d\n", n - 1)
+  printf("#define TEMPERATURE_ADC_MIN %d\n", adc[0])
+  printf("#define TEMPERATURE_ADC_MAX %d\n", adc[n - 1])
+  printf("#define TEMPERATURE_MIN %d\n", t[0])
+  printf("#define TEMPERATURE_MAX %d\n", t[n - 1])
+}
@@ -0,0 +1,51 @@
+#include "temperature.h"
+
+#include <avr/pgmspace.h>
+
+#include "ads1115.h"
+
+// Generated from temperature.cal by temperature.awk
+#include "temperature_table.h"
+
+typedef struct {
+  int16_t adc;		// first ADC count of segment
+  int16_t temperature;	// temperature at first ADC count (0.1 °C)
+  int32_t slope;	// 0.1 °C per ADC count, Q16
+} _temperature_segment_t;
+
+static const _temperature_segment_t _temperature_segments[TEMPERATURE_SEGMENTS] PROGMEM = {
+  TEMPERATURE_SEGMENTS_TABLE
+};
+
+/*
+ * Convert ADS1115 counts "adc" into "temperature" (0.1 °C) following
+ * the sensor calibration curve.
+ *
+ * Out of range conversions are clamped to the first or last
+ * calibration point and reported as such.  ADS1115_ERR_CONNECTION_LOST
+ * is reported as invalid, "temperature" being left untouched.
+ */
+temperature_status_t
+temperature_from_adc(const int16_t adc, int16_t *temperature)
+{
+  if (adc == ADS1115_ERR_CONNECTION_LOST)
+    return TEMPERATURE_INVALID;
+  if (adc < TEMPERATURE_ADC_MIN) {
+    *temperature = TEMPERATURE_MIN;
+    return TEMPERATURE_UNDER_RANGE;
+  }
+  if (adc > TEMPERATURE_ADC_MAX) {
+    *temperature = TEMPERATURE_MAX;
+    return TEMPERATURE_OVER_RANGE;
+  }
+
+  uint8_t n = TEMPERATURE_SEGMENTS - 1;
+  while ((n > 0) && (adc < (int16_t)pgm_read_word(&_temperature_segments[n].adc)))
+    n--;
+
+  const int16_t offset = adc - (int16_t)pgm_read_word(&_temperature_segments[n].adc);
+  const int32_t slope = (int32_t)pgm_read_dword(&_temperature_segments[n].slope);
+  *temperature = (int16_t)pgm_read_word(&_temperature_segments[n].temperature) + (int16_t)((offset * slope + 0x8000) >> 16);
+
+  return TEMPERATURE_OK;
+}
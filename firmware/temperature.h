@@ -0,0 +1,18 @@
+#ifndef __TEMPERATURE_H__
+#define __TEMPERATURE_H__
+
+#include <stdint.h>
+
+// Temperatures are fixed point values, in 0.1 °C
+#define TEMPERATURE_C(c)	((c) * 10)
+
+typedef enum {
+  TEMPERATURE_OK,
+  TEMPERATURE_UNDER_RANGE,	// below first calibration point
+  TEMPERATURE_OVER_RANGE,	// above last calibration point
+  TEMPERATURE_INVALID		// no conversion available
+} temperature_status_t;
+
+temperature_status_t temperature_from_adc(const int16_t adc, int16_t *temperature);
+
+#endif	/* __TEMPERATURE_H__ */
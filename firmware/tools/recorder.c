@@ -0,0 +1,706 @@
+/*
+ * Telemetry recorder: decodes the monitor mode frames (telemetry.h)
+ * from the firmware console, a serial port or the pseudo terminal of
+ * the host build (utophuile-host -p), into a columnar capture file.
+ *
+ *   recorder record [-m Hz] [-b baud] device capture
+ *   recorder info capture
+ *   recorder export [-f s] [-t s] [-c column,...] capture
+ *   recorder query [-f s] [-t s] [-M mode] capture
+ *
+ * Capture file, host byte order: a 64 bytes header, then chunks of
+ * RECORDER_CHUNK_ROWS rows.  In a chunk, each column is an array of
+ * fixed width values, in _recorder_columns order, so that a capture is
+ * mapped in memory and read in place, whatever its length.  The row
+ * count in the header is updated after the row is written: an
+ * interrupted capture stays readable.
+ */
+
+#define _GNU_SOURCE
+
+#include "../telemetry.h"
+
+#include <util/crc16.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <poll.h>
+#include <stddef.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+
+#define RECORDER_MAGIC		"UTRCAP1"
+#define RECORDER_HEADER_SIZE	64
+#define RECORDER_CHUNK_ROWS	4096
+
+// Text on the console is flushed after this long without input
+#define RECORDER_IDLE_MS	100
+
+typedef struct {
+  char magic[8];
+  uint32_t chunk_rows;
+  uint32_t row_size;	// sum of column widths, checks the layout
+  uint64_t rows;
+  uint8_t reserved[RECORDER_HEADER_SIZE - 24];
+} _recorder_header_t;
+
+typedef enum {
+  _RECORDER_HOST_TIME,	// int64, ms since the epoch, at reception
+  _RECORDER_TIME,	// uint32, ms since firmware boot
+  _RECORDER_SEQUENCE,	// uint16
+  _RECORDER_TEMPERATURE,	// int16, 0.1 °C
+  _RECORDER_STATUS,	// uint8, temperature_status_t
+  _RECORDER_MODE,	// uint8, utophuile_mode_t
+  _RECORDER_RELAYS,	// uint8, commands in bits 4-7, feedback in bits 0-3
+  _RECORDER_CONNECTIONS,	// uint8, TELEMETRY_CONNECTION_*
+  _RECORDER_SLOPE,	// int16, 0.1 °C/min
+  _RECORDER_ETA,	// uint16, s
+  _RECORDER_COLUMN_COUNT
+} _recorder_column_id_t;
+
+typedef struct {
+  const char *name;
+  uint8_t width;
+  bool is_signed;
+} _recorder_column_t;
+
+static const _recorder_column_t _recorder_columns[_RECORDER_COLUMN_COUNT] = {
+  [_RECORDER_HOST_TIME] = { "host_time", 8, true },
+  [_RECORDER_TIME] = { "time", 4, false },
+  [_RECORDER_SEQUENCE] = { "sequence", 2, false },
+  [_RECORDER_TEMPERATURE] = { "temperature", 2, true },
+  [_RECORDER_STATUS] = { "status", 1, false },
+  [_RECORDER_MODE] = { "mode", 1, false },
+  [_RECORDER_RELAYS] = { "relays", 1, false },
+  [_RECORDER_CONNECTIONS] = { "connections", 1, false },
+  [_RECORDER_SLOPE] = { "slope", 2, true },
+  [_RECORDER_ETA] = { "eta", 2, false },
+};
+
+static const char *const _recorder_modes[] = {
+  "off", "heating", "ready", "oil", "emergency", "error"
+};
+
+#define RECORDER_MODE_COUNT	(sizeof(_recorder_modes) / sizeof(_recorder_modes[0]))
+
+static volatile sig_atomic_t _recorder_quit = 0;
+
+static void
+usage(void)
+{
+  fprintf(stderr,
+          "usage: recorder record [-m Hz] [-b baud] device capture\n"
+          "       recorder info capture\n"
+          "       recorder export [-f s] [-t s] [-c column,...] capture\n"
+          "       recorder query [-f s] [-t s] [-M mode] capture\n"
+          "  -m Hz        start monitor mode at this rate\n"
+          "  -b baud      serial port speed (default 38400)\n"
+          "  -f s, -t s   rows from/to this time, in s since the first row\n"
+          "  -c columns   exported columns (default all)\n"
+          "  -M mode      only rows in this mode\n"
+          "record appends to the capture, console text goes to stdout, stdin to the\n"
+          "firmware.\n");
+  exit(2);
+}
+
+static size_t
+_recorder_row_size(void)
+{
+  size_t size = 0;
+
+  for (unsigned c = 0; c < _RECORDER_COLUMN_COUNT; c++)
+    size += _recorder_columns[c].width;
+  return size;
+}
+
+// Offset of a value in the file
+static off_t
+_recorder_offset(const uint64_t row, const _recorder_column_id_t column)
+{
+  off_t offset = RECORDER_HEADER_SIZE + (off_t)(row / RECORDER_CHUNK_ROWS) * RECORDER_CHUNK_ROWS * _recorder_row_size();
+
+  for (unsigned c = 0; c < column; c++)
+    offset += (off_t)RECORDER_CHUNK_ROWS * _recorder_columns[c].width;
+  return offset + (off_t)(row % RECORDER_CHUNK_ROWS) * _recorder_columns[column].width;
+}
+
+/*
+ * Capture file
+ */
+typedef struct {
+  int fd;
+  _recorder_header_t header;
+  const uint8_t *map;	// read only mapping, see _recorder_map()
+  size_t map_size;
+} _recorder_capture_t;
+
+static int
+_recorder_open(_recorder_capture_t *capture, const char *path, const bool write)
+{
+  struct stat st;
+
+  capture->map = NULL;
+  capture->fd = open(path, write ? (O_RDWR | O_CREAT) : O_RDONLY, 0644);
+  if ((capture->fd < 0) || (fstat(capture->fd, &st) != 0)) {
+    perror(path);
+    return -1;
+  }
+  if (st.st_size == 0) {
+    if (!write) {
+      fprintf(stderr, "%s: empty capture\n", path);
+      return -1;
+    }
+    memset(&capture->header, 0, sizeof(capture->header));
+    memcpy(capture->header.magic, RECORDER_MAGIC, sizeof(capture->header.magic));
+    capture->header.chunk_rows = RECORDER_CHUNK_ROWS;
+    capture->header.row_size = _recorder_row_size();
+    if (pwrite(capture->fd, &capture->header, sizeof(capture->header), 0) != sizeof(capture->header)) {
+      perror(path);
+      return -1;
+    }
+    return 0;
+  }
+  if ((pread(capture->fd, &capture->header, sizeof(capture->header), 0) != sizeof(capture->header))
+      || (memcmp(capture->header.magic, RECORDER_MAGIC, sizeof(capture->header.magic)) != 0)
+      || (capture->header.chunk_rows != RECORDER_CHUNK_ROWS)
+      || (capture->header.row_size != _recorder_row_size())) {
+    fprintf(stderr, "%s: not a capture file\n", path);
+    return -1;
+  }
+  return 0;
+}
+
+/*
+ * Map the whole capture: columns are then read in place.
+ */
+static int
+_recorder_map(_recorder_capture_t *capture, const char *path)
+{
+  if (capture->header.rows == 0)
+    return 0;
+  capture->map_size = _recorder_offset(capture->header.rows - 1, _RECORDER_COLUMN_COUNT - 1) + _recorder_columns[_RECORDER_COLUMN_COUNT - 1].width;
+  capture->map = mmap(NULL, capture->map_size, PROT_READ, MAP_SHARED, capture->fd, 0);
+  if (capture->map == MAP_FAILED) {
+    capture->map = NULL;
+    perror(path);
+    return -1;
+  }
+  return 0;
+}
+
+static int64_t
+_recorder_get(const _recorder_capture_t *capture, const uint64_t row, const _recorder_column_id_t column)
+{
+  const uint8_t *p = capture->map + _recorder_offset(row, column);
+
+  switch (_recorder_columns[column].width) {
+    case 1:
+      return *p;
+    case 2:
+      return _recorder_columns[column].is_signed ? (int64_t)*(const int16_t *)p : (int64_t)*(const uint16_t *)p;
+    case 4:
+      return _recorder_columns[column].is_signed ? (int64_t)*(const int32_t *)p : (int64_t)*(const uint32_t *)p;
+    default:
+      return *(const int64_t *)p;
+  }
+}
+
+/*
+ * Append a row, "values" in column order: the file grows by whole
+ * chunks.
+ */
+static int
+_recorder_append(_recorder_capture_t *capture, const int64_t *values)
+{
+  const uint64_t row = capture->header.rows;
+
+  if ((row % RECORDER_CHUNK_ROWS) == 0) {
+    const off_t end = _recorder_offset(row + RECORDER_CHUNK_ROWS - 1, _RECORDER_COLUMN_COUNT - 1) + _recorder_columns[_RECORDER_COLUMN_COUNT - 1].width;
+    if (ftruncate(capture->fd, end) != 0)
+      return -1;
+  }
+  for (unsigned c = 0; c < _RECORDER_COLUMN_COUNT; c++) {
+    // Little endian host: the low bytes come first
+    if (pwrite(capture->fd, &values[c], _recorder_columns[c].width, _recorder_offset(row, c)) != _recorder_columns[c].width)
+      return -1;
+  }
+  capture->header.rows++;
+  if (pwrite(capture->fd, &capture->header.rows, sizeof(capture->header.rows), offsetof(_recorder_header_t, rows)) != sizeof(capture->header.rows))
+    return -1;
+  return 0;
+}
+
+/*
+ * Frame decoding
+ */
+static int
+_recorder_uncobs(uint8_t *out, const uint8_t *in, const size_t len)
+{
+  size_t i = 0;
+  int n = 0;
+
+  while (i < len) {
+    const uint8_t code = in[i++];
+    if ((code == 0) || (i + code - 1 > len))
+      return -1;
+    for (uint8_t k = 1; k < code; k++)
+      out[n++] = in[i++];
+    if ((code < 0xff) && (i < len))
+      out[n++] = 0;
+  }
+  return n;
+}
+
+static uint16_t
+_recorder_le16(const uint8_t *p)
+{
+  return p[0] | ((uint16_t)p[1] << 8);
+}
+
+// State frame into row values, false if "in" is not one
+static bool
+_recorder_decode(const uint8_t *in, const size_t len, int64_t *values)
+{
+  uint8_t payload[TELEMETRY_FRAME_MAX];
+  uint16_t crc = 0xffff;
+
+  if ((len > sizeof(payload)) || (_recorder_uncobs(payload, in, len) != TELEMETRY_STATE_SIZE + 2)
+      || (payload[0] != TELEMETRY_FRAME_STATE))
+    return false;
+  for (unsigned i = 0; i < TELEMETRY_STATE_SIZE; i++)
+    crc = _crc_ccitt_update(crc, payload[i]);
+  if (crc != _recorder_le16(payload + TELEMETRY_STATE_SIZE))
+    return false;
+
+  struct timespec ts;
+  clock_gettime(CLOCK_REALTIME, &ts);
+  values[_RECORDER_HOST_TIME] = (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+  values[_RECORDER_SEQUENCE] = _recorder_le16(payload + 1);
+  values[_RECORDER_TIME] = _recorder_le16(payload + 3) | ((uint32_t)_recorder_le16(payload + 5) << 16);
+  values[_RECORDER_TEMPERATURE] = (int16_t)_recorder_le16(payload + 7);
+  values[_RECORDER_STATUS] = payload[9];
+  values[_RECORDER_MODE] = payload[10];
+  values[_RECORDER_RELAYS] = payload[11];
+  values[_RECORDER_CONNECTIONS] = payload[12];
+  values[_RECORDER_SLOPE] = (int16_t)_recorder_le16(payload + 13);
+  values[_RECORDER_ETA] = _recorder_le16(payload + 15);
+  return true;
+}
+
+static void
+_recorder_signal(int sig)
+{
+  (void)sig;
+  _recorder_quit = 1;
+}
+
+static speed_t
+_recorder_speed(const long baud)
+{
+  switch (baud) {
+    case 9600:
+      return B9600;
+    case 19200:
+      return B19200;
+    case 57600:
+      return B57600;
+    case 115200:
+      return B115200;
+    default:
+      return B38400;
+  }
+}
+
+static void
+_recorder_text(const uint8_t *buf, const size_t len)
+{
+  if (len != 0)
+    fwrite(buf, 1, len, stdout);
+  fflush(stdout);
+}
+
+static int
+_recorder_record(int argc, char *argv[])
+{
+  long baud = 38400;
+  int monitor = -1;
+  int opt;
+
+  while ((opt = getopt(argc, argv, "m:b:")) != -1) {
+    switch (opt) {
+      case 'm':
+        monitor = atoi(optarg);
+        break;
+      case 'b':
+        baud = atol(optarg);
+        break;
+      default:
+        usage();
+    }
+  }
+  if (optind + 2 != argc)
+    usage();
+
+  const char *device = argv[optind];
+  _recorder_capture_t capture;
+  if (_recorder_open(&capture, argv[optind + 1], true) != 0)
+    return 1;
+  const int fd = open(device, O_RDWR | O_NOCTTY);
+  if (fd < 0) {
+    perror(device);
+    return 1;
+  }
+  struct termios t;
+  if (tcgetattr(fd, &t) == 0) {
+    cfmakeraw(&t);
+    cfsetspeed(&t, _recorder_speed(baud));
+    tcsetattr(fd, TCSANOW, &t);
+  }
+
+  signal(SIGINT, _recorder_signal);
+  signal(SIGTERM, _recorder_signal);
+  if (monitor >= 0)
+    dprintf(fd, "monitor %d\r", monitor);
+
+  // Bytes since the last zero: a frame, or console text
+  uint8_t buf[256];
+  size_t len = 0;
+  uint64_t frames = 0;
+  struct pollfd pfd[2] = { { fd, POLLIN, 0 }, { STDIN_FILENO, POLLIN, 0 } };
+  int64_t values[_RECORDER_COLUMN_COUNT];
+
+  while (!_recorder_quit) {
+    const int n = poll(pfd, (pfd[1].fd >= 0) ? 2 : 1, RECORDER_IDLE_MS);
+    if (n < 0) {
+      if (errno == EINTR)
+        continue;
+      perror("poll");
+      break;
+    }
+    if (n == 0) {
+      _recorder_text(buf, len);
+      len = 0;
+      continue;
+    }
+    if ((pfd[1].fd >= 0) && (pfd[1].revents != 0)) {
+      char line[256];
+      const ssize_t r = read(STDIN_FILENO, line, sizeof(line));
+      if (r <= 0)
+        pfd[1].fd = -1;
+      // The shell ends lines with CR, as a terminal would
+      for (ssize_t i = 0; i < r; i++) {
+        if (line[i] == '\n')
+          line[i] = '\r';
+      }
+      if ((r > 0) && (write(fd, line, r) != r))
+        perror(device);
+    }
+    if (pfd[0].revents == 0)
+      continue;
+
+    uint8_t in[512];
+    const ssize_t r = read(fd, in, sizeof(in));
+    if (r <= 0) {
+      if ((r < 0) && ((errno == EINTR) || (errno == EAGAIN)))
+        continue;
+      break;
+    }
+    for (ssize_t i = 0; i < r; i++) {
+      if (in[i] != 0) {
+        if (len == sizeof(buf)) {
+          _recorder_text(buf, len);
+          len = 0;
+        }
+        buf[len++] = in[i];
+        continue;
+      }
+      if (len == 0)
+        continue;
+      if (_recorder_decode(buf, len, values)) {
+        if (_recorder_append(&capture, values) != 0) {
+          perror(argv[optind + 1]);
+          return 1;
+        }
+        frames++;
+      } else {
+        _recorder_text(buf, len);
+      }
+      len = 0;
+    }
+  }
+
+  if (monitor >= 0)
+    dprintf(fd, "monitor 0\r");
+  fprintf(stderr, "%" PRIu64 " frames recorded, %" PRIu64 " rows in capture\n", frames, capture.header.rows);
+  return 0;
+}
+
+/*
+ * Rows between "from" and "to" (s since the first row): host times are
+ * increasing, found by binary search.
+ */
+static uint64_t
+_recorder_find(const _recorder_capture_t *capture, const double seconds)
+{
+  const int64_t date = _recorder_get(capture, 0, _RECORDER_HOST_TIME) + (int64_t)(seconds * 1000);
+  uint64_t low = 0;
+  uint64_t high = capture->header.rows;
+
+  while (low < high) {
+    const uint64_t mid = low + (high - low) / 2;
+    if (_recorder_get(capture, mid, _RECORDER_HOST_TIME) < date)
+      low = mid + 1;
+    else
+      high = mid;
+  }
+  return low;
+}
+
+static int
+_recorder_load(_recorder_capture_t *capture, const char *path)
+{
+  if ((_recorder_open(capture, path, false) != 0) || (_recorder_map(capture, path) != 0))
+    return -1;
+  return 0;
+}
+
+static int
+_recorder_info(int argc, char *argv[])
+{
+  _recorder_capture_t capture;
+
+  if (argc != 2)
+    usage();
+  if (_recorder_load(&capture, argv[1]) != 0)
+    return 1;
+
+  const uint64_t rows = capture.header.rows;
+  printf("rows %" PRIu64 "\n", rows);
+  for (unsigned c = 0; c < _RECORDER_COLUMN_COUNT; c++)
+    printf("column %s %s%u\n", _recorder_columns[c].name, _recorder_columns[c].is_signed ? "int" : "uint", _recorder_columns[c].width * 8);
+  if (rows == 0)
+    return 0;
+  const int64_t first = _recorder_get(&capture, 0, _RECORDER_HOST_TIME);
+  const int64_t last = _recorder_get(&capture, rows - 1, _RECORDER_HOST_TIME);
+  const time_t start = first / 1000;
+  char date[32];
+  strftime(date, sizeof(date), "%Y-%m-%d %H:%M:%S", localtime(&start));
+  printf("start %s\n", date);
+  printf("duration_s %.1f\n", (double)(last - first) / 1000);
+  printf("rate_hz %.1f\n", (last > first) ? (double)(rows - 1) * 1000 / (last - first) : 0);
+
+  // Sequence gaps are frames dropped by the firmware or lost on the link
+  uint64_t lost = 0;
+  for (uint64_t r = 1; r < rows; r++) {
+    const uint16_t gap = _recorder_get(&capture, r, _RECORDER_SEQUENCE) - _recorder_get(&capture, r - 1, _RECORDER_SEQUENCE) - 1;
+    if (gap < 1000)
+      lost += gap;
+  }
+  printf("lost %" PRIu64 "\n", lost);
+  return 0;
+}
+
+static void
+_recorder_print(const _recorder_capture_t *capture, const uint64_t row, const _recorder_column_id_t column)
+{
+  const int64_t v = _recorder_get(capture, row, column);
+
+  switch (column) {
+    case _RECORDER_TEMPERATURE:
+    case _RECORDER_SLOPE:
+      printf("%s%" PRId64 ".%" PRId64, (v < 0) ? "-" : "", ((v < 0) ? -v : v) / 10, ((v < 0) ? -v : v) % 10);
+      break;
+    case _RECORDER_MODE:
+      printf("%s", (v < (int64_t)RECORDER_MODE_COUNT) ? _recorder_modes[v] : "?");
+      break;
+    case _RECORDER_RELAYS:
+    case _RECORDER_CONNECTIONS:
+      printf("0x%02" PRIx64, v);
+      break;
+    default:
+      printf("%" PRId64, v);
+      break;
+  }
+}
+
+static int
+_recorder_export(int argc, char *argv[])
+{
+  double from = 0;
+  double to = -1;
+  bool selected[_RECORDER_COLUMN_COUNT];
+  int opt;
+
+  for (unsigned c = 0; c < _RECORDER_COLUMN_COUNT; c++)
+    selected[c] = true;
+  while ((opt = getopt(argc, argv, "f:t:c:")) != -1) {
+    switch (opt) {
+      case 'f':
+        from = atof(optarg);
+        break;
+      case 't':
+        to = atof(optarg);
+        break;
+      case 'c':
+        memset(selected, 0, sizeof(selected));
+        for (char *name = strtok(optarg, ","); name != NULL; name = strtok(NULL, ",")) {
+          unsigned c = 0;
+          while ((c < _RECORDER_COLUMN_COUNT) && (strcmp(name, _recorder_columns[c].name) != 0))
+            c++;
+          if (c == _RECORDER_COLUMN_COUNT) {
+            fprintf(stderr, "%s: unknown column\n", name);
+            return 2;
+          }
+          selected[c] = true;
+        }
+        break;
+      default:
+        usage();
+    }
+  }
+  if (optind + 1 != argc)
+    usage();
+
+  _recorder_capture_t capture;
+  if (_recorder_load(&capture, argv[optind]) != 0)
+    return 1;
+
+  const char *sep = "";
+  for (unsigned c = 0; c < _RECORDER_COLUMN_COUNT; c++) {
+    if (selected[c]) {
+      printf("%s%s", sep, _recorder_columns[c].name);
+      sep = ",";
+    }
+  }
+  printf("\n");
+  if (capture.header.rows == 0)
+    return 0;
+
+  const uint64_t end = (to < 0) ? capture.header.rows : _recorder_find(&capture, to);
+  for (uint64_t r = _recorder_find(&capture, from); r < end; r++) {
+    sep = "";
+    for (unsigned c = 0; c < _RECORDER_COLUMN_COUNT; c++) {
+      if (selected[c]) {
+        printf("%s", sep);
+        _recorder_print(&capture, r, c);
+        sep = ",";
+      }
+    }
+    printf("\n");
+  }
+  return 0;
+}
+
+/*
+ * Statistics over a time range, one "name value" line each: row count,
+ * temperature extremes and mean, time spent in each mode, relay
+ * switches and rows with a relay feedback disagreeing with its command.
+ */
+static int
+_recorder_query(int argc, char *argv[])
+{
+  double from = 0;
+  double to = -1;
+  int mode = -1;
+  int opt;
+
+  while ((opt = getopt(argc, argv, "f:t:M:")) != -1) {
+    switch (opt) {
+      case 'f':
+        from = atof(optarg);
+        break;
+      case 't':
+        to = atof(optarg);
+        break;
+      case 'M':
+        for (mode = 0; (mode < (int)RECORDER_MODE_COUNT) && (strcmp(optarg, _recorder_modes[mode]) != 0); mode++)
+          ;
+        if (mode == (int)RECORDER_MODE_COUNT) {
+          fprintf(stderr, "%s: unknown mode\n", optarg);
+          return 2;
+        }
+        break;
+      default:
+        usage();
+    }
+  }
+  if (optind + 1 != argc)
+    usage();
+
+  _recorder_capture_t capture;
+  if (_recorder_load(&capture, argv[optind]) != 0)
+    return 1;
+
+  uint64_t rows = 0;
+  int64_t min = INT64_MAX;
+  int64_t max = INT64_MIN;
+  int64_t sum = 0;
+  double mode_s[RECORDER_MODE_COUNT] = { 0 };
+  uint64_t switches = 0;
+  uint64_t mismatches = 0;
+  if (capture.header.rows != 0) {
+    const uint64_t end = (to < 0) ? capture.header.rows : _recorder_find(&capture, to);
+    for (uint64_t r = _recorder_find(&capture, from); r < end; r++) {
+      const int64_t m = _recorder_get(&capture, r, _RECORDER_MODE);
+      if ((mode >= 0) && (m != mode))
+        continue;
+      const int64_t t = _recorder_get(&capture, r, _RECORDER_TEMPERATURE);
+      const int64_t relays = _recorder_get(&capture, r, _RECORDER_RELAYS);
+      rows++;
+      sum += t;
+      min = (t < min) ? t : min;
+      max = (t > max) ? t : max;
+      if (((relays >> 4) ^ relays) & 0x0f)
+        mismatches++;
+      if (r + 1 < capture.header.rows) {
+        const double dt = (double)(_recorder_get(&capture, r + 1, _RECORDER_HOST_TIME) - _recorder_get(&capture, r, _RECORDER_HOST_TIME)) / 1000;
+        if (m < (int64_t)RECORDER_MODE_COUNT)
+          mode_s[m] += dt;
+        const int64_t next = _recorder_get(&capture, r + 1, _RECORDER_RELAYS);
+        for (int64_t changed = (next ^ relays) & 0xf0; changed != 0; changed &= changed - 1)
+          switches++;
+      }
+    }
+  }
+
+  printf("rows %" PRIu64 "\n", rows);
+  if (rows != 0) {
+    printf("temperature_min %.1f\n", (double)min / 10);
+    printf("temperature_max %.1f\n", (double)max / 10);
+    printf("temperature_mean %.2f\n", (double)sum / 10 / rows);
+  }
+  for (unsigned m = 0; m < RECORDER_MODE_COUNT; m++)
+    printf("%s_s %.1f\n", _recorder_modes[m], mode_s[m]);
+  printf("relay_switches %" PRIu64 "\n", switches);
+  printf("feedback_mismatches %" PRIu64 "\n", mismatches);
+  return 0;
+}
+
+int
+main(int argc, char *argv[])
+{
+  if (argc < 2)
+    usage();
+  argc--;
+  argv++;
+  if (strcmp(argv[0], "record") == 0)
+    return _recorder_record(argc, argv);
+  if (strcmp(argv[0], "info") == 0)
+    return _recorder_info(argc, argv);
+  if (strcmp(argv[0], "export") == 0)
+    return _recorder_export(argc, argv);
+  if (strcmp(argv[0], "query") == 0)
+    return _recorder_query(argc, argv);
+  usage();
+  return 2;
+}
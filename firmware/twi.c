@@ -1,9 +1,8 @@
 #include "twi.h"
 
-#include <avr/io.h>
-#include <util/twi.h>		/* Note [1] */
+#include <stddef.h>
 
-#include <stdio.h>
+#include "hal.h"
 
 /*
  * Maximal number of iterations to wait for a device to respond for a
@@ -17,16 +16,6 @@
  */
 #define MAX_ITER	200
 
-/*
- * Number of bytes that can be written in a row, see comments for
- * ee24xx_write_page() below.  Some vendor's devices would accept 16,
- * but 8 seems to be the lowest common denominator.
- *
- * Note that the page size must be a power of two, this simplifies the
- * page boundary calculations below.
- */
-#define PAGE_SIZE 8
-
 /*
  * Saved TWI status register, for error messages only.  We need to
  * save it in a variable, since the datasheet only guarantees the TWSR
@@ -34,257 +23,188 @@
  */
 uint8_t twst;
 
-#define TWI_PORT PORTC
-#define SCL	PC5 	// Arduino Analog Input 5
-#define SDA	PC4 	// Arduino Analog Input 4
+/*
+ * Pending transactions, the one at _twi_queue_tail is on the bus.
+ */
+static twi_transaction_t *volatile _twi_queue[TWI_QUEUE_SIZE];
+static volatile uint8_t _twi_queue_head = 0;
+static volatile uint8_t _twi_queue_tail = 0;
+static volatile uint8_t _twi_queue_count = 0;
+
+// Progress of the transaction on the bus
+static uint8_t _twi_index;
+static uint8_t _twi_iter;
+static uint8_t _twi_reading;
 
 void
 twi_init(void)
 {
-  TWI_PORT |= _BV(SCL) | _BV(SDA);
+  /* 100 kHz clock, internal pull ups */
+  hal_twi_init();
+}
 
-  /* initialize TWI clock: 100 kHz clock, TWPS = 0 => prescaler = 1 */
-#if defined(TWPS0)
-  /* has prescaler (mega128 & newer) */
-  TWSR = 0;
-#endif
+/*
+ * Begin the transaction at the queue tail, from scratch: send a start
+ * condition, after a stop condition if "stop" is set.
+ */
+static void
+_twi_begin(const bool stop)
+{
+  _twi_index = 0;
+  _twi_reading = (_twi_queue[_twi_queue_tail]->write_len == 0);
+  if (stop)
+    hal_twi_stop_start();
+  else
+    hal_twi_start();
+}
+
+/*
+ * Release the bus, report "status" to the owner of the current
+ * transaction, and chain the next one if any (a start condition
+ * following the stop condition is generated by the hardware).
+ */
+static void
+_twi_complete(int8_t status)
+{
+  twi_transaction_t *t = _twi_queue[_twi_queue_tail];
+
+  _twi_queue_tail = (_twi_queue_tail + 1) % TWI_QUEUE_SIZE;
+  _twi_queue_count--;
+  _twi_iter = 0;
+
+  if (_twi_queue_count != 0) {
+    _twi_begin(true);
+  } else {
+    hal_twi_stop();
+  }
 
-#if F_CPU < 3600000UL
-  TWBR = 10;			/* smallest TWBR value, see note [5] */
-#else
-  TWBR = (F_CPU / 100000UL - 16) / 2;
-#endif
+  t->status = status;
+  if (t->callback != NULL)
+    t->callback(t);
 }
 
 /*
  * Note [7]
  *
- * Read "len" bytes from EEPROM starting at "eeaddr" into "buf".
+ * Bus state machine, a transaction is made of up to two bus cycles:
+ * during the first one, the device is selected in master transmitter
+ * mode and "write_len" bytes are transfered.  The second one
+ * reselects the device (repeated start condition, going into master
+ * receiver mode) and transfers "read_len" bytes from the device to the
+ * TWI master.  Multiple bytes are transfered by ACKing the client's
+ * transfer, the last one is NACKed, which the client will take as an
+ * indication to not initiate further transfers.
  *
- * This requires two bus cycles: during the first cycle, the device
- * will be selected (master transmitter mode), and the address
- * transfered.  Address bits exceeding 256 are transfered in the
- * E2/E1/E0 bits (subaddress bits) of the device selector.
- *
- * The second bus cycle will reselect the device (repeated start
- * condition, going into master receiver mode), and transfer the data
- * from the device to the TWI master.  Multiple bytes can be
- * transfered by ACKing the client's transfer.  The last transfer will
- * be NACKed, which the client will take as an indication to not
- * initiate further transfers.
+ * A device NACKing its selection (busy) is selected again, up to
+ * MAX_ITER times.
  */
-int
-twi_read_bytes(uint8_t addr, int len, uint8_t *buf)
+ISR(TWI_vect)
 {
-  uint8_t twcr, n = 0;
-  int rv = 0;
+  twi_transaction_t *t = _twi_queue[_twi_queue_tail];
 
-  /*
-   * Note [8]
-   * First cycle: master transmitter mode
-   */
-restart:
-  if (n++ >= MAX_ITER)
-    return -1;
-begin:
-  TWCR = _BV(TWINT) | _BV(TWSTA) | _BV(TWEN);          /* send start condition */
-  while ((TWCR & _BV(TWINT)) == 0) ;        /* wait for transmission */
-  switch ((twst = TW_STATUS)) {
-    case TW_REP_START:		/* OK, but should not happen */
+  switch ((twst = hal_twi_status())) {
     case TW_START:
+    case TW_REP_START:
+      /* Note [10] */
+      hal_twi_write(t->addr | (_twi_reading ? TW_READ : TW_WRITE));
+      hal_twi_next(false);
       break;
 
-    case TW_MT_ARB_LOST:	/* Note [9] */
-      goto begin;
-
-    default:
-      return -1;		/* error: not in start condition */
-      /* NB: do /not/ send stop condition */
-  }
-
-  /* Note [10] */
-  /* send SLA+W */
-  TWDR = addr | TW_WRITE;
-  TWCR = _BV(TWINT) | _BV(TWEN);       /* clear interrupt to start transmission */
-  while ((TWCR & _BV(TWINT)) == 0) ;        /* wait for transmission */
-  switch ((twst = TW_STATUS)) {
     case TW_MT_SLA_ACK:
+    case TW_MT_DATA_ACK:
+      if (_twi_index < t->write_len) {
+        hal_twi_write(t->write_buf[_twi_index++]);
+        hal_twi_next(false);
+      } else if (t->read_len != 0) {
+        /* Note [12] */
+        _twi_index = 0;
+        _twi_reading = 1;
+        hal_twi_start();	/* send repeated start condition */
+      } else {
+        _twi_complete(TWI_OK);
+      }
       break;
 
-    case TW_MT_SLA_NACK:	/* nack during select: device busy writing */
-      /* Note [11] */
-      goto restart;
-
-    case TW_MT_ARB_LOST:	/* re-arbitrate */
-      goto begin;
-
-    default:
-      goto error;		/* must send stop condition */
-  }
-
-  /*
-   * Note [12]
-   * Next cycle(s): master receiver mode
-   */
-  TWCR = _BV(TWINT) | _BV(TWSTA) | _BV(TWEN);          /* send (rep.) start condition */
-  while ((TWCR & _BV(TWINT)) == 0) ;        /* wait for transmission */
-  switch ((twst = TW_STATUS)) {
-    case TW_START:		/* OK, but should not happen */
-    case TW_REP_START:
+    case TW_MT_DATA_NACK:	/* device write protected -- Note [16] */
+      _twi_complete(TWI_ERR_DEVICE_WRITE_PROTECTED);
       break;
 
-    case TW_MT_ARB_LOST:
-      goto begin;
+    case TW_MT_SLA_NACK:	/* nack during select: device busy -- Note [11] */
+    case TW_MR_SLA_NACK:
+      if (++_twi_iter >= MAX_ITER) {
+        _twi_complete(TWI_ERR_MAX_ITER);
+      } else {
+        _twi_begin(true);
+      }
+      break;
 
-    default:
-      goto error;
-  }
+    case TW_MT_ARB_LOST:	/* re-arbitrate -- Note [9] */
+      _twi_begin(false);
+      break;
 
-  /* send SLA+R */
-  TWDR = addr | TW_READ;
-  TWCR = _BV(TWINT) | _BV(TWEN);       /* clear interrupt to start transmission */
-  while ((TWCR & _BV(TWINT)) == 0) ;        /* wait for transmission */
-  switch ((twst = TW_STATUS)) {
     case TW_MR_SLA_ACK:
+      /* Note [13] */
+      hal_twi_next(t->read_len > 1);
       break;
 
-    case TW_MR_SLA_NACK:
-      goto quit;
+    case TW_MR_DATA_ACK:
+      t->read_buf[_twi_index++] = hal_twi_read();
+      hal_twi_next(_twi_index + 1 < t->read_len);
+      break;
 
-    case TW_MR_ARB_LOST:
-      goto begin;
+    case TW_MR_DATA_NACK:
+      t->read_buf[_twi_index++] = hal_twi_read();
+      /* Note [14] */
+      _twi_complete(TWI_OK);
+      break;
 
     default:
-      goto error;
-  }
-
-  for (twcr = _BV(TWINT) | _BV(TWEN) | _BV(TWEA) /* Note [13] */;
-       len > 0;
-       len--) {
-    if (len == 1)
-      twcr = _BV(TWINT) | _BV(TWEN);       /* send NAK this time */
-    TWCR = twcr;		/* clear int to start transmission */
-    while ((TWCR & _BV(TWINT)) == 0) ;        /* wait for transmission */
-    switch ((twst = TW_STATUS)) {
-      case TW_MR_DATA_NACK:
-        len = 0;		/* force end of loop */
-        /* FALLTHROUGH */
-      case TW_MR_DATA_ACK:
-        *buf++ = TWDR;
-        rv++;
-        break;
-
-      default:
-        goto error;
-    }
+      _twi_complete(TWI_ERR_MUST_SEND_STOP);
+      break;
   }
-quit:
-  /* Note [14] */
-  TWCR = _BV(TWINT) | _BV(TWSTO) | _BV(TWEN);          /* send stop condition */
-
-  return rv;
-
-error:
-  rv = -1;
-  goto quit;
 }
 
 /*
- * Write "len" bytes into EEPROM starting at "eeaddr" from "buf".
+ * Queue "transaction" for execution, and return immediately.
  *
- * This is a bit simpler than the previous function since both, the
- * address and the data bytes will be transfered in master transmitter
- * mode, thus no reselection of the device is necessary.  However, the
- * EEPROMs are only capable of writing one "page" simultaneously, so
- * care must be taken to not cross a page boundary within one write
- * cycle.  The amount of data one page consists of varies from
- * manufacturer to manufacturer: some vendors only use 8-byte pages
- * for the smaller devices, and 16-byte pages for the larger devices,
- * while other vendors generally use 16-byte pages.  We thus use the
- * smallest common denominator of 8 bytes per page, declared by the
- * macro PAGE_SIZE above.
- *
- * The function simply returns after writing one page, returning the
- * actual number of data byte written.  It is up to the caller to
- * re-invoke it in order to write further data.
+ * The transaction is started at once if the bus is idle.  Its status
+ * is TWI_PENDING until completion, then TWI_OK or one of the
+ * TWI_ERR_* error codes.  Returns TWI_ERR_EMPTY if there is nothing
+ * to transfer, TWI_ERR_QUEUE_FULL if the transaction cannot be queued,
+ * TWI_OK otherwise.
  */
-
-#define TWI_ERR_UNKNOWN -1
-#define TWI_ERR_NOT_IN_START -2
-#define TWI_ERR_MAX_ITER -3
-#define TWI_ERR_MUST_SEND_STOP -4
-#define TWI_ERR_DEVICE_WRITE_PROTECTED -5
-int
-twi_write_bytes(uint8_t addr, int len, uint8_t *buf)
+int8_t
+twi_submit(twi_transaction_t *transaction)
 {
-  uint8_t n = 0;
-  int rv = 0;
-
-restart:
-  if (n++ >= MAX_ITER)
-    return TWI_ERR_MAX_ITER;
-begin:
-
-  /* Note [15] */
-  TWCR = _BV(TWINT) | _BV(TWSTA) | _BV(TWEN);          /* send start condition */
-  while ((TWCR & _BV(TWINT)) == 0) ;        /* wait for transmission */
-  switch ((twst = TW_STATUS)) {
-    case TW_REP_START:		/* OK, but should not happen */
-    case TW_START:
-      break;
-
-    case TW_MT_ARB_LOST:
-      goto begin;
-
-    default:
-      return TWI_ERR_NOT_IN_START;		/* error: not in start condition */
-      /* NB: do /not/ send stop condition */
-  }
-
-  /* send SLA+W */
-  TWDR = addr | TW_WRITE;
-  TWCR = _BV(TWINT) | _BV(TWEN);       /* clear interrupt to start transmission */
-  while ((TWCR & _BV(TWINT)) == 0) ;        /* wait for transmission */
-  switch ((twst = TW_STATUS)) {
-    case TW_MT_SLA_ACK:
-      break;
-
-    case TW_MT_SLA_NACK:	/* nack during select: device busy writing */
-      goto restart;
-
-    case TW_MT_ARB_LOST:	/* re-arbitrate */
-      goto begin;
-
-    default:
-      rv = TWI_ERR_MUST_SEND_STOP;
-      goto error;		/* must send stop condition */
-  }
-
-  for (; len > 0; len--) {
-    TWDR = *buf++;
-    TWCR = _BV(TWINT) | _BV(TWEN);       /* start transmission */
-    while ((TWCR & _BV(TWINT)) == 0) ;        /* wait for transmission */
-    switch ((twst = TW_STATUS)) {
-      case TW_MT_DATA_NACK:
-        rv = TWI_ERR_DEVICE_WRITE_PROTECTED;
-        goto error;		/* device write protected -- Note [16] */
-
-      case TW_MT_DATA_ACK:
-        rv++;
-        break;
-
-      default:
-        goto error;
+  const uint8_t sreg = SREG;
+  int8_t rv = TWI_OK;
+
+  // Would be run in master receiver mode, into a missing buffer
+  if ((transaction->write_len == 0) && (transaction->read_len == 0))
+    return TWI_ERR_EMPTY;
+
+  cli();
+  if (_twi_queue_count == TWI_QUEUE_SIZE) {
+    rv = TWI_ERR_QUEUE_FULL;
+  } else {
+    transaction->status = TWI_PENDING;
+    _twi_queue[_twi_queue_head] = transaction;
+    _twi_queue_head = (_twi_queue_head + 1) % TWI_QUEUE_SIZE;
+    if (_twi_queue_count++ == 0) {
+      /* Bus is idle, send start condition -- Note [8] */
+      _twi_begin(false);
     }
   }
-quit:
-  TWCR = _BV(TWINT) | _BV(TWSTO) | _BV(TWEN);          /* send stop condition */
+  SREG = sreg;
 
   return rv;
-
-error:
-  if (rv == 0) rv = TWI_ERR_UNKNOWN;
-  goto quit;
 }
 
-
+/*
+ * No transaction queued nor on the bus.
+ */
+bool
+twi_idle(void)
+{
+  return _twi_queue_count == 0;
+}
@@ -2,14 +2,52 @@
 #define __TWI_H__
 
 #include <stdint.h>
+#include <stdbool.h>
 
 typedef enum {
   CONNECTION_BROKEN,
   CONNECTION_OK
 } twi_connection_state;
 
+// Transaction status
+#define TWI_OK				0
+#define TWI_PENDING			1
+#define TWI_ERR_UNKNOWN			-1
+#define TWI_ERR_NOT_IN_START		-2
+#define TWI_ERR_MAX_ITER		-3
+#define TWI_ERR_MUST_SEND_STOP		-4
+#define TWI_ERR_DEVICE_WRITE_PROTECTED	-5
+#define TWI_ERR_QUEUE_FULL		-6
+#define TWI_ERR_EMPTY			-7
+
+// Maximal number of transactions waiting for the bus
+#define TWI_QUEUE_SIZE	4
+
+typedef struct twi_transaction_s twi_transaction_t;
+
+/*
+ * A transaction writes "write_len" bytes from "write_buf" to the
+ * device at "addr" (8 bits address, R/W bit cleared), then, if
+ * "read_len" is not null, reads "read_len" bytes into "read_buf"
+ * after a repeated start condition.  Either part may be empty, not
+ * both.
+ *
+ * Descriptors and buffers are owned by the caller and must stay valid
+ * until "status" leaves TWI_PENDING.  "callback", if any, is called
+ * from TWI interrupt context once the transaction is over.
+ */
+struct twi_transaction_s {
+  uint8_t addr;
+  uint8_t write_len;
+  uint8_t *write_buf;
+  uint8_t read_len;
+  uint8_t *read_buf;
+  void (*callback)(twi_transaction_t *transaction);
+  volatile int8_t status;
+};
+
 void twi_init(void);
-int twi_read_bytes(uint8_t addr, int len, uint8_t *buf);
-int twi_write_bytes(uint8_t addr, int len, uint8_t *buf);
+int8_t twi_submit(twi_transaction_t *transaction);
+bool twi_idle(void);
 
 #endif 	/* !__TWI_H__ */
@@ -15,206 +15,231 @@
 #define UART_BAUD  38400
 
 #include <stdint.h>
-#include <stdio.h>
 
-#include <avr/io.h>
+#include <avr/interrupt.h>
 
+#include "hal.h"
 #include "uart.h"
 
-#ifndef UBRRL
-# define UBRRL UBRR0L
+#if (UART_TX_BUFSIZE & (UART_TX_BUFSIZE - 1)) != 0 || UART_TX_BUFSIZE > 256
+# error UART_TX_BUFSIZE must be a power of two, up to 256
 #endif
 
-#ifndef UCSRA
-# define UCSRA UCSR0A
+/*
+ * Transmit ring buffer, filled by uart_putchar() and drained by the
+ * data register empty interrupt.
+ */
+static volatile char _uart_tx_buf[UART_TX_BUFSIZE];
+static volatile uint8_t _uart_tx_head = 0;
+static volatile uint8_t _uart_tx_tail = 0;
+static volatile uint16_t _uart_tx_dropped = 0;
+static volatile uint8_t _uart_tx_used = 0;
+
+#if (UART_RX_RINGSIZE & (UART_RX_RINGSIZE - 1)) != 0 || UART_RX_RINGSIZE > 256
+# error UART_RX_RINGSIZE must be a power of two, up to 256
 #endif
 
-#ifndef UCSRB
-# define UCSRB UCSR0B
-#endif
+/*
+ * Receive ring buffer, filled by the receive complete interrupt and
+ * drained by uart_read().
+ */
+static volatile uint8_t _uart_rx_buf[UART_RX_RINGSIZE];
+static volatile uint8_t _uart_rx_head = 0;
+static volatile uint8_t _uart_rx_tail = 0;
+static volatile uint16_t _uart_rx_dropped = 0;
 
-#ifndef RXC
-# define RXC RXC0
-#endif
+/*
+ * Initialize the UART to 38400 Bd, tx/rx, 8N1.
+ */
+void
+uart_init(void)
+{
+  hal_uart_init(UART_BAUD);	/* tx/rx enable, rx interrupt */
+}
 
-#ifndef UDR
-# define UDR UDR0
-#endif
+/*
+ * Store received character in the receive ring buffer.  Characters
+ * with a framing error, and characters received while the buffer is
+ * full, are dropped and counted.  Hardware data overruns are counted
+ * too.
+ */
+ISR(USART_RX_vect)
+{
+  const uint8_t status = hal_uart_rx_status();
+  const uint8_t c = hal_uart_rx_data();
+
+  if (status & HAL_UART_RX_OVERRUN)
+    _uart_rx_dropped++;
+  if (status & HAL_UART_RX_FRAME_ERROR) {
+    _uart_rx_dropped++;
+    return;
+  }
+
+  const uint8_t head = (_uart_rx_head + 1) & (UART_RX_RINGSIZE - 1);
+  if (head == _uart_rx_tail) {
+    _uart_rx_dropped++;
+    return;
+  }
+  _uart_rx_buf[_uart_rx_head] = c;
+  _uart_rx_head = head;
+}
 
-#ifndef UDRE
-# define UDRE UDRE0
-#endif
+/*
+ * Number of characters waiting in the receive ring buffer.
+ */
+uint8_t
+uart_rx_available(void)
+{
+  return (_uart_rx_head - _uart_rx_tail) & (UART_RX_RINGSIZE - 1);
+}
 
-#ifndef FE
-# define FE FE0
-#endif
+/*
+ * Number of received characters lost (framing error, hardware overrun
+ * or receive buffer full).
+ */
+uint16_t
+uart_rx_dropped(void)
+{
+  const uint8_t sreg = SREG;
+  cli();
+  const uint16_t dropped = _uart_rx_dropped;
+  SREG = sreg;
+  return dropped;
+}
 
-#ifndef DOR
-# define DOR DOR0
-#endif
+/*
+ * Take the next character of the receive ring buffer, without
+ * waiting: returns false if there is none.
+ */
+bool
+uart_read(uint8_t *c)
+{
+  if (_uart_rx_head == _uart_rx_tail)
+    return false;
+  *c = _uart_rx_buf[_uart_rx_tail];
+  _uart_rx_tail = (_uart_rx_tail + 1) & (UART_RX_RINGSIZE - 1);
+  return true;
+}
 
-#ifndef TXEN
-# define TXEN TXEN0
-#endif
+/*
+ * Send the next character of the transmit ring buffer, or disable the
+ * data register empty interrupt when there is nothing left to send.
+ */
+static void
+uart_tx_next(void)
+{
+  if (_uart_tx_head == _uart_tx_tail) {
+    hal_uart_tx_irq(false);
+    return;
+  }
+  hal_uart_tx_data(_uart_tx_buf[_uart_tx_tail]);	/* also clears transmit complete flag */
+  _uart_tx_tail = (_uart_tx_tail + 1) & (UART_TX_BUFSIZE - 1);
+}
 
-#ifndef RXEN
-# define RXEN RXEN0
-#endif
+ISR(USART_UDRE_vect)
+{
+  uart_tx_next();
+}
 
 /*
- * Initialize the UART to 38400 Bd, tx/rx, 8N1.
+ * Queue character c for transmission on the UART Tx.
+ *
+ * When the transmit buffer is full, the caller waits for some room if
+ * interrupts are enabled (thread context), otherwise (interrupt
+ * context or critical section) the character is dropped and counted,
+ * see uart_tx_dropped().
  */
 void
-uart_init(void)
+uart_putchar(const char c)
 {
-#if F_CPU < 2000000UL && defined(U2X)
-  UCSRA = _BV(U2X);             /* improve baud rate error by using 2x clk */
-  UBRRL = (F_CPU / (8UL * UART_BAUD)) - 1;
-#else
-  UBRRL = (F_CPU / (16UL * UART_BAUD)) - 1;
-#endif
-  UCSRB = _BV(TXEN) | _BV(RXEN);        /* tx/rx enable */
+  if (c == '\n')
+    uart_putchar('\r');
+
+  // Queued with interrupts disabled, as an interrupt may queue too
+  for (;;) {
+    const uint8_t sreg = SREG;
+    cli();
+
+    const uint8_t head = (_uart_tx_head + 1) & (UART_TX_BUFSIZE - 1);
+    if (head != _uart_tx_tail) {
+      _uart_tx_buf[_uart_tx_head] = c;
+      _uart_tx_head = head;
+      _uart_tx_used = 1;
+      hal_uart_tx_irq(true);
+      SREG = sreg;
+      return;
+    }
+    if (bit_is_clear(sreg, SREG_I)) {
+      _uart_tx_dropped++;
+      return;
+    }
+    SREG = sreg;
+    hal_busy_wait();
+  }
 }
 
 /*
- * Send character c down the UART Tx, wait until tx holding register
- * is empty.
+ * Queue "len" bytes for transmission, all or nothing: returns false if
+ * the transmit buffer has not enough room, may be called from
+ * interrupt context.
  */
-int
-uart_putchar(char c, FILE *stream)
+bool
+uart_write(const uint8_t *buf, const uint8_t len)
 {
-  /* This code causes some bug when stdin is full (Data Over-Run)
-    if (c == '\a') {
-      fputs ("*ring*\n", stderr);
-      return 0;
-    }
-  */
-  if (c == '\n')
-    uart_putchar('\r', stream);
-  loop_until_bit_is_set(UCSRA, UDRE);
-  UDR = c;
-
-  return 0;
+  const uint8_t sreg = SREG;
+  cli();
+
+  const uint8_t room = (_uart_tx_tail - _uart_tx_head - 1) & (UART_TX_BUFSIZE - 1);
+  if (len > room) {
+    SREG = sreg;
+    return false;
+  }
+  for (uint8_t i = 0; i < len; i++) {
+    _uart_tx_buf[_uart_tx_head] = buf[i];
+    _uart_tx_head = (_uart_tx_head + 1) & (UART_TX_BUFSIZE - 1);
+  }
+  _uart_tx_used = 1;
+  hal_uart_tx_irq(true);
+
+  SREG = sreg;
+  return true;
 }
 
 /*
- * Receive a character from the UART Rx.
- *
- * This features a simple line-editor that allows to delete and
- * re-edit the characters entered, until either CR or NL is entered.
- * Printable characters entered will be echoed using uart_putchar().
- *
- * Editing characters:
- *
- * . \b (BS) or \177 (DEL) delete the previous character
- * . ^u kills the entire input buffer
- * . ^w deletes the previous word
- * . ^r sends a CR, and then reprints the buffer
- * . \t will be replaced by a single space
+ * Wait until every queued character has been shifted out.
  *
- * All other control characters will be ignored.
- *
- * The internal line buffer is RX_BUFSIZE (80) characters long, which
- * includes the terminating \n (but no terminating \0).  If the buffer
- * is full (i. e., at RX_BUFSIZE-1 characters in order to keep space for
- * the trailing \n), any further input attempts will send a \a to
- * uart_putchar() (BEL character), although line editing is still
- * allowed.
- *
- * Input errors while talking to the UART will cause an immediate
- * return of -1 (error indication).  Notably, this will be caused by a
- * framing error (e. g. serial line "break" condition), by an input
- * overrun, and by a parity error (if parity was enabled and automatic
- * parity recognition is supported by hardware).
- *
- * Successive calls to uart_getchar() will be satisfied from the
- * internal buffer until that buffer is emptied again.
+ * May be called with interrupts disabled, the transmit buffer is then
+ * drained by polling.
  */
-int
-uart_getchar(FILE *stream)
+void
+uart_flush(void)
 {
-  uint8_t c;
-  char   *cp,
-         *cp2;
-  static char b[RX_BUFSIZE];
-  static char *rxp;
-
-  if (rxp == 0)
-    for (cp = b;;) {
-      loop_until_bit_is_set(UCSRA, RXC);
-      if (UCSRA & _BV(FE))
-        return _FDEV_EOF;
-      if (UCSRA & _BV(DOR)) {
-        do {
-          c = UDR;
-        } while (UCSRA & _BV(DOR));
-        return _FDEV_ERR;
-      }
-      c = UDR;
-      /* behaviour similar to Unix stty ICRNL */
-      if (c == '\r')
-        c = '\n';
-      if (c == '\n') {
-        *cp = c;
-        uart_putchar(c, stream);
-        rxp = b;
-        break;
-      } else if (c == '\t')
-        c = ' ';
-
-      if ((c >= (uint8_t) ' ' && c <= (uint8_t) '\x7e') || c >= (uint8_t) '\xa0') {
-        if (cp == b + RX_BUFSIZE - 1)
-          uart_putchar('\a', stream);
-        else {
-          *cp++ = c;
-          uart_putchar(c, stream);
-        }
-        continue;
-      }
-
-      switch (c) {
-        case 'c' & 0x1f:
-          return _FDEV_EOF; //-1;
-
-        case '\b':
-        case '\x7f':
-          if (cp > b) {
-            uart_putchar('\b', stream);
-            uart_putchar(' ', stream);
-            uart_putchar('\b', stream);
-            cp--;
-          }
-          break;
-
-        case 'r' & 0x1f:
-          uart_putchar('\r', stream);
-          for (cp2 = b; cp2 < cp; cp2++)
-            uart_putchar(*cp2, stream);
-          break;
-
-        case 'u' & 0x1f:
-          while (cp > b) {
-            uart_putchar('\b', stream);
-            uart_putchar(' ', stream);
-            uart_putchar('\b', stream);
-            cp--;
-          }
-          break;
-
-        case 'w' & 0x1f:
-          while (cp > b && cp[-1] != ' ') {
-            uart_putchar('\b', stream);
-            uart_putchar(' ', stream);
-            uart_putchar('\b', stream);
-            cp--;
-          }
-          break;
-      }
-    }
+  while (_uart_tx_head != _uart_tx_tail) {
+    if (bit_is_clear(SREG, SREG_I) && hal_uart_tx_ready())
+      uart_tx_next();
+    hal_busy_wait();
+  }
+  if (_uart_tx_used) {
+    while (!hal_uart_tx_done())
+      hal_busy_wait();
+  }
+}
 
-  c = *rxp++;
-  if (c == '\n')
-    rxp = 0;
+bool
+uart_tx_idle(void)
+{
+  return (_uart_tx_head == _uart_tx_tail) && (!_uart_tx_used || hal_uart_tx_done());
+}
 
-  return c;
+/*
+ * Number of characters dropped because the transmit buffer was full.
+ */
+uint16_t
+uart_tx_dropped(void)
+{
+  const uint8_t sreg = SREG;
+  cli();
+  const uint16_t dropped = _uart_tx_dropped;
+  SREG = sreg;
+  return dropped;
 }
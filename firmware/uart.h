@@ -14,26 +14,74 @@
  * $Id: uart.h,v 1.1 2005/12/28 21:38:59 joerg_wunsch Exp $
  */
 
+#include <stdint.h>
+#include <stdbool.h>
+
 /*
  * Perform UART startup initialization.
  */
 void    uart_init(void);
 
 /*
- * Send one character to the UART.
+ * Size of transmit ring buffer used by uart_putchar(), must be a
+ * power of two.
+ */
+#ifndef UART_TX_BUFSIZE
+#define UART_TX_BUFSIZE 64
+#endif
+
+/*
+ * Send one character to the UART.  The actual transmission is
+ * interrupt driven, characters are queued in the transmit buffer.
+ */
+void    uart_putchar(const char c);
+
+/*
+ * Queue a block of bytes as is (no newline translation), without
+ * waiting: nothing is queued if the transmit buffer lacks room.
+ */
+bool    uart_write(const uint8_t *buf, const uint8_t len);
+
+/*
+ * Wait until all queued characters are sent.
+ */
+void    uart_flush(void);
+
+/*
+ * True when every queued character has been shifted out, so that the
+ * UART clock may be stopped.
+ */
+bool    uart_tx_idle(void);
+
+/*
+ * Number of characters dropped by uart_putchar() in interrupt context
+ * because the transmit buffer was full.
+ */
+uint16_t uart_tx_dropped(void);
+
+/*
+ * Size of receive ring buffer filled by the receive interrupt, must be
+ * a power of two.
+ */
+#ifndef UART_RX_RINGSIZE
+#define UART_RX_RINGSIZE 128
+#endif
+
+/*
+ * Number of characters waiting in the receive ring buffer.
  */
-int     uart_putchar(char c, FILE *stream);
+uint8_t uart_rx_available(void);
 
 /*
- * Size of internal line buffer used by uart_getchar().
+ * Number of received characters lost (framing error, overrun or
+ * receive ring buffer full).
  */
-#define RX_BUFSIZE 160
+uint16_t uart_rx_dropped(void);
 
 /*
- * Receive one character from the UART.  The actual reception is
- * line-buffered, and one character is returned from the buffer at
- * each invokation.
+ * Take one received character, without waiting: returns false if the
+ * receive ring buffer is empty.
  */
-int     uart_getchar(FILE *stream);
+bool    uart_read(uint8_t *c);
 
-#endif // __UART_H__
\ No newline at end of file
+#endif // __UART_H__
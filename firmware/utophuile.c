@@ -1,9 +1,7 @@
 #include <avr/io.h>
 #include <avr/interrupt.h>
-#include <avr/sleep.h>
 #include <avr/pgmspace.h>
 
-#include <stdio.h>
 #include <stdint.h>
 #include <ctype.h>
 
@@ -16,34 +14,27 @@
 #include "uart.h"
 #include "twi.h"
 #include "relay.h"
+#include "heater.h"
 #include "shell.h"
 
 #include "scheduler.h"
+#include "temperature.h"
+#include "filter.h"
+#include "slope.h"
+#include "eventlog.h"
+#include "telemetry.h"
+#include "fmt.h"
+#include "power.h"
+#include "mem.h"
 
 #include "config.h"
 
-// FILE uart_stdout = FDEV_SETUP_STREAM(uart_putchar, NULL, _FDEV_SETUP_WRITE);
-FILE uart_stdio = FDEV_SETUP_STREAM(uart_putchar, uart_getchar, _FDEV_SETUP_RW);
-
-typedef enum {
-  UTOPHUILE_MODE_OFF,
-  UTOPHUILE_MODE_HEATING,
-  UTOPHUILE_MODE_READY,
-  UTOPHUILE_MODE_OIL,
-  UTOPHUILE_MODE_EMERGENCY,
-  UTOPHUILE_MODE_ERROR
-} utophuile_mode_t;
-
 void utophuile_process(void);
+void utophuile_sample(const ads1115_channel_t channel, const int16_t value);
+static void utophuile_telemetry(telemetry_sample_t *sample);
 void utophuile_set_mode(utophuile_mode_t mode);
-
-// Shell commands
-shell_command_t shell_commands[SHELL_COMMAND_COUNT];
-void utophuile_command_help(const char *args);
-void utophuile_command_status(const char *args);
-void utophuile_debug_command_relay(const char *args);
-void utophuile_debug_command_monitor(const char *args);
-void utophuile_debug_command_fake(const char *args);
+static power_state_t utophuile_sleep_depth(void);
+static void utophuile_wakeup(const power_wakeup_t wakeup);
 
 
 static volatile utophuile_mode_t _utophuile_mode = UTOPHUILE_MODE_OFF;
@@ -55,28 +46,100 @@ typedef enum {
 } alerter_mode_t;
 static volatile alerter_mode_t _utophuile_alerter_mode = UTOPHUILE_ALERTER_ENABLED;
 
-#define UTOPHUILE_TOLERENCE_OIL_TEMPERATURE 3
-#define UTOPHUILE_MIN_OIL_TEMPERATURE  59 /* Stop when < MIN_OIL_TEMP, ready when > ( MIN_OIL_TEMP + TOLERENCE ) */
-#define UTOPHUILE_MAX_OIL_TEMPERATURE  94 /* Stop when > MAX_OIL_TEMP, ready when < ( MAX_OIL_TEMP + TOLERENCE ) */
+#define UTOPHUILE_PERIOD_MS		250
+#define UTOPHUILE_ALERTER_PERIOD_MS	1000	/* Repeated beeps period */
+
+#if UTOPHUILE_PERIOD_MS != HEATER_PERIOD_MS
+#  error "heater_process() is run by utophuile_process()"
+#endif
+
+#define UTOPHUILE_TOLERENCE_OIL_TEMPERATURE TEMPERATURE_C(3)
+#define UTOPHUILE_MIN_OIL_TEMPERATURE  TEMPERATURE_C(59) /* Stop when < MIN_OIL_TEMP, ready when > ( MIN_OIL_TEMP + TOLERENCE ) */
+#define UTOPHUILE_MAX_OIL_TEMPERATURE  TEMPERATURE_C(94) /* Stop when > MAX_OIL_TEMP, ready when < ( MAX_OIL_TEMP + TOLERENCE ) */
+
+#if (HEATER_SETPOINT_MIN <= UTOPHUILE_MIN_OIL_TEMPERATURE + UTOPHUILE_TOLERENCE_OIL_TEMPERATURE) \
+    || (HEATER_SETPOINT_MAX >= UTOPHUILE_MAX_OIL_TEMPERATURE - UTOPHUILE_TOLERENCE_OIL_TEMPERATURE)
+#  error "the heater setpoint must stay within the READY oil temperatures"
+#endif
+
+/*
+ * Opening the valves brings cold oil into the circuit: the heater is
+ * boosted ahead of the dip (see heater_feedforward()), and OIL mode is
+ * only left for HEATING below MIN_OIL_TEMP - HYSTERESIS, or below
+ * MIN_OIL_TEMP once the dwell time is over and the oil is not warming
+ * up anymore.
+ */
+#define UTOPHUILE_OIL_BOOST		400	/* per mille of heater output */
+#define UTOPHUILE_OIL_BOOST_S		300
+#define UTOPHUILE_OIL_DWELL_S		120
+#define UTOPHUILE_OIL_HYSTERESIS	TEMPERATURE_C(5)
+
+// Remaining OIL mode dwell time, utophuile_process() periods
+static uint16_t _utophuile_oil_dwell = 0;
+
+/*
+ * Oil temperature trend: time to READY while heating, and the heater is
+ * cut when the temperature expected in UTOPHUILE_OVERHEAT_LEAD_S is
+ * above MAX_OIL_TEMP, until it is back below MAX_OIL_TEMP - TOLERENCE.
+ */
+#define UTOPHUILE_OVERHEAT_LEAD_S	60
+
+static slope_t _utophuile_oil_trend;
 
-static uint8_t _report_mode_enabled = 0;
 static bool _debug_mode = true;
 
+/*
+ * Input filters, run at conversion rate: median window, IIR shift and
+ * maximal step between samples (ADC counts, 0 for no check), see
+ * filter.h.  Oil temperature cannot move by more than ~2 °C (~100
+ * counts) between two conversions.
+ */
+typedef struct {
+  uint8_t median;
+  uint8_t iir_shift;
+  uint16_t max_step;
+} utophuile_filter_config_t;
+
+static const utophuile_filter_config_t _utophuile_filter_configs[ADS1115_CHANNEL_COUNT] PROGMEM = {
+  [ADS1115_CHANNEL_OIL_TEMPERATURE] = { 5, 2, 100 },
+  [ADS1115_CHANNEL_DIESEL_TEMPERATURE] = { 5, 2, 100 },
+  [ADS1115_CHANNEL_COOLANT_TEMPERATURE] = { 5, 2, 100 },
+  [ADS1115_CHANNEL_FUEL_PRESSURE] = { 3, 1, 0 },
+};
+
+static filter_t _utophuile_filters[ADS1115_CHANNEL_COUNT];
+
 // Is oil temperature a fake ? (ie. sets by user in debug mode)
 static bool _utophuile_oil_temperature_is_fake = false;
 
+static int16_t _utophuile_oil_temperature = TEMPERATURE_C(20);
+static temperature_status_t _utophuile_oil_temperature_status = TEMPERATURE_INVALID;
+
+// Relay feedback has this long to follow the outputs
+#define UTOPHUILE_FEEDBACK_MS	1000
+
+/*
+ * Power-down (OFF mode only) waits this long after a mode change, so
+ * that beeps and relays settle, and after boot or console input.
+ */
+#define UTOPHUILE_MODE_AWAKE_MS		2000
+#define UTOPHUILE_CONSOLE_AWAKE_MS	30000
+
 int
 main(void)
 {
   cli();
 
+  power_init();
   uart_init();
-  stdout = stdin = &uart_stdio;
-  stderr = &uart_stdio;
 
-  printf_P(PSTR("\n"PACKAGE_STRING"\n"));
+  fmt_str_P(PSTR("\n"PACKAGE_STRING"\n"));
 
   scheduler_init();
+  mem_init();
+
+  eventlog_init();
+  eventlog_add(EVENTLOG_BOOT, hal_reset_cause(), EVENTLOG_NO_TEMPERATURE);
 
   buttons_init();
   leds_init();
@@ -88,31 +151,50 @@ main(void)
   twi_init();
 
   // 16bits Analog-to-Digital Converter
+  for (uint8_t n = 0; n < ADS1115_CHANNEL_COUNT; n++) {
+    filter_init(&_utophuile_filters[n],
+                pgm_read_byte(&_utophuile_filter_configs[n].median),
+                pgm_read_byte(&_utophuile_filter_configs[n].iir_shift),
+                pgm_read_word(&_utophuile_filter_configs[n].max_step));
+  }
+  slope_reset(&_utophuile_oil_trend);
+  ads1115_set_sample_hook(utophuile_sample);
   ads1115_init();
 
   relay_init();
+  heater_init();
 
-  scheduler_add_hook_fct(utophuile_process);
+  telemetry_init(utophuile_telemetry);
 
-  SHELL_COMMAND_DECL(0, "help", "this help", false, utophuile_command_help);
-  SHELL_COMMAND_DECL(1, "status", "system status", false, utophuile_command_status);
-  SHELL_COMMAND_DECL(2, "relay", "active/disactive relay (VI, VO, P, H)", true, utophuile_debug_command_relay);
-  SHELL_COMMAND_DECL(3, "monitor", "enable monitor mode", true, utophuile_debug_command_monitor);
-  SHELL_COMMAND_DECL(4, "fake", "set a simulated value", true, utophuile_debug_command_fake);
+  scheduler_add_hook_fct(utophuile_process, UTOPHUILE_PERIOD_MS, SCHEDULER_CONTEXT_MAIN);
 
   sei();   /* Enable interrupts */
 
   utophuile_set_mode(UTOPHUILE_MODE_OFF);
+  power_stay_awake(UTOPHUILE_CONSOLE_AWAKE_MS);	/* opening the console resets the board */
+
+  shell_init();
 
   for (;;) {
-    shell_loop();
+    scheduler_process();
+    if (uart_rx_available() != 0)
+      power_stay_awake(UTOPHUILE_CONSOLE_AWAKE_MS);
+    shell_process();
     /*
           case 'v': // Version
-            printf_P(PSTR("\n"PACKAGE_STRING"\n"));
+            fmt_str_P(PSTR("\n"PACKAGE_STRING"\n"));
             break;
         }
     */
-    sleep_mode();
+    // Sleep until the next interrupt (tick, received character...),
+    // unless a character arrived since shell_process() looked
+    cli();
+    if (uart_rx_available() == 0) {
+      const power_wakeup_t wakeup = power_sleep(utophuile_sleep_depth());
+      if (wakeup != POWER_WAKEUP_NONE)
+        utophuile_wakeup(wakeup);
+    }
+    sei();
   }
   return (0);
 }
@@ -120,53 +202,136 @@ main(void)
 
 static int16_t _fake_oil_temperature;
 
-int16_t
-utophuile_oil_temperature(void)
+// New conversion, from interrupt context
+void
+utophuile_sample(const ads1115_channel_t channel, const int16_t value)
+{
+  filter_process(&_utophuile_filters[channel], value);
+}
+
+// Retrieve oil temperature (0.1 °C)
+temperature_status_t
+utophuile_oil_temperature(int16_t *temperature)
 {
   if (!_utophuile_oil_temperature_is_fake) {
-    int16_t adc = ads1115_read();
-    // return (((double)adc * 0.0217220010422) - 259.74025974);
-    // printf_P(PSTR("adc: %"PRIi16), adc);
-    adc /= 46; // * 0.0217220010422 => / 46.0362743772
-    // printf_P(PSTR(", tmp: %"PRIi16), adc);
-    adc -= 259; // - 259.74025974
-    // printf_P(PSTR(", res: %"PRIi16"\n"), adc);
-    return adc;
+    return temperature_from_adc(filter_output(&_utophuile_filters[ADS1115_CHANNEL_OIL_TEMPERATURE]), temperature);
   } else {
-    return _fake_oil_temperature;
+    *temperature = _fake_oil_temperature;
+    return TEMPERATURE_OK;
   }
 }
 
+// Telemetry frame contents (monitor mode), see telemetry.h
+static void
+utophuile_telemetry(telemetry_sample_t *sample)
+{
+  sample->status = utophuile_oil_temperature(&sample->temperature);
+  sample->mode = _utophuile_mode;
+  sample->relays = relay_mode();
+  sample->connections = ((ads1115_connection_state == CONNECTION_OK) ? TELEMETRY_CONNECTION_ADS1115 : 0)
+                        | ((relay_connection_state == CONNECTION_OK) ? TELEMETRY_CONNECTION_RELAY : 0);
+  sample->slope = slope_per_minute(&_utophuile_oil_trend);
+  sample->eta = slope_eta(&_utophuile_oil_trend, UTOPHUILE_MIN_OIL_TEMPERATURE + UTOPHUILE_TOLERENCE_OIL_TEMPERATURE);
+}
+
+// "ON" or "OFF", in program memory
+static PGM_P
+utophuile_on_off(const bool on)
+{
+  static const char on_text[] PROGMEM = "ON";
+  static const char off_text[] PROGMEM = "OFF";
+  return on ? on_text : off_text;
+}
+
+// Print the time left before READY, from the oil temperature trend
+static void
+utophuile_print_eta(void)
+{
+  const uint16_t eta = slope_eta(&_utophuile_oil_trend, UTOPHUILE_MIN_OIL_TEMPERATURE + UTOPHUILE_TOLERENCE_OIL_TEMPERATURE);
+
+  if (eta == SLOPE_ETA_NONE)
+    fmt_P(PSTR("-"));
+  else
+    fmt_P(PSTR("%u"), eta);
+}
+
+utophuile_mode_t
+utophuile_mode(void)
+{
+  return _utophuile_mode;
+}
+
+/*
+ * Power-down is only safe in OFF mode, when nothing is left running
+ * from the tick: buzzer, telemetry, event log writes (the EEPROM
+ * interrupt does not wake the CPU up) and button press handling.
+ */
+static power_state_t
+utophuile_sleep_depth(void)
+{
+  if ((_utophuile_mode != UTOPHUILE_MODE_OFF) || beep_playing() || (telemetry_rate() != 0)
+      || (eventlog_pending() != 0) || !buttons_idle())
+    return POWER_IDLE;
+  return POWER_DOWN;
+}
+
+/*
+ * Back from power-down: catch up with the lost button edge and sensor
+ * conversions.  A pin change without the button held down comes from
+ * the console, whose first character was lost: stay awake for the next
+ * ones.
+ */
+static void
+utophuile_wakeup(const power_wakeup_t wakeup)
+{
+  buttons_wakeup();
+  ads1115_resume();
+  if ((wakeup == POWER_WAKEUP_PIN) && buttons_idle())
+    power_stay_awake(UTOPHUILE_CONSOLE_AWAKE_MS);
+}
+
 void
 utophuile_set_mode(utophuile_mode_t mode)
 {
   if (_utophuile_mode != mode) {
     _utophuile_previous_mode = _utophuile_mode;
     _utophuile_mode = mode;
+    eventlog_add(EVENTLOG_MODE, mode, _utophuile_oil_temperature);
+    power_stay_awake(UTOPHUILE_MODE_AWAKE_MS);
     switch (mode) {
       case UTOPHUILE_MODE_OFF:
         relay_set_mode(RELAY_OFF);
+        heater_enable(false);
         leds_set(LED_ALL_OFF);
         break;
       case UTOPHUILE_MODE_HEATING:
-        relay_set_mode(_BV(RELAY_PUMP) | _BV(RELAY_HEATER));
+        // Heater relay is driven by heater_process()
+        relay_set_mode(_BV(RELAY_PUMP));
+        heater_enable(true);
         leds_set(LED_RED_ON);
         break;
       case UTOPHUILE_MODE_READY:
-        relay_set_mode(_BV(RELAY_PUMP) | _BV(RELAY_HEATER));
+        relay_set_mode(_BV(RELAY_PUMP));
+        heater_enable(true);
         leds_set(LED_ORANGE_BLINK);
         break;
       case UTOPHUILE_MODE_OIL:
-        relay_set_mode(_BV(RELAY_VALVE_INPUT) | _BV(RELAY_VALVE_OUTPUT) | _BV(RELAY_PUMP) | _BV(RELAY_HEATER));
+        relay_set_mode(_BV(RELAY_VALVE_INPUT) | _BV(RELAY_VALVE_OUTPUT) | _BV(RELAY_PUMP));
+        heater_enable(true);
+        heater_feedforward(UTOPHUILE_OIL_BOOST, UTOPHUILE_OIL_BOOST_S);
+        _utophuile_oil_dwell = UTOPHUILE_OIL_DWELL_S * 1000UL / UTOPHUILE_PERIOD_MS;
         leds_set(LED_GREEN_ON);
         break;
       case UTOPHUILE_MODE_EMERGENCY:
         relay_set_mode(RELAY_OFF);
+        heater_enable(false);
         leds_set(LED_RED_BLINK);
         _utophuile_alerter_mode = UTOPHUILE_ALERTER_ENABLED;
         beep_play_partition_P(PSTR("G"));
         break;
       case UTOPHUILE_MODE_ERROR:
+        // No heating without a trusted temperature, other relays are kept
+        heater_enable(false);
         leds_set(LED_ALL_BLINK);
         _utophuile_alerter_mode = UTOPHUILE_ALERTER_ENABLED;
         break;
@@ -174,35 +339,89 @@ utophuile_set_mode(utophuile_mode_t mode)
   }
 }
 
-static int16_t _utophuile_oil_temperature = 20.0;
-
 void
 utophuile_process(void)
 {
   const button_action_t requested_action = buttons_get_requested_action();
 
+  // Repeated beeps are slower than the control loop
+  static uint8_t alerter_countdown = 1;
+  bool alert = false;
+  if (--alerter_countdown == 0) {
+    alerter_countdown = UTOPHUILE_ALERTER_PERIOD_MS / UTOPHUILE_PERIOD_MS;
+    alert = (_utophuile_alerter_mode == UTOPHUILE_ALERTER_ENABLED);
+  }
+
   // Retrieve temperature
-  _utophuile_oil_temperature = utophuile_oil_temperature();
+  _utophuile_oil_temperature_status = utophuile_oil_temperature(&_utophuile_oil_temperature);
+  // Over range is handled as an over temperature, see below
+  const bool sensor_ok = (_utophuile_oil_temperature_status == TEMPERATURE_OK) || (_utophuile_oil_temperature_status == TEMPERATURE_OVER_RANGE);
+
+  static uint8_t trend_countdown = 1;
+  if (--trend_countdown == 0) {
+    trend_countdown = SLOPE_PERIOD_MS / UTOPHUILE_PERIOD_MS;
+    if (_utophuile_oil_temperature_status == TEMPERATURE_OK)
+      slope_process(&_utophuile_oil_trend, _utophuile_oil_temperature);
+    else
+      slope_reset(&_utophuile_oil_trend);
+  }
 
-  // Print data if report mode is enabled
-  if (_report_mode_enabled != 0) {
-    printf("t=%"PRIi16"\n", _utophuile_oil_temperature);
+  // Predicted overtemperature
+  if (!slope_valid(&_utophuile_oil_trend)) {
+    heater_cut(false);
+  } else {
+    const int16_t predicted = slope_predict(&_utophuile_oil_trend, UTOPHUILE_OVERHEAT_LEAD_S);
+    if (predicted > UTOPHUILE_MAX_OIL_TEMPERATURE)
+      heater_cut(true);
+    else if (predicted < UTOPHUILE_MAX_OIL_TEMPERATURE - UTOPHUILE_TOLERENCE_OIL_TEMPERATURE)
+      heater_cut(false);
   }
+  static bool cut = false;
+  if (heater_is_cut() != cut) {
+    cut = heater_is_cut();
+    eventlog_add(EVENTLOG_HEATER_CUT, cut, _utophuile_oil_temperature);
+  }
+
+  heater_process(_utophuile_oil_temperature, slope_per_minute(&_utophuile_oil_trend), _utophuile_oil_temperature_status == TEMPERATURE_OK);
 
   static twi_connection_state local = CONNECTION_OK;
   if ((ads1115_connection_state != local)) {
     if (ads1115_connection_state == CONNECTION_OK) {
       beep_play_partition_P(PSTR("DAA"));
+      eventlog_add(EVENTLOG_CONNECTION_BACK, EVENTLOG_DEVICE_ADS1115, _utophuile_oil_temperature);
     } else {
       beep_play_partition_P(PSTR("ADD"));
+      eventlog_add(EVENTLOG_CONNECTION_LOST, EVENTLOG_DEVICE_ADS1115, _utophuile_oil_temperature);
     }
     local = ads1115_connection_state;
   }
+  static twi_connection_state relay_local = CONNECTION_OK;
+  if (relay_connection_state != relay_local) {
+    relay_local = relay_connection_state;
+    eventlog_add((relay_local == CONNECTION_OK) ? EVENTLOG_CONNECTION_BACK : EVENTLOG_CONNECTION_LOST,
+                 EVENTLOG_DEVICE_RELAY, _utophuile_oil_temperature);
+  }
+
+  // Relay feedback: logged once it disagrees with the outputs for UTOPHUILE_FEEDBACK_MS
+  static uint8_t feedback_mismatch = 0;
+  static uint8_t feedback_logged = 0;
+  static uint8_t feedback_periods = 0;
+  const uint8_t rm = relay_mode();
+  const uint8_t mismatch = (relay_connection_state == CONNECTION_OK) ? ((rm >> 4) ^ rm) & 0x0f : 0;
+  if (mismatch != feedback_mismatch) {
+    feedback_mismatch = mismatch;
+    feedback_periods = 0;
+    if (mismatch == 0)
+      feedback_logged = 0;
+  } else if ((mismatch != 0) && (mismatch != feedback_logged) && (++feedback_periods >= UTOPHUILE_FEEDBACK_MS / UTOPHUILE_PERIOD_MS)) {
+    feedback_logged = mismatch;
+    eventlog_add(EVENTLOG_RELAY_FEEDBACK, mismatch, _utophuile_oil_temperature);
+  }
 
   /* Start / Stop actions */
   if (_utophuile_mode != UTOPHUILE_MODE_OFF) {
     // FIXME Use different error beeps
-    if ((relay_connection_state != CONNECTION_OK) || (ads1115_connection_state != CONNECTION_OK)) {
+    if ((relay_connection_state != CONNECTION_OK) || (ads1115_connection_state != CONNECTION_OK) || !sensor_ok) {
       utophuile_set_mode(UTOPHUILE_MODE_ERROR);
     }
 
@@ -217,6 +436,19 @@ utophuile_process(void)
     }
   }
 
+  // Stack came too close to the heap: RAM may be corrupted, ERROR
+  // mode until reset
+  static bool stack_low = false;
+  if (mem_low()) {
+    if (!stack_low) {
+      mem_usage_t usage;
+      mem_usage(&usage);
+      eventlog_add(EVENTLOG_STACK_LOW, (usage.margin > UINT8_MAX) ? UINT8_MAX : usage.margin, _utophuile_oil_temperature);
+      stack_low = true;
+    }
+    utophuile_set_mode(UTOPHUILE_MODE_ERROR);
+  }
+
   switch (_utophuile_mode) {
     case UTOPHUILE_MODE_OFF:
       // Nothing to do
@@ -244,7 +476,10 @@ utophuile_process(void)
       break;
     case UTOPHUILE_MODE_OIL:
       // Check if all is OK
-      if (_utophuile_oil_temperature < UTOPHUILE_MIN_OIL_TEMPERATURE) {
+      if (_utophuile_oil_dwell != 0)
+        _utophuile_oil_dwell--;
+      if ((_utophuile_oil_temperature < UTOPHUILE_MIN_OIL_TEMPERATURE - UTOPHUILE_OIL_HYSTERESIS)
+          || ((_utophuile_oil_temperature < UTOPHUILE_MIN_OIL_TEMPERATURE) && (_utophuile_oil_dwell == 0) && (slope_per_minute(&_utophuile_oil_trend) <= 0))) {
         utophuile_set_mode(UTOPHUILE_MODE_HEATING);
       } else if (_utophuile_oil_temperature > UTOPHUILE_MAX_OIL_TEMPERATURE) {
         utophuile_set_mode(UTOPHUILE_MODE_EMERGENCY);
@@ -262,19 +497,19 @@ utophuile_process(void)
       } else if (requested_action == BUTTON_ACTION_OK) {
         // User want to stop beeps :)
         _utophuile_alerter_mode = UTOPHUILE_ALERTER_DISABLED;
-      } else if (_utophuile_alerter_mode == UTOPHUILE_ALERTER_ENABLED) {
+      } else if (alert) {
         beep_play_partition_P(PSTR("G"));
       }
       break;
     case UTOPHUILE_MODE_ERROR:
       // Something went wrong, checking if all is back to normal or emit repeated beeps
-      if (relay_connection_state == CONNECTION_OK) {
+      if ((relay_connection_state == CONNECTION_OK) && sensor_ok && !mem_low()) {
         // Back to normal
         utophuile_set_mode(_utophuile_previous_mode);
       } else if (requested_action == BUTTON_ACTION_OK) {
         // User want to stop beeps :)
         _utophuile_alerter_mode = UTOPHUILE_ALERTER_DISABLED;
-      } else if (_utophuile_alerter_mode == UTOPHUILE_ALERTER_ENABLED) {
+      } else if (alert) {
         beep_play_partition_P(PSTR("GFG"));
       }
       break;
@@ -283,91 +518,299 @@ utophuile_process(void)
 
 // Help command
 void
-utophuile_command_help(const char *args)
+utophuile_command_help(const uint8_t argc, char *argv[])
 {
-  (void)args;
-  printf_P(PSTR("supported commands:\n"));
-  for (size_t n = 0; n < SHELL_COMMAND_COUNT; n++) {
-    if ((_debug_mode) || (shell_commands[n].debug == false)) {
-      printf_P(PSTR("  %S - %S\n"), shell_commands[n].text, shell_commands[n].description);
+  (void)argc;
+  (void)argv;
+  fmt_P(PSTR("supported commands:\n"));
+  for (uint8_t n = 0; n < shell_command_count(); n++) {
+    shell_command_t command;
+    shell_command(n, &command);
+    if ((_debug_mode) || (command.debug == false)) {
+      fmt_P(PSTR("  %S - %S\n"), command.text, command.description);
     }
   }
 }
 
 // Status command
 void
-utophuile_command_status(const char *args)
+utophuile_command_status(const uint8_t argc, char *argv[])
 {
-  (void)args;
+  (void)argc;
+  (void)argv;
 
   // Mode
   switch (_utophuile_mode) {
     case UTOPHUILE_MODE_OFF:
-      printf_P(PSTR("Status: OFF\n"));
+      fmt_P(PSTR("Status: OFF\n"));
       break;
     case UTOPHUILE_MODE_HEATING:
-      printf_P(PSTR("Status: HEATING\n"));
+      fmt_P(PSTR("Status: HEATING (ready in "));
+      utophuile_print_eta();
+      fmt_P(PSTR(" s)\n"));
       break;
     case UTOPHUILE_MODE_READY:
-      printf_P(PSTR("Status: READY\n"));
+      fmt_P(PSTR("Status: READY\n"));
       break;
     case UTOPHUILE_MODE_OIL:
-      printf_P(PSTR("Status: OIL\n"));
+      fmt_P(PSTR("Status: OIL\n"));
       break;
     case UTOPHUILE_MODE_EMERGENCY:
-      printf_P(PSTR("Status: EMERGENCY\n"));
+      fmt_P(PSTR("Status: EMERGENCY\n"));
       break;
     case UTOPHUILE_MODE_ERROR:
-      printf_P(PSTR("Status: ERROR\n"));
+      fmt_P(PSTR("Status: ERROR\n"));
       break;
   }
 
   // Temperature
-  printf_P(PSTR("Temperature: %"PRIi16" °C %s\n"), _utophuile_oil_temperature, _utophuile_oil_temperature_is_fake ? " (fake)" : "");
+  fmt_P(PSTR("Temperature: "));
+  switch (_utophuile_oil_temperature_status) {
+    case TEMPERATURE_OK:
+      fmt_P(PSTR("%.1d °C %S\n"), _utophuile_oil_temperature, _utophuile_oil_temperature_is_fake ? PSTR(" (fake)") : PSTR(""));
+      break;
+    case TEMPERATURE_UNDER_RANGE:
+      fmt_P(PSTR("< %.1d °C (out of range)\n"), _utophuile_oil_temperature);
+      break;
+    case TEMPERATURE_OVER_RANGE:
+      fmt_P(PSTR("> %.1d °C (out of range)\n"), _utophuile_oil_temperature);
+      break;
+    case TEMPERATURE_INVALID:
+      fmt_P(PSTR("invalid (no conversion)\n"));
+      break;
+  }
+
+  fmt_P(PSTR("Trend: %.1d °C/min%S\n"), slope_per_minute(&_utophuile_oil_trend), heater_is_cut() ? PSTR(" (heater cut, overtemperature predicted)") : PSTR(""));
+
+  fmt_P(PSTR("Rejected samples: %u\n"), filter_rejections(&_utophuile_filters[ADS1115_CHANNEL_OIL_TEMPERATURE]));
 
   // Relays
   const uint8_t rm = relay_mode();
-  printf_P(PSTR("Valve input: %s (feedback: %s)\n"),	(rm & _BV(RELAY_VALVE_INPUT)) ? "ON" : "OFF", (rm & _BV(RELAY_FB_VALVE_INPUT)) ? "ON" : "OFF");
-  printf_P(PSTR("Valve output: %s (feedback: %s)\n"),	(rm & _BV(RELAY_VALVE_OUTPUT)) ? "ON" : "OFF", (rm & _BV(RELAY_FB_VALVE_OUTPUT)) ? "ON" : "OFF");
-  printf_P(PSTR("Pump: %s (feedback: %s)\n"),	(rm & _BV(RELAY_PUMP)) ? "ON" : "OFF", (rm & _BV(RELAY_FB_PUMP)) ? "ON" : "OFF");
-  printf_P(PSTR("Heater: %s (feedback: %s)\n"),	(rm & _BV(RELAY_HEATER)) ? "ON" : "OFF", (rm & _BV(RELAY_FB_HEATER)) ? "ON" : "OFF");
+  fmt_P(PSTR("Valve input: %S (feedback: %S)\n"),	utophuile_on_off(rm & _BV(RELAY_VALVE_INPUT)), utophuile_on_off(rm & _BV(RELAY_FB_VALVE_INPUT)));
+  fmt_P(PSTR("Valve output: %S (feedback: %S)\n"),	utophuile_on_off(rm & _BV(RELAY_VALVE_OUTPUT)), utophuile_on_off(rm & _BV(RELAY_FB_VALVE_OUTPUT)));
+  fmt_P(PSTR("Pump: %S (feedback: %S)\n"),	utophuile_on_off(rm & _BV(RELAY_PUMP)), utophuile_on_off(rm & _BV(RELAY_FB_PUMP)));
+  fmt_P(PSTR("Heater: %S (feedback: %S)\n"),	utophuile_on_off(rm & _BV(RELAY_HEATER)), utophuile_on_off(rm & _BV(RELAY_FB_HEATER)));
 }
 
-// Monitor debug command
+// Monitor debug command: binary telemetry stream, see telemetry.h
 void
-utophuile_debug_command_monitor(const char *args)
+utophuile_debug_command_monitor(const uint8_t argc, char *argv[])
 {
-  (void)args;
-  if (_report_mode_enabled) {
-    printf_P(PSTR("monitor mode off\n"));
-    _report_mode_enabled = 0;
+  uint16_t hz;
+
+  if ((argc > 1) && shell_arg_uint16(argv[1], &hz)) {
+    telemetry_set_rate((hz > TELEMETRY_MAX_HZ) ? TELEMETRY_MAX_HZ : hz);
+  } else if (telemetry_rate() != 0) {
+    telemetry_set_rate(0);
   } else {
-    printf_P(PSTR("monitor mode on\n"));
-    _report_mode_enabled = 1;
+    telemetry_set_rate(TELEMETRY_DEFAULT_HZ);
+  }
+  if (telemetry_rate() != 0)
+    fmt_P(PSTR("monitor mode on, %u Hz\n"), telemetry_rate());
+  else
+    fmt_P(PSTR("monitor mode off (%u frames dropped)\n"), telemetry_dropped());
+}
+
+// Scheduler debug command
+void
+utophuile_debug_command_scheduler(const uint8_t argc, char *argv[])
+{
+  (void)argc;
+  (void)argv;
+  fmt_P(PSTR("uptime: %lu ms\n"), scheduler_millis());
+  for (uint8_t n = 0; n < scheduler_hook_count(); n++) {
+    uint16_t period;
+    scheduler_context_t context;
+    uint16_t misses;
+    scheduler_hook_info(n, &period, &context, &misses);
+    fmt_P(PSTR("  hook %u: every %u ms (%S), %u deadline misses\n"), n, period,
+             (context == SCHEDULER_CONTEXT_ISR) ? PSTR("isr") : PSTR("main"), misses);
+  }
+}
+
+// Print time "ms" and its share of "total"
+static void
+utophuile_print_share(PGM_P name, const uint32_t ms, uint32_t total)
+{
+  uint32_t part = ms;
+
+  while (total > UINT32_MAX / 1000) {
+    total >>= 1;
+    part >>= 1;
+  }
+  fmt_P(PSTR("%S: %lu ms (%.1d %%)\n"), name, ms, (int16_t)((total == 0) ? 0 : part * 1000 / total));
+}
+
+// Time spent in each power state, see power.h
+void
+utophuile_command_power(const uint8_t argc, char *argv[])
+{
+  power_stats_t stats;
+
+  (void)argc;
+  (void)argv;
+  power_stats(&stats);
+  const uint32_t uptime = scheduler_millis();
+  const uint32_t asleep = stats.idle_ms + stats.down_ms;
+  fmt_P(PSTR("uptime: %lu ms\n"), uptime);
+  utophuile_print_share(PSTR("active"), (asleep < uptime) ? uptime - asleep : 0, uptime);
+  utophuile_print_share(PSTR("idle"), stats.idle_ms, uptime);
+  utophuile_print_share(PSTR("power-down"), stats.down_ms, uptime);
+  fmt_P(PSTR("wakeups: %u timer, %u pin change\n"), stats.timer_wakeups, stats.pin_wakeups);
+}
+
+// RAM usage, see mem.h
+void
+utophuile_command_mem(const uint8_t argc, char *argv[])
+{
+  mem_usage_t usage;
+
+  (void)argc;
+  (void)argv;
+  mem_usage(&usage);
+  fmt_P(PSTR(".data: %u bytes\n.bss: %u bytes\nheap: %u bytes\n"), usage.data, usage.bss, usage.heap);
+  fmt_P(PSTR("stack: %u bytes, %u max\n"), usage.stack, usage.stack_max);
+  fmt_P(PSTR("free: %u bytes, %u never used (minimum %u)%S\n"), usage.free, usage.margin, MEM_MARGIN_MIN,
+        mem_low() ? PSTR(", STACK LOW") : PSTR(""));
+}
+
+// Heater control
+void
+utophuile_command_heater(const uint8_t argc, char *argv[])
+{
+  int16_t setpoint;
+  heater_gains_t gains;
+
+  if (argc > 1) {
+    if (shell_arg_is_P(argv[1], PSTR("sp")) && (argc == 3) && shell_arg_int16(argv[2], &setpoint)) {
+      // In °C, checked before TEMPERATURE_C() can overflow
+      if ((setpoint < HEATER_SETPOINT_MIN / 10) || (setpoint > HEATER_SETPOINT_MAX / 10)
+          || !heater_set_setpoint(TEMPERATURE_C(setpoint)))
+        fmt_P(PSTR("setpoint out of %.1d..%.1d °C\n"), HEATER_SETPOINT_MIN, HEATER_SETPOINT_MAX);
+    } else if (shell_arg_is_P(argv[1], PSTR("tune"))) {
+      if (!heater_autotune())
+        fmt_P(PSTR("heating is off\n"));
+    } else if (shell_arg_is_P(argv[1], PSTR("gains")) && (argc == 5)
+               && shell_arg_int32(argv[2], &gains.kp) && shell_arg_int32(argv[3], &gains.ki) && shell_arg_int32(argv[4], &gains.kd)) {
+      heater_set_gains(&gains);
+    } else {
+      fmt_P(PSTR("\"%s\" is not a subcommand of 'heater'\n"), argv[1]);
+      return;
+    }
+  }
+
+  static const char state_off[] PROGMEM = "off";
+  static const char state_pid[] PROGMEM = "pid";
+  static const char state_autotune[] PROGMEM = "autotune";
+  static PGM_P const states[] PROGMEM = {
+    [HEATER_OFF] = state_off,
+    [HEATER_PID] = state_pid,
+    [HEATER_AUTOTUNE] = state_autotune,
+  };
+  fmt_P(PSTR("state: %S\n"), (PGM_P)pgm_read_ptr(&states[heater_state()]));
+  fmt_P(PSTR("setpoint: %.1d °C\noutput: %u / %u (relay %S, %u switches)\n"), heater_setpoint(), heater_output(), HEATER_OUTPUT_MAX,
+        heater_on() ? PSTR("on") : PSTR("off"), heater_switches());
+  fmt_P(PSTR("slope: %.1d °C/min\n"), slope_per_minute(&_utophuile_oil_trend));
+  heater_gains(&gains);
+  fmt_P(PSTR("gains (Q8): kp %ld ki %ld kd %ld\n"), gains.kp, gains.ki, gains.kd);
+}
+
+// Event log command
+void
+utophuile_command_log(const uint8_t argc, char *argv[])
+{
+  const bool dump = (argc > 1);
+
+  if (dump && !shell_arg_is_P(argv[1], PSTR("dump"))) {
+    fmt_P(PSTR("\"%s\" is not a subcommand of 'log'\n"), argv[1]);
+    return;
+  }
+
+  // Queued records first
+  while (eventlog_pending() != 0)
+    hal_busy_wait();
+
+  // Oldest record first, as stored: header line, then raw records
+  if (dump) {
+    uint8_t raw[EVENTLOG_RECORD_SIZE];
+    fmt_P(PSTR("eventlog %u %u\n"), EVENTLOG_SLOTS, EVENTLOG_RECORD_SIZE);
+    for (uint8_t n = 0; n < EVENTLOG_SLOTS; n++) {
+      eventlog_read_raw(n, raw);
+      // As is, without newline translation
+      while (!uart_write(raw, EVENTLOG_RECORD_SIZE))
+        hal_busy_wait();
+    }
+    return;
+  }
+
+  static const char event_boot[] PROGMEM = "boot, reset";
+  static const char event_mode[] PROGMEM = "mode";
+  static const char event_lost[] PROGMEM = "connection lost";
+  static const char event_back[] PROGMEM = "connection back";
+  static const char event_feedback[] PROGMEM = "relay feedback";
+  static const char event_cut[] PROGMEM = "heater cut";
+  static const char event_stack[] PROGMEM = "stack low";
+  static PGM_P const events[] PROGMEM = {
+    [EVENTLOG_BOOT] = event_boot,
+    [EVENTLOG_MODE] = event_mode,
+    [EVENTLOG_CONNECTION_LOST] = event_lost,
+    [EVENTLOG_CONNECTION_BACK] = event_back,
+    [EVENTLOG_RELAY_FEEDBACK] = event_feedback,
+    [EVENTLOG_HEATER_CUT] = event_cut,
+    [EVENTLOG_STACK_LOW] = event_stack,
+  };
+  static const char mode_off[] PROGMEM = "OFF";
+  static const char mode_heating[] PROGMEM = "HEATING";
+  static const char mode_ready[] PROGMEM = "READY";
+  static const char mode_oil[] PROGMEM = "OIL";
+  static const char mode_emergency[] PROGMEM = "EMERGENCY";
+  static const char mode_error[] PROGMEM = "ERROR";
+  static PGM_P const modes[] PROGMEM = {
+    [UTOPHUILE_MODE_OFF] = mode_off,
+    [UTOPHUILE_MODE_HEATING] = mode_heating,
+    [UTOPHUILE_MODE_READY] = mode_ready,
+    [UTOPHUILE_MODE_OIL] = mode_oil,
+    [UTOPHUILE_MODE_EMERGENCY] = mode_emergency,
+    [UTOPHUILE_MODE_ERROR] = mode_error,
+  };
+  eventlog_record_t record;
+  for (uint8_t n = 0; n < EVENTLOG_SLOTS; n++) {
+    if (!eventlog_read(n, &record) || (record.event >= EVENTLOG_EVENT_COUNT))
+      continue;
+    fmt_P(PSTR("#%u %u s: %S "), record.sequence, record.time, (PGM_P)pgm_read_ptr(&events[record.event]));
+    if ((record.event == EVENTLOG_MODE) && (record.arg <= UTOPHUILE_MODE_ERROR))
+      fmt_P(PSTR("%S"), (PGM_P)pgm_read_ptr(&modes[record.arg]));
+    else
+      fmt_P(PSTR("0x%02x"), record.arg);
+    if (record.temperature != EVENTLOG_NO_TEMPERATURE)
+      fmt_P(PSTR(", %.1d °C"), record.temperature);
+    fmt_char('\n');
   }
+  if (eventlog_dropped() != 0)
+    fmt_P(PSTR("%u events dropped\n"), eventlog_dropped());
 }
 
 // Fake values
 void
-utophuile_debug_command_fake(const char *args)
+utophuile_debug_command_fake(const uint8_t argc, char *argv[])
 {
-  char subcommand[128];
-  if (sscanf_P(args, PSTR("%*s %s"), subcommand) > 0) {
+  if (argc > 1) {
     // Look for an exact match
     for (size_t n = 0; n < 1; n++) {
-      if (0 == strcmp_P(subcommand, PSTR("temp"))) {
-        if (sscanf_P(args, PSTR("%*s %*s %"PRIi16), &_fake_oil_temperature) > 0) {
+      if (shell_arg_is_P(argv[1], PSTR("temp"))) {
+        if ((argc > 2) && shell_arg_int16(argv[2], &_fake_oil_temperature)) {
+          fmt_P(PSTR("fake oil temperature: %d\n"), _fake_oil_temperature);
+          _fake_oil_temperature = TEMPERATURE_C(_fake_oil_temperature);
           _utophuile_oil_temperature_is_fake = true;
-          printf_P(PSTR("fake oil temperature: %"PRIi16"\n"), _fake_oil_temperature);
           return;
         } else {
           _utophuile_oil_temperature_is_fake = false;
-          printf_P(PSTR("fake oil temperature disabled\n"));
+          fmt_P(PSTR("fake oil temperature disabled\n"));
           return;
         }
       }
     }
-    printf_P(PSTR("\"%s\" is not an unknown subcommand of 'fake'\n"), subcommand);
+    fmt_P(PSTR("\"%s\" is not an unknown subcommand of 'fake'\n"), argv[1]);
   }
 }
 
@@ -385,29 +828,28 @@ typedef struct {
 static relay_item relay_lut[4];
 
 void
-utophuile_debug_command_relay(const char *args)
+utophuile_debug_command_relay(const uint8_t argc, char *argv[])
 {
   RELAY_DECL(0, "VI", RELAY_VALVE_INPUT);
   RELAY_DECL(1, "VO", RELAY_VALVE_OUTPUT);
   RELAY_DECL(2, "P", RELAY_PUMP);
   RELAY_DECL(3, "H", RELAY_HEATER);
 
-  char subcommand[128];
-  if (sscanf_P(args, PSTR("%*s %s"), subcommand) > 0) {
+  if (argc > 1) {
     // Look for an exact match
     bool found = false;
     for (size_t n = 0; (n < 4) & !found; n++) {
-      if (0 == strcmp_P(subcommand, relay_lut[n].label)) {
+      if (shell_arg_is_P(argv[1], relay_lut[n].label)) {
         uint8_t on;
-        if (sscanf_P(args, PSTR("%*s %*s %u"), &on) > 0) {
+        if ((argc > 2) && shell_arg_uint8(argv[2], &on)) {
           const uint8_t lut_value = relay_lut[n].value;
-          printf_P(PSTR("on: %"PRIu8"\n"), on);
-          printf_P(PSTR("lut value: %"PRIu8"\n"), lut_value);
-          printf_P(PSTR("rm before: %"PRIu8"\n"), relay_mode());
+          fmt_P(PSTR("on: %u\n"), on);
+          fmt_P(PSTR("lut value: %u\n"), lut_value);
+          fmt_P(PSTR("rm before: %u\n"), relay_mode());
           relay_set(lut_value, on);
-          printf_P(PSTR("rm after: %"PRIu8"\n"), relay_mode());
+          fmt_P(PSTR("rm after: %u\n"), relay_mode());
         } else {
-          printf_P(PSTR("%s is %s\n"), relay_lut[n].label, (relay_mode() & relay_lut[n].value) ? "ON" : "OFF");
+          fmt_P(PSTR("%S is %S\n"), relay_lut[n].label, utophuile_on_off(relay_mode() & _BV(relay_lut[n].value)));
         }
       }
     }
@@ -1,6 +1,15 @@
 #ifndef __UTOPHUILE_H__
 #define __UTOPHUILE_H__
 
+typedef enum {
+  UTOPHUILE_MODE_OFF,
+  UTOPHUILE_MODE_HEATING,
+  UTOPHUILE_MODE_READY,
+  UTOPHUILE_MODE_OIL,
+  UTOPHUILE_MODE_EMERGENCY,
+  UTOPHUILE_MODE_ERROR
+} utophuile_mode_t;
 
+utophuile_mode_t utophuile_mode(void);
 
-#endif		/*	__UTOPHUILE_H__ */
\ No newline at end of file
+#endif		/*	__UTOPHUILE_H__ */